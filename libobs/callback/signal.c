@@ -15,44 +15,126 @@
  */
 
 #include "../util/darray.h"
+#include "../util/platform.h"
 #include "../util/threading.h"
 
 #include "decl.h"
 #include "signal.h"
 
+/*
+ * Emitting a signal takes no locks.  Each signal's callbacks are kept in an
+ * immutable list which connect/disconnect replace as a whole.  Emitters
+ * register themselves in one of two counters (chosen by the parity of
+ * 'epoch') before loading the list.  After publishing a new list, a writer
+ * waits for both counters to drain, flipping the epoch before each wait so
+ * that new emitters go to the other counter.  After that nothing on another
+ * thread can still be using the old list, or be calling a callback that was
+ * just disconnected.
+ *
+ * A writer that is itself inside a callback of the same signal cannot wait
+ * for other emitters (they may be waiting on it), so it only retires the old
+ * list; a later writer or the handler's destruction frees it.  Disconnect
+ * still has to guarantee the callback is no longer running elsewhere, so it
+ * also waits on the callback's own count of running calls, not counting
+ * the ones this thread is nested in.
+ */
+
+#define SIGNAL_BUCKETS 32
+
 struct signal_callback {
 	signal_callback_t callback;
 	void              *data;
-	bool              remove;
+	volatile bool     remove;
+
+	/* number of lists holding this callback */
+	volatile long     refs;
+
+	/* number of emitters about to call or calling this callback */
+	volatile long     active;
+};
+
+struct signal_callbacks {
+	size_t                  num;
+	struct signal_callback  **array;
+	struct signal_callbacks *next_retired;
 };
 
 struct signal_info {
 	struct decl_info               func;
-	DARRAY(struct signal_callback) callbacks;
+	struct signal_callbacks        *volatile callbacks;
+
+	/* replaced lists that may still be in use, and the lock guarding
+	 * both lists; never held while waiting on emitters */
+	struct signal_callbacks        *volatile retired;
 	pthread_mutex_t                mutex;
-	bool                           signalling;
+
+	volatile long                  epoch;
+	volatile long                  emitters[2];
 
 	struct signal_info             *next;
 };
 
+/* signals currently being emitted by this thread, innermost first */
+struct emit_frame {
+	struct signal_info     *sig;
+	struct signal_callback *cb;
+	long                   parity;
+	struct emit_frame      *prev;
+};
+
+#ifdef _MSC_VER
+static __declspec(thread) struct emit_frame *thread_frames = NULL;
+#else
+static __thread struct emit_frame *thread_frames = NULL;
+#endif
+
+static struct signal_callbacks *callbacks_create(size_t num)
+{
+	struct signal_callbacks *list = bzalloc(sizeof(struct signal_callbacks)
+			+ sizeof(struct signal_callback*) * num);
+
+	list->num   = num;
+	list->array = (struct signal_callback**)(list + 1);
+	return list;
+}
+
+static void callbacks_free(struct signal_callbacks *list)
+{
+	if (!list)
+		return;
+
+	for (size_t i = 0; i < list->num; i++) {
+		struct signal_callback *cb = list->array[i];
+		if (os_atomic_dec_long(&cb->refs) == 0)
+			bfree(cb);
+	}
+
+	bfree(list);
+}
+
+static void free_callbacks_chain(struct signal_callbacks *list)
+{
+	while (list) {
+		struct signal_callbacks *next = list->next_retired;
+		callbacks_free(list);
+		list = next;
+	}
+}
+
+static inline struct signal_callbacks *get_callbacks(struct signal_info *si)
+{
+	return os_atomic_load_ptr((void *const volatile*)&si->callbacks);
+}
+
 static inline struct signal_info *signal_info_create(struct decl_info *info)
 {
-	pthread_mutexattr_t attr;
 	struct signal_info *si;
 
-	if (pthread_mutexattr_init(&attr) != 0)
-		return NULL;
-	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
-		return NULL;
-
-	si = bmalloc(sizeof(struct signal_info));
+	si = bzalloc(sizeof(struct signal_info));
 
-	si->func       = *info;
-	si->next       = NULL;
-	si->signalling = false;
-	da_init(si->callbacks);
+	si->func = *info;
 
-	if (pthread_mutex_init(&si->mutex, &attr) != 0) {
+	if (pthread_mutex_init(&si->mutex, NULL) != 0) {
 		blog(LOG_ERROR, "Could not create signal");
 
 		decl_info_free(&si->func);
@@ -66,18 +148,22 @@ static inline struct signal_info *signal_info_create(struct decl_info *info)
 static inline void signal_info_destroy(struct signal_info *si)
 {
 	if (si) {
+		free_callbacks_chain(si->retired);
 		pthread_mutex_destroy(&si->mutex);
 		decl_info_free(&si->func);
-		da_free(si->callbacks);
+		callbacks_free(si->callbacks);
 		bfree(si);
 	}
 }
 
-static inline size_t signal_get_callback_idx(struct signal_info *si,
+static inline size_t signal_get_callback_idx(struct signal_callbacks *list,
 		signal_callback_t callback, void *data)
 {
-	for (size_t i = 0; i < si->callbacks.num; i++) {
-		struct signal_callback *sc = si->callbacks.array+i;
+	if (!list)
+		return DARRAY_INVALID;
+
+	for (size_t i = 0; i < list->num; i++) {
+		struct signal_callback *sc = list->array[i];
 
 		if (sc->callback == callback && sc->data == data)
 			return i;
@@ -86,27 +172,127 @@ static inline size_t signal_get_callback_idx(struct signal_info *si,
 	return DARRAY_INVALID;
 }
 
+static bool emitting_on_thread(struct signal_info *si)
+{
+	for (struct emit_frame *frame = thread_frames; frame;
+			frame = frame->prev) {
+		if (frame->sig == si)
+			return true;
+	}
+
+	return false;
+}
+
+/* frees lists retired by nested writers once nothing is emitting */
+static void free_retired_callbacks(struct signal_info *si)
+{
+	struct signal_callbacks *retired = NULL;
+
+	if (pthread_mutex_trylock(&si->mutex) != 0)
+		return;
+
+	/* lists are only retired with the lock held, so if there are no
+	 * emitters now, nothing can still be using the retired ones */
+	if (!os_atomic_load_long(&si->emitters[0]) &&
+	    !os_atomic_load_long(&si->emitters[1])) {
+		retired = os_atomic_set_ptr((void *volatile*)&si->retired,
+				NULL);
+	}
+
+	pthread_mutex_unlock(&si->mutex);
+
+	free_callbacks_chain(retired);
+}
+
+static void wait_for_emitters(struct signal_info *si)
+{
+	for (int i = 0; i < 2; i++) {
+		long parity = (os_atomic_inc_long(&si->epoch) - 1) & 1;
+
+		while (os_atomic_load_long(&si->emitters[parity]) > 0)
+			os_sleep_ms(1);
+	}
+}
+
+/* waits until no other thread is calling a callback that has been marked
+ * for removal */
+static void wait_for_callback(struct signal_callback *cb)
+{
+	long own = 0;
+
+	for (struct emit_frame *frame = thread_frames; frame;
+			frame = frame->prev) {
+		if (frame->cb == cb)
+			own++;
+	}
+
+	while (os_atomic_load_long(&cb->active) > own)
+		os_sleep_ms(1);
+}
+
+/* must be called with si->mutex locked, returns with it unlocked */
+static void replace_callbacks_unlock(struct signal_info *si,
+		struct signal_callbacks *list)
+{
+	struct signal_callbacks *old;
+
+	old = os_atomic_set_ptr((void *volatile*)&si->callbacks, list);
+	if (old) {
+		old->next_retired = si->retired;
+		os_atomic_set_ptr((void *volatile*)&si->retired, old);
+	}
+
+	if (emitting_on_thread(si)) {
+		pthread_mutex_unlock(&si->mutex);
+		return;
+	}
+
+	/* everything retired so far was unpublished before this point, so
+	 * it can be freed once the current emitters are done */
+	old = os_atomic_set_ptr((void *volatile*)&si->retired, NULL);
+	pthread_mutex_unlock(&si->mutex);
+
+	wait_for_emitters(si);
+	free_callbacks_chain(old);
+}
+
 struct signal_handler {
-	struct signal_info *first;
-	pthread_mutex_t    mutex;
+	struct signal_info *volatile buckets[SIGNAL_BUCKETS];
+	pthread_mutex_t             mutex;
 };
 
+static inline size_t signal_hash(const char *name)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619U;
+	}
+
+	return (size_t)hash & (SIGNAL_BUCKETS - 1);
+}
+
+/* signals are never removed from a handler, so lookups need no lock */
 static struct signal_info *getsignal(signal_handler_t *handler,
-		const char *name, struct signal_info **p_last)
+		const char *name)
 {
-	struct signal_info *signal, *last= NULL;
+	struct signal_info *signal;
+
+	if (!handler)
+		return NULL;
+
+	signal = os_atomic_load_ptr((void *const volatile*)
+			&handler->buckets[signal_hash(name)]);
 
-	signal = handler->first;
 	while (signal != NULL) {
 		if (strcmp(signal->func.name, name) == 0)
 			break;
 
-		last = signal;
 		signal = signal->next;
 	}
 
-	if (p_last)
-		*p_last = last;
 	return signal;
 }
 
@@ -114,8 +300,7 @@ static struct signal_info *getsignal(signal_handler_t *handler,
 
 signal_handler_t *signal_handler_create(void)
 {
-	struct signal_handler *handler = bmalloc(sizeof(struct signal_handler));
-	handler->first = NULL;
+	struct signal_handler *handler = bzalloc(sizeof(struct signal_handler));
 
 	if (pthread_mutex_init(&handler->mutex, NULL) != 0) {
 		blog(LOG_ERROR, "Couldn't create signal handler!");
@@ -129,11 +314,13 @@ signal_handler_t *signal_handler_create(void)
 void signal_handler_destroy(signal_handler_t *handler)
 {
 	if (handler) {
-		struct signal_info *sig = handler->first;
-		while (sig != NULL) {
-			struct signal_info *next = sig->next;
-			signal_info_destroy(sig);
-			sig = next;
+		for (size_t i = 0; i < SIGNAL_BUCKETS; i++) {
+			struct signal_info *sig = handler->buckets[i];
+			while (sig != NULL) {
+				struct signal_info *next = sig->next;
+				signal_info_destroy(sig);
+				sig = next;
+			}
 		}
 
 		pthread_mutex_destroy(&handler->mutex);
@@ -144,7 +331,7 @@ void signal_handler_destroy(signal_handler_t *handler)
 bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 {
 	struct decl_info func = {0};
-	struct signal_info *sig, *last;
+	struct signal_info *sig;
 	bool success = true;
 
 	if (!parse_decl_string(&func, signal_decl)) {
@@ -154,17 +341,22 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 
 	pthread_mutex_lock(&handler->mutex);
 
-	sig = getsignal(handler, func.name, &last);
+	sig = getsignal(handler, func.name);
 	if (sig) {
 		blog(LOG_WARNING, "Signal declaration '%s' exists", func.name);
 		decl_info_free(&func);
 		success = false;
 	} else {
+		size_t bucket = signal_hash(func.name);
+
 		sig = signal_info_create(&func);
-		if (!last)
-			handler->first = sig;
-		else
-			last->next = sig;
+		if (sig) {
+			sig->next = handler->buckets[bucket];
+			os_atomic_set_ptr((void *volatile*)
+					&handler->buckets[bucket], sig);
+		} else {
+			success = false;
+		}
 	}
 
 	pthread_mutex_unlock(&handler->mutex);
@@ -175,17 +367,15 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 void signal_handler_connect(signal_handler_t *handler, const char *signal,
 		signal_callback_t callback, void *data)
 {
-	struct signal_info *sig, *last;
-	struct signal_callback cb_data = {callback, data, false};
-	size_t idx;
+	struct signal_info *sig;
+	struct signal_callbacks *old_list, *list;
+	struct signal_callback *cb;
+	size_t num;
 
 	if (!handler)
 		return;
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, signal, &last);
-	pthread_mutex_unlock(&handler->mutex);
-
+	sig = getsignal(handler, signal);
 	if (!sig) {
 		blog(LOG_WARNING, "signal_handler_connect: "
 		                  "signal '%s' not found", signal);
@@ -196,32 +386,36 @@ void signal_handler_connect(signal_handler_t *handler, const char *signal,
 
 	pthread_mutex_lock(&sig->mutex);
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx == DARRAY_INVALID)
-		da_push_back(sig->callbacks, &cb_data);
-	
-	pthread_mutex_unlock(&sig->mutex);
-}
+	old_list = sig->callbacks;
+	if (signal_get_callback_idx(old_list, callback, data) !=
+			DARRAY_INVALID) {
+		pthread_mutex_unlock(&sig->mutex);
+		return;
+	}
 
-static inline struct signal_info *getsignal_locked(signal_handler_t *handler,
-		const char *name)
-{
-	struct signal_info *sig;
+	num = old_list ? old_list->num : 0;
+	list = callbacks_create(num + 1);
 
-	if (!handler)
-		return NULL;
+	for (size_t i = 0; i < num; i++) {
+		list->array[i] = old_list->array[i];
+		os_atomic_inc_long(&list->array[i]->refs);
+	}
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, name, NULL);
-	pthread_mutex_unlock(&handler->mutex);
+	cb = bzalloc(sizeof(struct signal_callback));
+	cb->callback = callback;
+	cb->data     = data;
+	cb->refs     = 1;
+	list->array[num] = cb;
 
-	return sig;
+	replace_callbacks_unlock(sig, list);
 }
 
 void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 		signal_callback_t callback, void *data)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_info *sig = getsignal(handler, signal);
+	struct signal_callbacks *old_list, *list = NULL;
+	struct signal_callback *cb;
 	size_t idx;
 
 	if (!sig)
@@ -229,40 +423,78 @@ void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 
 	pthread_mutex_lock(&sig->mutex);
 
-	idx = signal_get_callback_idx(sig, callback, data);
+	old_list = sig->callbacks;
+	idx = signal_get_callback_idx(old_list, callback, data);
 	if (idx != DARRAY_INVALID) {
-		if (sig->signalling)
-			sig->callbacks.array[idx].remove = true;
-		else
-			da_erase(sig->callbacks, idx);
+		/* skipped by anything still iterating the old list */
+		cb = old_list->array[idx];
+		os_atomic_set_bool(&cb->remove, true);
+		os_atomic_inc_long(&cb->refs);
+
+		if (old_list->num > 1) {
+			size_t num = 0;
+
+			list = callbacks_create(old_list->num - 1);
+			for (size_t i = 0; i < old_list->num; i++) {
+				if (i == idx)
+					continue;
+
+				list->array[num] = old_list->array[i];
+				os_atomic_inc_long(&list->array[num++]->refs);
+			}
+		}
+
+		replace_callbacks_unlock(sig, list);
+
+		wait_for_callback(cb);
+		if (os_atomic_dec_long(&cb->refs) == 0)
+			bfree(cb);
+		return;
 	}
-	
+
 	pthread_mutex_unlock(&sig->mutex);
 }
 
 void signal_handler_signal(signal_handler_t *handler, const char *signal,
 		calldata_t *params)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_info *sig = getsignal(handler, signal);
+	struct signal_callbacks *list;
+	struct emit_frame frame;
 
 	if (!sig)
 		return;
 
-	pthread_mutex_lock(&sig->mutex);
-	sig->signalling = true;
-
-	for (size_t i = 0; i < sig->callbacks.num; i++) {
-		struct signal_callback *cb = sig->callbacks.array+i;
-		if (!cb->remove)
-			cb->callback(cb->data, params);
+	/* register before loading the list (inc is a full barrier) */
+	frame.parity = os_atomic_load_long(&sig->epoch) & 1;
+	os_atomic_inc_long(&sig->emitters[frame.parity]);
+
+	frame.sig  = sig;
+	frame.cb   = NULL;
+	frame.prev = thread_frames;
+	thread_frames = &frame;
+
+	list = get_callbacks(sig);
+
+	if (list) {
+		for (size_t i = 0; i < list->num; i++) {
+			struct signal_callback *cb = list->array[i];
+
+			/* registered before checking 'remove', so a
+			 * disconnect either stops the call or waits for it */
+			os_atomic_inc_long(&cb->active);
+			if (!os_atomic_load_bool(&cb->remove)) {
+				frame.cb = cb;
+				cb->callback(cb->data, params);
+				frame.cb = NULL;
+			}
+			os_atomic_dec_long(&cb->active);
+		}
 	}
 
-	for (size_t i = sig->callbacks.num; i > 0; i--) {
-		struct signal_callback *cb = sig->callbacks.array+i-1;
-		if (cb->remove)
-			da_erase(sig->callbacks, i-1);
-	}
+	thread_frames = frame.prev;
+	os_atomic_dec_long(&sig->emitters[frame.parity]);
 
-	sig->signalling = false;
-	pthread_mutex_unlock(&sig->mutex);
+	if (os_atomic_load_ptr((void *const volatile*)&sig->retired))
+		free_retired_callbacks(sig);
 }
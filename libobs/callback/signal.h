@@ -57,6 +57,13 @@ static inline bool signal_handler_add_array(signal_handler_t *handler,
 
 EXPORT void signal_handler_connect(signal_handler_t *handler,
 		const char *signal, signal_callback_t callback, void *data);
+
+/**
+ * Once this returns, the callback will not be called again and is not
+ * running on any other thread, even when called from inside a callback of
+ * the same signal.  Two callbacks running on different threads must not
+ * disconnect each other at the same time.
+ */
 EXPORT void signal_handler_disconnect(signal_handler_t *handler,
 		const char *signal, signal_callback_t callback, void *data);
 
@@ -18,6 +18,7 @@
 #include "image-file.h"
 #include "../util/base.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 
 #define blog(level, format, ...) \
 	blog(level, "%s: " format, __FUNCTION__, __VA_ARGS__)
@@ -54,16 +55,290 @@ static void bi_def_bitmap_modified(void *bitmap)
 	UNUSED_PARAMETER(bitmap);
 }
 
-static inline int get_full_decoded_gif_size(gs_image_file_t *image)
+/* gifs that decode to more than this are not cached in full.  instead, a
+ * thread decodes ahead of playback into a cache of GIF_STREAM_CACHE_SIZE
+ * (but at least GIF_STREAM_MIN_FRAMES frames), evicting the least recently
+ * used frames that aren't coming up next */
+#define GIF_MAX_CACHE_SIZE    (256ULL * 1024ULL * 1024ULL)
+#define GIF_STREAM_CACHE_SIZE (64ULL * 1024ULL * 1024ULL)
+#define GIF_STREAM_MIN_FRAMES 4
+
+struct gs_gif_stream {
+	pthread_t       thread;
+	bool            thread_created;
+	os_event_t      *event;
+	volatile bool   stop;
+
+	/* protects animation_frame_cache and the slots */
+	pthread_mutex_t mutex;
+	size_t          frame_size;
+	size_t          num_slots;
+	int             *slot_frames;
+	uint64_t        *slot_last_used;
+	uint64_t        use_count;
+
+	/* frames from play_frame on are decoded ahead of time */
+	volatile long   play_frame;
+	int             decode_ahead;
+	int             displayed_frame;
+};
+
+static inline uint64_t get_frame_size(gs_image_file_t *image)
 {
-	return image->gif.width * image->gif.height * 4 * image->gif.frame_count;
+	return (uint64_t)image->gif.width * (uint64_t)image->gif.height * 4;
 }
 
+static inline uint64_t get_full_decoded_gif_size(gs_image_file_t *image)
+{
+	return get_frame_size(image) * (uint64_t)image->gif.frame_count;
+}
+
+/* caches every frame at load, so playback never has to decode.  a damaged
+ * frame is cached as far as it could be decoded, like when streaming */
+static void init_frame_cache(gs_image_file_t *image, const char *path)
+{
+	size_t frame_size = (size_t)get_frame_size(image);
+
+	image->animation_frame_cache = bzalloc(
+			image->gif.frame_count * sizeof(uint8_t*));
+	image->animation_frame_data = bmalloc(
+			(size_t)get_full_decoded_gif_size(image));
+
+	for (unsigned int i = 0; i < image->gif.frame_count; i++) {
+		if (gif_decode_frame(&image->gif, i) != GIF_OK)
+			blog(LOG_WARNING, "Couldn't decode frame %u "
+					"of '%s'", i, path);
+
+		image->animation_frame_cache[i] =
+			image->animation_frame_data + i * frame_size;
+		memcpy(image->animation_frame_cache[i],
+				image->gif.frame_image, frame_size);
+	}
+
+	image->last_decoded_frame = (int)image->gif.frame_count - 1;
+}
+
+/* gif frames are drawn over the previous frame, so frames have to be
+ * decoded in order.  returns false on error, though gif.frame_image then
+ * still holds whatever could be decoded. */
+static bool decode_frame(gs_image_file_t *image, int frame)
+{
+	int first_frame;
+	bool success = true;
+
+	/* if looped, decode frame 0 */
+	first_frame = (frame < image->last_decoded_frame) ?
+		0 : image->last_decoded_frame + 1;
+
+	/* decode missed frames */
+	for (int i = first_frame; i < frame; i++) {
+		if (gif_decode_frame(&image->gif, i) != GIF_OK)
+			success = false;
+	}
+
+	/* decode actual desired frame */
+	if (gif_decode_frame(&image->gif, frame) != GIF_OK)
+		success = false;
+
+	image->last_decoded_frame = frame;
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+/* streaming (bounded memory) decoding of large gifs */
+
+static inline bool is_upcoming_frame(gs_image_file_t *image, int frame,
+		int play_frame)
+{
+	int count = (int)image->gif.frame_count;
+	int distance = (frame - play_frame + count) % count;
+
+	return distance < image->gif_stream->decode_ahead;
+}
+
+/* called with the mutex held */
+static int get_next_frame_to_decode(gs_image_file_t *image, int play_frame)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+	int count = (int)image->gif.frame_count;
+
+	for (int i = 0; i < stream->decode_ahead; i++) {
+		int frame = (play_frame + i) % count;
+		if (!image->animation_frame_cache[frame])
+			return frame;
+	}
+
+	return -1;
+}
+
+/* called with the mutex held.  frames that are displayed or coming up are
+ * never evicted, and there is always at least one slot more than those */
+static size_t get_free_slot(gs_image_file_t *image, int play_frame)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+	size_t lru = stream->num_slots;
+
+	for (size_t i = 0; i < stream->num_slots; i++) {
+		int frame = stream->slot_frames[i];
+
+		if (frame == -1)
+			return i;
+		if (frame == stream->displayed_frame ||
+		    is_upcoming_frame(image, frame, play_frame))
+			continue;
+
+		if (lru == stream->num_slots ||
+		    stream->slot_last_used[i] < stream->slot_last_used[lru])
+			lru = i;
+	}
+
+	image->animation_frame_cache[stream->slot_frames[lru]] = NULL;
+	stream->slot_frames[lru] = -1;
+	return lru;
+}
+
+static void cache_frame(gs_image_file_t *image, int frame, int play_frame)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+	uint8_t *data;
+	size_t slot;
+
+	pthread_mutex_lock(&stream->mutex);
+	slot = get_free_slot(image, play_frame);
+	stream->slot_frames[slot] = frame;
+	pthread_mutex_unlock(&stream->mutex);
+
+	/* the slot can't be used by anything else until the frame is
+	 * published in animation_frame_cache, so no need to copy locked */
+	data = image->animation_frame_data + slot * stream->frame_size;
+	memcpy(data, image->gif.frame_image, stream->frame_size);
+
+	pthread_mutex_lock(&stream->mutex);
+	image->animation_frame_cache[frame] = data;
+	stream->slot_last_used[slot] = ++stream->use_count;
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static void decode_ahead(gs_image_file_t *image)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+
+	while (!os_atomic_load_bool(&stream->stop)) {
+		int play_frame = (int)os_atomic_load_long(&stream->play_frame);
+		int frame;
+
+		pthread_mutex_lock(&stream->mutex);
+		frame = get_next_frame_to_decode(image, play_frame);
+		pthread_mutex_unlock(&stream->mutex);
+
+		if (frame == -1)
+			break;
+
+		/* a damaged frame is still cached, otherwise it would be
+		 * decoded again on every tick */
+		decode_frame(image, frame);
+		cache_frame(image, frame, play_frame);
+	}
+}
+
+static void *gif_stream_thread(void *param)
+{
+	gs_image_file_t *image = param;
+	struct gs_gif_stream *stream = image->gif_stream;
+
+	os_set_thread_name("image-file: gif decode thread");
+
+	while (os_event_wait(stream->event) == 0) {
+		if (os_atomic_load_bool(&stream->stop))
+			break;
+
+		decode_ahead(image);
+	}
+
+	return NULL;
+}
+
+static inline void set_play_frame(struct gs_gif_stream *stream, int frame)
+{
+	if (os_atomic_load_long(&stream->play_frame) != (long)frame) {
+		os_atomic_set_long(&stream->play_frame, (long)frame);
+		os_event_signal(stream->event);
+	}
+}
+
+static bool init_gif_stream(gs_image_file_t *image)
+{
+	struct gs_gif_stream *stream = bzalloc(sizeof(struct gs_gif_stream));
+	size_t frame_size = (size_t)get_frame_size(image);
+	size_t num_slots = (size_t)(GIF_STREAM_CACHE_SIZE / frame_size);
+
+	if (num_slots < GIF_STREAM_MIN_FRAMES)
+		num_slots = GIF_STREAM_MIN_FRAMES;
+	if (num_slots > image->gif.frame_count)
+		num_slots = image->gif.frame_count;
+
+	pthread_mutex_init_value(&stream->mutex);
+	image->gif_stream = stream;
+
+	stream->frame_size     = frame_size;
+	stream->num_slots      = num_slots;
+	stream->decode_ahead   = (int)num_slots - 1;
+	stream->slot_frames    = bmalloc(num_slots * sizeof(int));
+	stream->slot_last_used = bzalloc(num_slots * sizeof(uint64_t));
+
+	for (size_t i = 0; i < num_slots; i++)
+		stream->slot_frames[i] = -1;
+
+	image->animation_frame_cache = bzalloc(
+			image->gif.frame_count * sizeof(uint8_t*));
+	image->animation_frame_data = bmalloc(num_slots * frame_size);
+
+	if (pthread_mutex_init(&stream->mutex, NULL) != 0)
+		return false;
+	if (os_event_init(&stream->event, OS_EVENT_TYPE_AUTO) != 0)
+		return false;
+
+	/* frame 0 is needed right away to create the texture */
+	decode_frame(image, 0);
+	cache_frame(image, 0, 0);
+
+	if (pthread_create(&stream->thread, NULL, gif_stream_thread,
+				image) != 0)
+		return false;
+
+	stream->thread_created = true;
+	os_event_signal(stream->event);
+	return true;
+}
+
+static void free_gif_stream(gs_image_file_t *image)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+
+	if (!stream)
+		return;
+
+	if (stream->thread_created) {
+		os_atomic_set_bool(&stream->stop, true);
+		os_event_signal(stream->event);
+		pthread_join(stream->thread, NULL);
+	}
+
+	os_event_destroy(stream->event);
+	pthread_mutex_destroy(&stream->mutex);
+	bfree(stream->slot_frames);
+	bfree(stream->slot_last_used);
+	bfree(stream);
+
+	image->gif_stream = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static bool init_animated_gif(gs_image_file_t *image, const char *path)
 {
 	bool is_animated_gif = true;
 	gif_result result;
-	uint64_t max_size;
 	size_t size;
 	FILE *file;
 
@@ -104,32 +379,27 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path)
 		goto fail;
 	}
 
-	max_size = (uint64_t)image->gif.width * (uint64_t)image->gif.height *
-		(uint64_t)image->gif.frame_count * 4LLU;
-
-	if ((uint64_t)get_full_decoded_gif_size(image) != max_size) {
-		blog(LOG_WARNING, "Gif '%s' overflowed maximum pointer size",
-				path);
-		goto fail;
-	}
-
 	image->is_animated_gif = (image->gif.frame_count > 1 && result >= 0);
 	if (image->is_animated_gif) {
-		gif_decode_frame(&image->gif, 0);
+		if (get_full_decoded_gif_size(image) <= GIF_MAX_CACHE_SIZE) {
+			init_frame_cache(image, path);
 
-		image->animation_frame_cache = bzalloc(
-				image->gif.frame_count * sizeof(uint8_t*));
-		image->animation_frame_data = bzalloc(
-				get_full_decoded_gif_size(image));
+		} else if (!init_gif_stream(image)) {
+			blog(LOG_WARNING, "Failed to start decoding '%s'",
+					path);
+			goto fail;
 
-		for (unsigned int i = 0; i < image->gif.frame_count; i++) {
-			if (gif_decode_frame(&image->gif, i) != GIF_OK)
-				blog(LOG_WARNING, "Couldn't decode frame %u "
-						"of '%s'", i, path);
+		} else {
+			blog(LOG_INFO, "'%s' is too large to cache (%u "
+					"frames, %llu MB), caching %d frames "
+					"at a time", path,
+					image->gif.frame_count,
+					(unsigned long long)
+					get_full_decoded_gif_size(image) /
+					(1024 * 1024),
+					(int)image->gif_stream->num_slots);
 		}
 
-		gif_decode_frame(&image->gif, 0);
-
 		image->cx = (uint32_t)image->gif.width;
 		image->cy = (uint32_t)image->gif.height;
 		image->format = GS_RGBA;
@@ -187,16 +457,18 @@ void gs_image_file_free(gs_image_file_t *image)
 	if (!image)
 		return;
 
+	/* the decode thread uses the gif, so it has to stop first */
+	free_gif_stream(image);
+
 	if (image->loaded) {
-		if (image->is_animated_gif) {
+		if (image->is_animated_gif)
 			gif_finalise(&image->gif);
-			bfree(image->animation_frame_cache);
-			bfree(image->animation_frame_data);
-		}
 
 		gs_texture_destroy(image->texture);
 	}
 
+	bfree(image->animation_frame_cache);
+	bfree(image->animation_frame_data);
 	bfree(image->texture_data);
 	bfree(image->gif_data);
 	memset(image, 0, sizeof(*image));
@@ -208,10 +480,21 @@ void gs_image_file_init_texture(gs_image_file_t *image)
 		return;
 
 	if (image->is_animated_gif) {
+		struct gs_gif_stream *stream = image->gif_stream;
+		const uint8_t *frame;
+
+		/* frame 0 is always cached at this point.  when streaming,
+		 * it's only safe to use while locked */
+		if (stream)
+			pthread_mutex_lock(&stream->mutex);
+		frame = image->animation_frame_cache[0];
+
 		image->texture = gs_texture_create(
 				image->cx, image->cy, image->format, 1,
-				(const uint8_t**)&image->gif.frame_image,
-				GS_DYNAMIC);
+				&frame, GS_DYNAMIC);
+
+		if (stream)
+			pthread_mutex_unlock(&stream->mutex);
 
 	} else {
 		image->texture = gs_texture_create(
@@ -255,40 +538,6 @@ static inline int calculate_new_frame(gs_image_file_t *image,
 	return new_frame;
 }
 
-static void decode_new_frame(gs_image_file_t *image, int new_frame)
-{
-	if (!image->animation_frame_cache[new_frame]) {
-		int last_frame;
-
-		/* if looped, decode frame 0 */
-		last_frame = (new_frame < image->last_decoded_frame) ?
-			0 : image->last_decoded_frame + 1;
-
-		/* decode missed frames */
-		for (int i = last_frame; i < new_frame; i++) {
-			if (gif_decode_frame(&image->gif, i) != GIF_OK)
-				return;
-		}
-
-		/* decode actual desired frame */
-		if (gif_decode_frame(&image->gif, new_frame) == GIF_OK) {
-			size_t pos = new_frame * image->gif.width *
-				image->gif.height * 4;
-			image->animation_frame_cache[new_frame] =
-				image->animation_frame_data + pos;
-
-			memcpy(image->animation_frame_cache[new_frame],
-					image->gif.frame_image,
-					image->gif.width *
-					image->gif.height * 4);
-
-			image->last_decoded_frame = new_frame;
-		}
-	}
-
-	image->cur_frame = new_frame;
-}
-
 bool gs_image_file_tick(gs_image_file_t *image, uint64_t elapsed_time_ns)
 {
 	int loops;
@@ -305,12 +554,42 @@ bool gs_image_file_tick(gs_image_file_t *image, uint64_t elapsed_time_ns)
 				loops);
 
 		if (new_frame != image->cur_frame) {
-			decode_new_frame(image, new_frame);
+			image->cur_frame = new_frame;
+			if (image->gif_stream)
+				set_play_frame(image->gif_stream, new_frame);
 			return true;
 		}
 	}
 
-	return false;
+	/* the frame may not have been decoded in time last tick */
+	return image->gif_stream &&
+		image->gif_stream->displayed_frame != image->cur_frame;
+}
+
+/* never decodes; if the decode thread is behind, the previous frame stays
+ * up until the current one is ready */
+static void update_streamed_texture(gs_image_file_t *image)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+	uint8_t *frame;
+
+	set_play_frame(stream, image->cur_frame);
+
+	pthread_mutex_lock(&stream->mutex);
+
+	frame = image->animation_frame_cache[image->cur_frame];
+	if (frame) {
+		size_t slot = (size_t)(frame - image->animation_frame_data) /
+			stream->frame_size;
+
+		gs_texture_set_image(image->texture, frame,
+				image->gif.width * 4, false);
+
+		stream->slot_last_used[slot] = ++stream->use_count;
+		stream->displayed_frame = image->cur_frame;
+	}
+
+	pthread_mutex_unlock(&stream->mutex);
 }
 
 void gs_image_file_update_texture(gs_image_file_t *image)
@@ -318,8 +597,10 @@ void gs_image_file_update_texture(gs_image_file_t *image)
 	if (!image->is_animated_gif || !image->loaded)
 		return;
 
-	if (!image->animation_frame_cache[image->cur_frame])
-		decode_new_frame(image, image->cur_frame);
+	if (image->gif_stream) {
+		update_streamed_texture(image);
+		return;
+	}
 
 	gs_texture_set_image(image->texture,
 			image->animation_frame_cache[image->cur_frame],
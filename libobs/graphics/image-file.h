@@ -40,6 +40,10 @@ struct gs_image_file {
 
 	uint8_t *texture_data;
 	gif_bitmap_callback_vt bitmap_callbacks;
+
+	/* set when the gif is too large to keep every frame decoded, see
+	 * image-file.c */
+	struct gs_gif_stream *gif_stream;
 };
 
 typedef struct gs_image_file gs_image_file_t;
@@ -25,6 +25,7 @@
 #include "../util/profiler.h"
 
 #include "audio-io.h"
+#include "audio-math.h"
 #include "audio-resampler.h"
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
@@ -164,7 +165,8 @@ static inline void do_audio_output(struct audio_output *audio,
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
+static inline void clamp_audio_output(struct audio_output *audio, size_t bytes,
+		uint32_t active_mixes)
 {
 	size_t float_size = bytes / sizeof(float);
 
@@ -172,20 +174,11 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		/* do not process mixing if a specific mix is inactive */
-		if (!mix->inputs.num)
+		if ((active_mixes & (1 << mix_idx)) == 0)
 			continue;
 
-		for (size_t plane = 0; plane < audio->planes; plane++) {
-			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
-
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val >  1.0f) ?  1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
-		}
+		for (size_t plane = 0; plane < audio->planes; plane++)
+			audio_clamp(mix->buffer[plane], float_size);
 	}
 }
 
@@ -213,15 +206,18 @@ static void input_and_output(struct audio_output *audio,
 	}
 	pthread_mutex_unlock(&audio->input_mutex);
 
-	/* clear mix buffers */
+	/* clear mix buffers.  inactive mixes are neither mixed into nor
+	 * output, so there is no need to touch them */
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
-		memset(mix->buffer[0], 0, AUDIO_OUTPUT_FRAMES *
-				MAX_AUDIO_CHANNELS * sizeof(float));
+		if ((active_mixes & (1 << mix_idx)) == 0)
+			continue;
 
-		for (size_t i = 0; i < audio->planes; i++)
+		for (size_t i = 0; i < audio->planes; i++) {
+			memset(mix->buffer[i], 0, bytes);
 			data[mix_idx].data[i] = mix->buffer[i];
+		}
 	}
 
 	/* get new audio data */
@@ -231,11 +227,15 @@ static void input_and_output(struct audio_output *audio,
 		return;
 
 	/* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(audio, bytes);
+	clamp_audio_output(audio, bytes, active_mixes);
 
-	/* output */
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	/* output.  a mix that gained its first input since the mask was taken
+	 * was not cleared this tick, so it starts on the next one */
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if (active_mixes & (1 << i))
+			do_audio_output(audio, i, new_ts,
+					AUDIO_OUTPUT_FRAMES);
+	}
 }
 
 static void *audio_thread(void *param)
@@ -246,24 +246,31 @@ static void *audio_thread(void *param)
 	uint64_t start_time = os_gettime_ns();
 	uint64_t prev_time = start_time;
 	uint64_t audio_time = prev_time;
-	uint32_t audio_wait_time =
-		(uint32_t)(audio_frames_to_ns(rate, AUDIO_OUTPUT_FRAMES) /
-				1000000);
 
 	os_set_thread_name("audio-io: audio thread");
 
-	const char *audio_thread_name =
-		profile_store_name(obs_get_profiler_name_store(),
-				"audio_thread(%s)", audio->info.name);
+	profiler_name_store_t *store = obs_get_profiler_name_store();
+	const char *audio_thread_name = profile_store_name(store,
+			"audio_thread(%s)", audio->info.name);
+	const char *wake_lateness_name = profile_store_name(store,
+			"audio_thread(%s): wake lateness", audio->info.name);
+	const char *burst_name = profile_store_name(store,
+			"audio_thread(%s): burst", audio->info.name);
 
 	while (os_event_try(audio->stop_event) == EAGAIN) {
 		uint64_t cur_time;
+		size_t ticks = 0;
+
+		/* wait for the start of the next block.  the deadline is
+		 * derived from the sample count rather than from the previous
+		 * wake-up, so lateness never accumulates */
+		os_sleepto_ns(audio_time);
 
-		os_sleep_ms(audio_wait_time);
+		cur_time = os_gettime_ns();
 
 		profile_start(audio_thread_name);
+		profile_record(wake_lateness_name, audio_time, cur_time);
 
-		cur_time = os_gettime_ns();
 		while (audio_time <= cur_time) {
 			samples += AUDIO_OUTPUT_FRAMES;
 			audio_time = start_time +
@@ -271,8 +278,13 @@ static void *audio_thread(void *param)
 
 			input_and_output(audio, audio_time, prev_time);
 			prev_time = audio_time;
+			ticks++;
 		}
 
+		/* woke up more than a whole block late and had to catch up */
+		if (ticks > 1)
+			profile_record(burst_name, cur_time, os_gettime_ns());
+
 		profile_end(audio_thread_name);
 
 		profile_reenable_thread();
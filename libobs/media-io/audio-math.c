@@ -0,0 +1,436 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "audio-math.h"
+#include "../util/platform.h"
+#include "../util/dstr.h"
+#include "../util/threading.h"
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+/* ------------------------------------------------------------------------- */
+/* C, used for the tails that don't fill a whole vector                      */
+
+static inline void add_c(float *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i];
+}
+
+static inline void add_mul_c(float *dst, const float *src, const float *mul,
+		size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i] * mul[i];
+}
+
+static inline void mul_c(float *dst, const float *mul, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] *= mul[i];
+}
+
+static inline void mul_scalar_c(float *dst, float mul, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] *= mul;
+}
+
+static inline void sum_squares_max_c(const float *src, size_t count,
+		float *sum, float *max)
+{
+	float s = *sum;
+	float m = *max;
+
+	for (size_t i = 0; i < count; i++) {
+		const float pow = src[i] * src[i];
+		s += pow;
+		m  = (m > pow) ? m : pow;
+	}
+
+	*sum = s;
+	*max = m;
+}
+
+static inline void clamp_c(float *dst, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = dst[i];
+		val = (val >  1.0f) ?  1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		dst[i] = val;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* SSE2                                                                      */
+
+/* none of the buffers are guaranteed to be aligned (mixing often starts part
+ * way into a buffer), so unaligned loads/stores are used throughout */
+
+static void add_sse2(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_add_ps(_mm_loadu_ps(dst + i),
+				_mm_loadu_ps(src + i));
+		_mm_storeu_ps(dst + i, val);
+	}
+
+	add_c(dst + i, src + i, count - i);
+}
+
+static void add_mul_sse2(float *dst, const float *src, const float *mul,
+		size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_mul_ps(_mm_loadu_ps(src + i),
+				_mm_loadu_ps(mul + i));
+		val = _mm_add_ps(_mm_loadu_ps(dst + i), val);
+		_mm_storeu_ps(dst + i, val);
+	}
+
+	add_mul_c(dst + i, src + i, mul + i, count - i);
+}
+
+static void mul_sse2(float *dst, const float *mul, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_mul_ps(_mm_loadu_ps(dst + i),
+				_mm_loadu_ps(mul + i));
+		_mm_storeu_ps(dst + i, val);
+	}
+
+	mul_c(dst + i, mul + i, count - i);
+}
+
+static void mul_scalar_sse2(float *dst, float mul, size_t count)
+{
+	__m128 mul_val = _mm_set1_ps(mul);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(dst + i),
+					mul_val));
+
+	mul_scalar_c(dst + i, mul, count - i);
+}
+
+/* min/max return their second operand if either is NaN, so the constants go
+ * first to pass NaN through the same way the C version does */
+static void clamp_sse2(float *dst, size_t count)
+{
+	__m128 max_val = _mm_set1_ps(1.0f);
+	__m128 min_val = _mm_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(dst + i);
+		val = _mm_min_ps(max_val, val);
+		val = _mm_max_ps(min_val, val);
+		_mm_storeu_ps(dst + i, val);
+	}
+
+	clamp_c(dst + i, count - i);
+}
+
+static void sum_squares_max_sse2(const float *src, size_t count,
+		float *sum, float *max)
+{
+	__m128 sum_val = _mm_setzero_ps();
+	__m128 sum_val2 = _mm_setzero_ps();
+	__m128 max_val = _mm_setzero_ps();
+	float sums[4], maxes[4];
+	size_t i = 0;
+
+	/* two sums so consecutive adds don't wait on each other */
+	for (; i + 8 <= count; i += 8) {
+		__m128 val  = _mm_loadu_ps(src + i);
+		__m128 val2 = _mm_loadu_ps(src + i + 4);
+		val  = _mm_mul_ps(val, val);
+		val2 = _mm_mul_ps(val2, val2);
+		sum_val  = _mm_add_ps(sum_val, val);
+		sum_val2 = _mm_add_ps(sum_val2, val2);
+		max_val  = _mm_max_ps(max_val, _mm_max_ps(val, val2));
+	}
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(src + i);
+		val = _mm_mul_ps(val, val);
+		sum_val = _mm_add_ps(sum_val, val);
+		max_val = _mm_max_ps(max_val, val);
+	}
+
+	sum_val = _mm_add_ps(sum_val, sum_val2);
+
+	_mm_storeu_ps(sums, sum_val);
+	_mm_storeu_ps(maxes, max_val);
+
+	for (size_t j = 0; j < 4; j++) {
+		*sum += sums[j];
+		*max  = (*max > maxes[j]) ? *max : maxes[j];
+	}
+
+	sum_squares_max_c(src + i, count - i, sum, max);
+}
+
+/* ------------------------------------------------------------------------- */
+/* AVX                                                                       */
+
+SIMD_TARGET("avx")
+static void add_avx(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_add_ps(_mm256_loadu_ps(dst + i),
+				_mm256_loadu_ps(src + i));
+		_mm256_storeu_ps(dst + i, val);
+	}
+
+	add_c(dst + i, src + i, count - i);
+}
+
+SIMD_TARGET("avx")
+static void add_mul_avx(float *dst, const float *src, const float *mul,
+		size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_mul_ps(_mm256_loadu_ps(src + i),
+				_mm256_loadu_ps(mul + i));
+		val = _mm256_add_ps(_mm256_loadu_ps(dst + i), val);
+		_mm256_storeu_ps(dst + i, val);
+	}
+
+	add_mul_c(dst + i, src + i, mul + i, count - i);
+}
+
+SIMD_TARGET("avx")
+static void mul_avx(float *dst, const float *mul, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_mul_ps(_mm256_loadu_ps(dst + i),
+				_mm256_loadu_ps(mul + i));
+		_mm256_storeu_ps(dst + i, val);
+	}
+
+	mul_c(dst + i, mul + i, count - i);
+}
+
+SIMD_TARGET("avx")
+static void mul_scalar_avx(float *dst, float mul, size_t count)
+{
+	__m256 mul_val = _mm256_set1_ps(mul);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(
+					_mm256_loadu_ps(dst + i), mul_val));
+
+	mul_scalar_c(dst + i, mul, count - i);
+}
+
+SIMD_TARGET("avx")
+static void clamp_avx(float *dst, size_t count)
+{
+	__m256 max_val = _mm256_set1_ps(1.0f);
+	__m256 min_val = _mm256_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_loadu_ps(dst + i);
+		val = _mm256_min_ps(max_val, val);
+		val = _mm256_max_ps(min_val, val);
+		_mm256_storeu_ps(dst + i, val);
+	}
+
+	clamp_c(dst + i, count - i);
+}
+
+SIMD_TARGET("avx")
+static void sum_squares_max_avx(const float *src, size_t count,
+		float *sum, float *max)
+{
+	__m256 sum_val = _mm256_setzero_ps();
+	__m256 sum_val2 = _mm256_setzero_ps();
+	__m256 max_val = _mm256_setzero_ps();
+	float sums[8], maxes[8];
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256 val  = _mm256_loadu_ps(src + i);
+		__m256 val2 = _mm256_loadu_ps(src + i + 8);
+		val  = _mm256_mul_ps(val, val);
+		val2 = _mm256_mul_ps(val2, val2);
+		sum_val  = _mm256_add_ps(sum_val, val);
+		sum_val2 = _mm256_add_ps(sum_val2, val2);
+		max_val  = _mm256_max_ps(max_val, _mm256_max_ps(val, val2));
+	}
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_loadu_ps(src + i);
+		val = _mm256_mul_ps(val, val);
+		sum_val = _mm256_add_ps(sum_val, val);
+		max_val = _mm256_max_ps(max_val, val);
+	}
+
+	sum_val = _mm256_add_ps(sum_val, sum_val2);
+
+	_mm256_storeu_ps(sums, sum_val);
+	_mm256_storeu_ps(maxes, max_val);
+
+	for (size_t j = 0; j < 8; j++) {
+		*sum += sums[j];
+		*max  = (*max > maxes[j]) ? *max : maxes[j];
+	}
+
+	sum_squares_max_c(src + i, count - i, sum, max);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Runtime dispatch                                                          */
+
+struct audio_math_funcs {
+	const char *name;
+	void (*add)(float *dst, const float *src, size_t count);
+	void (*add_mul)(float *dst, const float *src, const float *mul,
+			size_t count);
+	void (*mul)(float *dst, const float *mul, size_t count);
+	void (*mul_scalar)(float *dst, float mul, size_t count);
+	void (*clamp)(float *dst, size_t count);
+	void (*sum_squares_max)(const float *src, size_t count,
+			float *sum, float *max);
+};
+
+static const struct audio_math_funcs funcs_sse2 = {
+	"SSE2",
+	add_sse2,
+	add_mul_sse2,
+	mul_sse2,
+	mul_scalar_sse2,
+	clamp_sse2,
+	sum_squares_max_sse2
+};
+
+static const struct audio_math_funcs funcs_avx = {
+	"AVX",
+	add_avx,
+	add_mul_avx,
+	mul_avx,
+	mul_scalar_avx,
+	clamp_avx,
+	sum_squares_max_avx
+};
+
+static const struct audio_math_funcs *volatile funcs = NULL;
+static pthread_once_t funcs_init_token = PTHREAD_ONCE_INIT;
+
+static inline void set_funcs(const struct audio_math_funcs *new_funcs)
+{
+	os_atomic_set_ptr((void *volatile*)&funcs, (void*)new_funcs);
+}
+
+static void init_funcs(void)
+{
+	uint32_t features = os_get_cpu_features();
+
+	if (features & OS_CPU_AVX)
+		set_funcs(&funcs_avx);
+	else
+		set_funcs(&funcs_sse2);
+}
+
+/* audio is mixed on several threads, so the first call may race */
+static inline const struct audio_math_funcs *get_funcs(void)
+{
+	pthread_once(&funcs_init_token, init_funcs);
+	return os_atomic_load_ptr((void *const volatile*)&funcs);
+}
+
+const char *audio_math_get_isa(void)
+{
+	return get_funcs()->name;
+}
+
+bool audio_math_set_isa(const char *name)
+{
+	static const struct audio_math_funcs *all_funcs[] = {
+		&funcs_sse2, &funcs_avx
+	};
+	static const uint32_t required[] = {
+		0, OS_CPU_AVX
+	};
+
+	uint32_t features = os_get_cpu_features();
+
+	/* detect first so that detection cannot replace the forced choice */
+	pthread_once(&funcs_init_token, init_funcs);
+
+	for (size_t i = 0; i < sizeof(all_funcs)/sizeof(all_funcs[0]); i++) {
+		if (astrcmpi(all_funcs[i]->name, name) != 0)
+			continue;
+		if ((features & required[i]) != required[i])
+			return false;
+
+		set_funcs(all_funcs[i]);
+		return true;
+	}
+
+	return false;
+}
+
+void audio_add(float *dst, const float *src, size_t count)
+{
+	get_funcs()->add(dst, src, count);
+}
+
+void audio_add_mul(float *dst, const float *src, const float *mul,
+		size_t count)
+{
+	get_funcs()->add_mul(dst, src, mul, count);
+}
+
+void audio_mul(float *dst, const float *mul, size_t count)
+{
+	get_funcs()->mul(dst, mul, count);
+}
+
+void audio_mul_scalar(float *dst, float mul, size_t count)
+{
+	get_funcs()->mul_scalar(dst, mul, count);
+}
+
+void audio_clamp(float *dst, size_t count)
+{
+	get_funcs()->clamp(dst, count);
+}
+
+void audio_sum_squares_max(const float *src, size_t count,
+		float *sum, float *max)
+{
+	get_funcs()->sum_squares_max(src, count, sum, max);
+}
@@ -41,3 +41,52 @@ static inline float db_to_mul(const float db)
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Operations on planes of float samples, used for mixing and volume.
+ *
+ * The fastest implementation supported by the CPU (SSE2 or AVX) is chosen
+ * the first time any of these functions are called.  Buffers do not need to
+ * be aligned, and results are identical to the equivalent scalar loops
+ * (except for audio_sum_squares_max, which sums in a different order).
+ */
+
+/** Returns the name of the instruction set currently in use */
+EXPORT const char *audio_math_get_isa(void);
+
+/**
+ * Forces a specific implementation ("SSE2" or "AVX").  Returns false if the
+ * name is unknown or the CPU does not support it.
+ */
+EXPORT bool audio_math_set_isa(const char *name);
+
+/** dst[i] += src[i] */
+EXPORT void audio_add(float *dst, const float *src, size_t count);
+
+/** dst[i] += src[i] * mul[i] */
+EXPORT void audio_add_mul(float *dst, const float *src, const float *mul,
+		size_t count);
+
+/** dst[i] *= mul[i] */
+EXPORT void audio_mul(float *dst, const float *mul, size_t count);
+
+/** dst[i] *= mul */
+EXPORT void audio_mul_scalar(float *dst, float mul, size_t count);
+
+/** clamps dst[i] to -1.0..1.0 */
+EXPORT void audio_clamp(float *dst, size_t count);
+
+/**
+ * Adds the sum of src[i]^2 to *sum, and raises *max to the largest src[i]^2
+ * if it is larger.  Used for RMS and peak levels.
+ */
+EXPORT void audio_sum_squares_max(const float *src, size_t count,
+		float *sum, float *max);
+
+#ifdef __cplusplus
+}
+#endif
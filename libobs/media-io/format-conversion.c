@@ -16,8 +16,13 @@
 ******************************************************************************/
 
 #include "format-conversion.h"
+#include "../util/platform.h"
+#include "../util/dstr.h"
+#include "../util/threading.h"
 #include <xmmintrin.h>
 #include <emmintrin.h>
+#include <tmmintrin.h>
+#include <immintrin.h>
 
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
  * CPU usage to boost by a tremendous amount in debug builds. */
@@ -89,7 +94,268 @@ static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
 	return a < b ? a : b;
 }
 
-void compress_uyvx_to_i420(
+
+/* ------------------------------------------------------------------------- */
+/* SSE2                                                                      */
+
+static FORCE_INLINE void i420_row_sse2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t y, uint32_t x, uint32_t width,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t y_pos        = y      * in_linesize;
+	uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+	uint32_t lum_y_pos    = y      * out_linesize[0];
+
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
+
+	for (; x < width; x += 4) {
+		const uint8_t *img = input + y_pos + x*4;
+		uint32_t lum_pos0  = lum_y_pos + x;
+		uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+		__m128i line1 = _mm_load_si128((const __m128i*)img);
+		__m128i line2 = _mm_load_si128(
+				(const __m128i*)(img + in_linesize));
+
+		pack_shift(lum_plane, lum_pos0, lum_pos1,
+				line1, line2, lum_mask, 1);
+		pack_ch_2plane(u_plane, v_plane,
+				chroma_y_pos + (x>>1),
+				line1, line2, uv_mask);
+	}
+}
+
+static FORCE_INLINE void nv12_row_sse2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t y, uint32_t x, uint32_t width,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane    = output[0];
+	uint8_t  *chroma_plane = output[1];
+	uint32_t y_pos         = y      * in_linesize;
+	uint32_t chroma_y_pos  = (y>>1) * out_linesize[1];
+	uint32_t lum_y_pos     = y      * out_linesize[0];
+
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
+
+	for (; x < width; x += 4) {
+		const uint8_t *img = input + y_pos + x*4;
+		uint32_t lum_pos0  = lum_y_pos + x;
+		uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+		__m128i line1 = _mm_load_si128((const __m128i*)img);
+		__m128i line2 = _mm_load_si128(
+				(const __m128i*)(img + in_linesize));
+
+		pack_shift(lum_plane, lum_pos0, lum_pos1,
+				line1, line2, lum_mask, 1);
+		pack_ch_1plane(chroma_plane, chroma_y_pos + x,
+				line1, line2, uv_mask);
+	}
+}
+
+static FORCE_INLINE void i444_row_sse2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t y, uint32_t x, uint32_t width,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t y_pos        = y      * in_linesize;
+	uint32_t lum_y_pos    = y      * out_linesize[0];
+
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i u_mask   = _mm_set1_epi32(0x000000FF);
+	__m128i v_mask   = _mm_set1_epi32(0x00FF0000);
+
+	for (; x < width; x += 4) {
+		const uint8_t *img = input + y_pos + x*4;
+		uint32_t lum_pos0  = lum_y_pos + x;
+		uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+		__m128i line1 = _mm_load_si128((const __m128i*)img);
+		__m128i line2 = _mm_load_si128(
+				(const __m128i*)(img + in_linesize));
+
+		pack_shift(lum_plane, lum_pos0, lum_pos1,
+				line1, line2, lum_mask, 1);
+		pack_val(u_plane, lum_pos0, lum_pos1,
+				line1, line2, u_mask);
+		pack_shift(v_plane, lum_pos0, lum_pos1,
+				line1, line2, v_mask, 2);
+	}
+}
+
+static void compress_uyvx_to_i420_sse2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+
+	for (uint32_t y = start_y; y < end_y; y += 2)
+		i420_row_sse2(input, in_linesize, y, 0, width,
+				output, out_linesize);
+}
+
+static void compress_uyvx_to_nv12_sse2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+
+	for (uint32_t y = start_y; y < end_y; y += 2)
+		nv12_row_sse2(input, in_linesize, y, 0, width,
+				output, out_linesize);
+}
+
+static void convert_uyvx_to_i444_sse2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+
+	for (uint32_t y = start_y; y < end_y; y += 2)
+		i444_row_sse2(input, in_linesize, y, 0, width,
+				output, out_linesize);
+}
+
+/* expands four U/V pairs and eight luma values to eight packed pixels */
+static FORCE_INLINE void store_yuvx_8px_sse2(uint32_t *output,
+		const uint8_t *lum, __m128i uv_words)
+{
+	__m128i zero   = _mm_setzero_si128();
+	__m128i lum16  = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i*)lum), zero);
+	__m128i uv_lo  = _mm_unpacklo_epi16(uv_words, zero);
+	__m128i uv_hi  = _mm_unpackhi_epi16(uv_words, zero);
+	__m128i out_lo = _mm_or_si128(_mm_unpacklo_epi16(lum16, zero),
+			_mm_slli_epi32(uv_lo, 8));
+	__m128i out_hi = _mm_or_si128(_mm_unpackhi_epi16(lum16, zero),
+			_mm_slli_epi32(uv_hi, 8));
+
+	_mm_storeu_si128((__m128i*)output,       out_lo);
+	_mm_storeu_si128((__m128i*)(output + 4), out_hi);
+}
+
+static void decompress_420_sse2(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t width_d2   = min_uint32(in_linesize[0], out_linesize)/2;
+	uint32_t height_d2  = end_y/2;
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
+		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
+		uint32_t x;
+
+		lum0 = input[0] + y * 2 * in_linesize[0];
+		lum1 = lum0 + in_linesize[0];
+		output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
+
+		for (x = 0; x + 4 <= width_d2; x += 4) {
+			__m128i u = _mm_cvtsi32_si128(
+					*(const int32_t*)(chroma0 + x));
+			__m128i v = _mm_cvtsi32_si128(
+					*(const int32_t*)(chroma1 + x));
+			__m128i uv = _mm_unpacklo_epi8(u, v);
+
+			uv = _mm_unpacklo_epi16(uv, uv);
+
+			store_yuvx_8px_sse2(output0 + x*2, lum0 + x*2, uv);
+			store_yuvx_8px_sse2(output1 + x*2, lum1 + x*2, uv);
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t out = (chroma0[x] << 8) | (chroma1[x] << 16);
+
+			output0[x*2]   = lum0[x*2]   | out;
+			output0[x*2+1] = lum0[x*2+1] | out;
+			output1[x*2]   = lum1[x*2]   | out;
+			output1[x*2+1] = lum1[x*2+1] | out;
+		}
+	}
+}
+
+static void decompress_nv12_sse2(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t width_d2   = min_uint32(in_linesize[0], out_linesize)/2;
+	uint32_t height_d2  = end_y/2;
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint16_t *chroma;
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
+		uint32_t x;
+
+		chroma = (const uint16_t*)(input[1] + y * in_linesize[1]);
+		lum0 = input[0] + y * 2 * in_linesize[0];
+		lum1 = lum0 + in_linesize[0];
+		output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
+
+		for (x = 0; x + 4 <= width_d2; x += 4) {
+			__m128i uv = _mm_loadl_epi64(
+					(const __m128i*)(chroma + x));
+
+			uv = _mm_unpacklo_epi16(uv, uv);
+
+			store_yuvx_8px_sse2(output0 + x*2, lum0 + x*2, uv);
+			store_yuvx_8px_sse2(output1 + x*2, lum1 + x*2, uv);
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t out = chroma[x] << 8;
+
+			output0[x*2]   = lum0[x*2]   | out;
+			output0[x*2+1] = lum0[x*2+1] | out;
+			output1[x*2]   = lum1[x*2]   | out;
+			output1[x*2+1] = lum1[x*2+1] | out;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* SSSE3                                                                     */
+
+#define SHUF_NONE -1, -1, -1, -1
+
+SIMD_TARGET("ssse3")
+static inline __m128i average_chroma_ssse3(__m128i line1, __m128i line2,
+		__m128i uv_mask)
+{
+	__m128i add_val = _mm_add_epi16(
+			_mm_and_si128(line1, uv_mask),
+			_mm_and_si128(line2, uv_mask));
+	__m128i avg_val = _mm_add_epi16(
+			add_val,
+			_mm_shuffle_epi32(add_val, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_srai_epi16(avg_val, 2);
+}
+
+SIMD_TARGET("ssse3")
+static void compress_uyvx_to_i420_ssse3(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -100,7 +366,10 @@ void compress_uyvx_to_i420(
 	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
 	uint32_t y;
 
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i lum_shuf = _mm_setr_epi8(1, 5, 9, 13,
+			SHUF_NONE, SHUF_NONE, SHUF_NONE);
+	__m128i uv_shuf  = _mm_setr_epi8(0, 8, 2, 10,
+			SHUF_NONE, SHUF_NONE, SHUF_NONE);
 	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
 
 	for (y = start_y; y < end_y; y += 2) {
@@ -113,31 +382,48 @@ void compress_uyvx_to_i420(
 			const uint8_t *img = input + y_pos + x*4;
 			uint32_t lum_pos0  = lum_y_pos + x;
 			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+			uint32_t chroma_pos = chroma_y_pos + (x>>1);
+			uint32_t packed_vals;
 
-			__m128i line1 = _mm_load_si128((const __m128i*)img);
-			__m128i line2 = _mm_load_si128(
+			__m128i line1 = _mm_loadu_si128((const __m128i*)img);
+			__m128i line2 = _mm_loadu_si128(
 					(const __m128i*)(img + in_linesize));
+			__m128i avg   = average_chroma_ssse3(line1, line2,
+					uv_mask);
+
+			*(uint32_t*)(lum_plane+lum_pos0) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_shuffle_epi8(line1,
+							lum_shuf));
+			*(uint32_t*)(lum_plane+lum_pos1) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_shuffle_epi8(line2,
+							lum_shuf));
+
+			packed_vals = (uint32_t)_mm_cvtsi128_si32(
+					_mm_shuffle_epi8(avg, uv_shuf));
 
-			pack_shift(lum_plane, lum_pos0, lum_pos1,
-					line1, line2, lum_mask, 1);
-			pack_ch_2plane(u_plane, v_plane,
-					chroma_y_pos + (x>>1),
-					line1, line2, uv_mask);
+			*(uint16_t*)(u_plane+chroma_pos) =
+				(uint16_t)(packed_vals);
+			*(uint16_t*)(v_plane+chroma_pos) =
+				(uint16_t)(packed_vals>>16);
 		}
 	}
 }
 
-void compress_uyvx_to_nv12(
+SIMD_TARGET("ssse3")
+static void compress_uyvx_to_nv12_ssse3(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
 {
-	uint8_t *lum_plane    = output[0];
-	uint8_t *chroma_plane = output[1];
-	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint8_t  *lum_plane    = output[0];
+	uint8_t  *chroma_plane = output[1];
+	uint32_t width         = min_uint32(in_linesize, out_linesize[0]);
 	uint32_t y;
 
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i lum_shuf = _mm_setr_epi8(1, 5, 9, 13,
+			SHUF_NONE, SHUF_NONE, SHUF_NONE);
+	__m128i uv_shuf  = _mm_setr_epi8(0, 2, 8, 10,
+			SHUF_NONE, SHUF_NONE, SHUF_NONE);
 	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
 
 	for (y = start_y; y < end_y; y += 2) {
@@ -151,19 +437,27 @@ void compress_uyvx_to_nv12(
 			uint32_t lum_pos0  = lum_y_pos + x;
 			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
 
-			__m128i line1 = _mm_load_si128((const __m128i*)img);
-			__m128i line2 = _mm_load_si128(
+			__m128i line1 = _mm_loadu_si128((const __m128i*)img);
+			__m128i line2 = _mm_loadu_si128(
 					(const __m128i*)(img + in_linesize));
+			__m128i avg   = average_chroma_ssse3(line1, line2,
+					uv_mask);
 
-			pack_shift(lum_plane, lum_pos0, lum_pos1,
-					line1, line2, lum_mask, 1);
-			pack_ch_1plane(chroma_plane, chroma_y_pos + x,
-					line1, line2, uv_mask);
+			*(uint32_t*)(lum_plane+lum_pos0) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_shuffle_epi8(line1,
+							lum_shuf));
+			*(uint32_t*)(lum_plane+lum_pos1) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_shuffle_epi8(line2,
+							lum_shuf));
+			*(uint32_t*)(chroma_plane+chroma_y_pos+x) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_shuffle_epi8(avg,
+							uv_shuf));
 		}
 	}
 }
 
-void convert_uyvx_to_i444(
+SIMD_TARGET("ssse3")
+static void convert_uyvx_to_i444_ssse3(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -174,9 +468,9 @@ void convert_uyvx_to_i444(
 	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
 	uint32_t y;
 
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
-	__m128i u_mask   = _mm_set1_epi32(0x000000FF);
-	__m128i v_mask   = _mm_set1_epi32(0x00FF0000);
+	/* Y, U and V for four pixels end up in dwords 0, 1 and 2 */
+	__m128i shuf = _mm_setr_epi8(1, 5, 9, 13, 0, 4, 8, 12,
+			2, 6, 10, 14, SHUF_NONE);
 
 	for (y = start_y; y < end_y; y += 2) {
 		uint32_t y_pos        = y      * in_linesize;
@@ -188,21 +482,292 @@ void convert_uyvx_to_i444(
 			uint32_t lum_pos0  = lum_y_pos + x;
 			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
 
-			__m128i line1 = _mm_load_si128((const __m128i*)img);
-			__m128i line2 = _mm_load_si128(
-					(const __m128i*)(img + in_linesize));
+			__m128i line1 = _mm_shuffle_epi8(_mm_loadu_si128(
+						(const __m128i*)img), shuf);
+			__m128i line2 = _mm_shuffle_epi8(_mm_loadu_si128(
+					(const __m128i*)(img + in_linesize)),
+					shuf);
 
-			pack_shift(lum_plane, lum_pos0, lum_pos1,
-					line1, line2, lum_mask, 1);
-			pack_val(u_plane, lum_pos0, lum_pos1,
-					line1, line2, u_mask);
-			pack_shift(v_plane, lum_pos0, lum_pos1,
-					line1, line2, v_mask, 2);
+			*(uint32_t*)(lum_plane+lum_pos0) =
+				(uint32_t)_mm_cvtsi128_si32(line1);
+			*(uint32_t*)(lum_plane+lum_pos1) =
+				(uint32_t)_mm_cvtsi128_si32(line2);
+			*(uint32_t*)(u_plane+lum_pos0) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_srli_si128(line1, 4));
+			*(uint32_t*)(u_plane+lum_pos1) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_srli_si128(line2, 4));
+			*(uint32_t*)(v_plane+lum_pos0) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_srli_si128(line1, 8));
+			*(uint32_t*)(v_plane+lum_pos1) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_srli_si128(line2, 8));
 		}
 	}
 }
 
-void decompress_420(
+SIMD_TARGET("ssse3")
+static void decompress_422_ssse3(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	uint32_t width_d2 = min_uint32(in_linesize/4, out_linesize/8);
+	uint32_t y;
+
+	/* each input dword holds two pixels that share chroma; the second
+	 * output pixel repeats the chroma with the second luma value */
+	__m128i shuf_lo = leading_lum ?
+		_mm_setr_epi8(0, 1, 2, 3, 2, 1, 2, 3,
+		              4, 5, 6, 7, 6, 5, 6, 7) :
+		_mm_setr_epi8(0, 1, 2, 3, 0, 3, 2, 3,
+		              4, 5, 6, 7, 4, 7, 6, 7);
+	__m128i shuf_hi = _mm_add_epi8(shuf_lo, _mm_set1_epi8(8));
+
+	for (y = start_y; y < end_y; y++) {
+		const uint32_t *input32  =
+			(const uint32_t*)(input + y*in_linesize);
+		uint32_t       *output32 =
+			(uint32_t*)(output + y*out_linesize);
+		uint32_t       x;
+
+		for (x = 0; x + 4 <= width_d2; x += 4) {
+			__m128i dw = _mm_loadu_si128(
+					(const __m128i*)(input32 + x));
+
+			_mm_storeu_si128((__m128i*)(output32 + x*2),
+					_mm_shuffle_epi8(dw, shuf_lo));
+			_mm_storeu_si128((__m128i*)(output32 + x*2 + 4),
+					_mm_shuffle_epi8(dw, shuf_hi));
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t dw = input32[x];
+
+			output32[x*2] = dw;
+			if (leading_lum) {
+				dw &= 0xFFFFFF00;
+				dw |= (uint8_t)(dw>>16);
+			} else {
+				dw &= 0xFFFF00FF;
+				dw |= (dw>>16) & 0xFF00;
+			}
+			output32[x*2+1] = dw;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* AVX2                                                                      */
+
+/* gathers dword 0 of each 128bit lane into the low 64 bits */
+#define LANE_PACK_IDX 0, 4, 1, 5, 2, 6, 3, 7
+
+#define SHUF_LANES(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+SIMD_TARGET("avx2")
+static inline __m256i average_chroma_avx2(__m256i line1, __m256i line2,
+		__m256i uv_mask)
+{
+	__m256i add_val = _mm256_add_epi16(
+			_mm256_and_si256(line1, uv_mask),
+			_mm256_and_si256(line2, uv_mask));
+	__m256i avg_val = _mm256_add_epi16(
+			add_val,
+			_mm256_shuffle_epi32(add_val, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm256_srai_epi16(avg_val, 2);
+}
+
+SIMD_TARGET("avx2")
+static inline __m128i shuffle_pack_avx2(__m256i val, __m256i shuf,
+		__m256i pack_idx)
+{
+	val = _mm256_shuffle_epi8(val, shuf);
+	val = _mm256_permutevar8x32_epi32(val, pack_idx);
+	return _mm256_castsi256_si128(val);
+}
+
+SIMD_TARGET("avx2")
+static void compress_uyvx_to_i420_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	__m256i lum_shuf = SHUF_LANES(1, 5, 9, 13,
+			SHUF_NONE, SHUF_NONE, SHUF_NONE);
+	__m256i uv_shuf  = SHUF_LANES(0, 8, 2, 10,
+			SHUF_NONE, SHUF_NONE, SHUF_NONE);
+	__m128i uv_split = _mm_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7,
+			SHUF_NONE, SHUF_NONE);
+	__m256i pack_idx = _mm256_setr_epi32(LANE_PACK_IDX);
+	__m256i uv_mask  = _mm256_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+			uint32_t chroma_pos = chroma_y_pos + (x>>1);
+
+			__m256i line1 = _mm256_loadu_si256(
+					(const __m256i*)img);
+			__m256i line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+			__m256i avg   = average_chroma_avx2(line1, line2,
+					uv_mask);
+			__m128i uv;
+
+			_mm_storel_epi64((__m128i*)(lum_plane+lum_pos0),
+					shuffle_pack_avx2(line1, lum_shuf,
+						pack_idx));
+			_mm_storel_epi64((__m128i*)(lum_plane+lum_pos1),
+					shuffle_pack_avx2(line2, lum_shuf,
+						pack_idx));
+
+			uv = shuffle_pack_avx2(avg, uv_shuf, pack_idx);
+			uv = _mm_shuffle_epi8(uv, uv_split);
+
+			*(uint32_t*)(u_plane+chroma_pos) =
+				(uint32_t)_mm_cvtsi128_si32(uv);
+			*(uint32_t*)(v_plane+chroma_pos) = (uint32_t)
+				_mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+		}
+
+		i420_row_sse2(input, in_linesize, y, x, width,
+				output, out_linesize);
+	}
+}
+
+SIMD_TARGET("avx2")
+static void compress_uyvx_to_nv12_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane    = output[0];
+	uint8_t  *chroma_plane = output[1];
+	uint32_t width         = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	__m256i lum_shuf = SHUF_LANES(1, 5, 9, 13,
+			SHUF_NONE, SHUF_NONE, SHUF_NONE);
+	__m256i uv_shuf  = SHUF_LANES(0, 2, 8, 10,
+			SHUF_NONE, SHUF_NONE, SHUF_NONE);
+	__m256i pack_idx = _mm256_setr_epi32(LANE_PACK_IDX);
+	__m256i uv_mask  = _mm256_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m256i line1 = _mm256_loadu_si256(
+					(const __m256i*)img);
+			__m256i line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+			__m256i avg   = average_chroma_avx2(line1, line2,
+					uv_mask);
+
+			_mm_storel_epi64((__m128i*)(lum_plane+lum_pos0),
+					shuffle_pack_avx2(line1, lum_shuf,
+						pack_idx));
+			_mm_storel_epi64((__m128i*)(lum_plane+lum_pos1),
+					shuffle_pack_avx2(line2, lum_shuf,
+						pack_idx));
+			_mm_storel_epi64(
+					(__m128i*)(chroma_plane+chroma_y_pos+x),
+					shuffle_pack_avx2(avg, uv_shuf,
+						pack_idx));
+		}
+
+		nv12_row_sse2(input, in_linesize, y, x, width,
+				output, out_linesize);
+	}
+}
+
+SIMD_TARGET("avx2")
+static void convert_uyvx_to_i444_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	/* eight Y, U and V values end up in qwords 0, 1 and 2 */
+	__m256i shuf     = SHUF_LANES(1, 5, 9, 13, 0, 4, 8, 12,
+			2, 6, 10, 14, SHUF_NONE);
+	__m256i pack_idx = _mm256_setr_epi32(LANE_PACK_IDX);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos[2];
+
+			lum_pos[0] = lum_y_pos + x;
+			lum_pos[1] = lum_pos[0] + out_linesize[0];
+
+			for (size_t i = 0; i < 2; i++) {
+				__m256i line = _mm256_loadu_si256(
+						(const __m256i*)(img +
+							in_linesize*i));
+				__m128i lo, hi;
+
+				line = _mm256_shuffle_epi8(line, shuf);
+				line = _mm256_permutevar8x32_epi32(line,
+						pack_idx);
+				lo = _mm256_castsi256_si128(line);
+				hi = _mm256_extracti128_si256(line, 1);
+
+				_mm_storel_epi64(
+					(__m128i*)(lum_plane+lum_pos[i]), lo);
+				_mm_storel_epi64(
+					(__m128i*)(u_plane+lum_pos[i]),
+					_mm_srli_si128(lo, 8));
+				_mm_storel_epi64(
+					(__m128i*)(v_plane+lum_pos[i]), hi);
+			}
+		}
+
+		i444_row_sse2(input, in_linesize, y, x, width,
+				output, out_linesize);
+	}
+}
+
+SIMD_TARGET("avx2")
+static inline void store_yuvx_8px_avx2(uint32_t *output, const uint8_t *lum,
+		__m256i uv)
+{
+	__m256i lum32 = _mm256_cvtepu8_epi32(
+			_mm_loadl_epi64((const __m128i*)lum));
+	_mm256_storeu_si256((__m256i*)output, _mm256_or_si256(lum32, uv));
+}
+
+SIMD_TARGET("avx2")
+static void decompress_420_avx2(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize)
@@ -215,29 +780,43 @@ void decompress_420(
 	for (y = start_y_d2; y < height_d2; y++) {
 		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
 		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
 		uint32_t x;
 
 		lum0 = input[0] + y * 2 * in_linesize[0];
 		lum1 = lum0 + in_linesize[0];
-		output0 = (uint32_t*)(output + y * 2 * in_linesize[0]);
-		output1 = (uint32_t*)((uint8_t*)output0 + in_linesize[0]);
+		output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out;
-			out = (*(chroma0++) << 8) | (*(chroma1++) << 16);
+		for (x = 0; x + 4 <= width_d2; x += 4) {
+			__m128i u = _mm_cvtsi32_si128(
+					*(const int32_t*)(chroma0 + x));
+			__m128i v = _mm_cvtsi32_si128(
+					*(const int32_t*)(chroma1 + x));
+			__m128i uv16 = _mm_unpacklo_epi8(u, v);
+			__m256i uv;
+
+			uv16 = _mm_unpacklo_epi16(uv16, uv16);
+			uv   = _mm256_slli_epi32(_mm256_cvtepu16_epi32(uv16), 8);
+
+			store_yuvx_8px_avx2(output0 + x*2, lum0 + x*2, uv);
+			store_yuvx_8px_avx2(output1 + x*2, lum1 + x*2, uv);
+		}
 
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
+		for (; x < width_d2; x++) {
+			uint32_t out = (chroma0[x] << 8) | (chroma1[x] << 16);
 
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
+			output0[x*2]   = lum0[x*2]   | out;
+			output0[x*2+1] = lum0[x*2+1] | out;
+			output1[x*2]   = lum1[x*2]   | out;
+			output1[x*2+1] = lum1[x*2+1] | out;
 		}
 	}
 }
 
-void decompress_nv12(
+SIMD_TARGET("avx2")
+static void decompress_nv12_avx2(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize)
@@ -249,8 +828,8 @@ void decompress_nv12(
 
 	for (y = start_y_d2; y < height_d2; y++) {
 		const uint16_t *chroma;
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
 		uint32_t x;
 
 		chroma = (const uint16_t*)(input[1] + y * in_linesize[1]);
@@ -259,25 +838,99 @@ void decompress_nv12(
 		output0 = (uint32_t*)(output + y * 2 * out_linesize);
 		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out = *(chroma++) << 8;
+		for (x = 0; x + 4 <= width_d2; x += 4) {
+			__m128i uv16 = _mm_loadl_epi64(
+					(const __m128i*)(chroma + x));
+			__m256i uv;
+
+			uv16 = _mm_unpacklo_epi16(uv16, uv16);
+			uv   = _mm256_slli_epi32(_mm256_cvtepu16_epi32(uv16), 8);
+
+			store_yuvx_8px_avx2(output0 + x*2, lum0 + x*2, uv);
+			store_yuvx_8px_avx2(output1 + x*2, lum1 + x*2, uv);
+		}
 
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
+		for (; x < width_d2; x++) {
+			uint32_t out = chroma[x] << 8;
 
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
+			output0[x*2]   = lum0[x*2]   | out;
+			output0[x*2+1] = lum0[x*2+1] | out;
+			output1[x*2]   = lum1[x*2]   | out;
+			output1[x*2+1] = lum1[x*2+1] | out;
 		}
 	}
 }
 
-void decompress_422(
+SIMD_TARGET("avx2")
+static void decompress_422_avx2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize,
 		bool leading_lum)
 {
-	uint32_t width_d2 = min_uint32(in_linesize, out_linesize)/2;
+	uint32_t width_d2 = min_uint32(in_linesize/4, out_linesize/8);
+	uint32_t y;
+
+	/* the low lane expands input dwords 0-1, the high lane 2-3 */
+	__m256i shuf = leading_lum ?
+		_mm256_setr_epi8(0, 1, 2, 3, 2, 1, 2, 3,
+		                 4, 5, 6, 7, 6, 5, 6, 7,
+		                 8, 9, 10, 11, 10, 9, 10, 11,
+		                 12, 13, 14, 15, 14, 13, 14, 15) :
+		_mm256_setr_epi8(0, 1, 2, 3, 0, 3, 2, 3,
+		                 4, 5, 6, 7, 4, 7, 6, 7,
+		                 8, 9, 10, 11, 8, 11, 10, 11,
+		                 12, 13, 14, 15, 12, 15, 14, 15);
+
+	for (y = start_y; y < end_y; y++) {
+		const uint32_t *input32  =
+			(const uint32_t*)(input + y*in_linesize);
+		uint32_t       *output32 =
+			(uint32_t*)(output + y*out_linesize);
+		uint32_t       x;
+
+		for (x = 0; x + 8 <= width_d2; x += 8) {
+			__m128i lo = _mm_loadu_si128(
+					(const __m128i*)(input32 + x));
+			__m128i hi = _mm_loadu_si128(
+					(const __m128i*)(input32 + x + 4));
+
+			_mm256_storeu_si256((__m256i*)(output32 + x*2),
+					_mm256_shuffle_epi8(
+						_mm256_broadcastsi128_si256(lo),
+						shuf));
+			_mm256_storeu_si256((__m256i*)(output32 + x*2 + 8),
+					_mm256_shuffle_epi8(
+						_mm256_broadcastsi128_si256(hi),
+						shuf));
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t dw = input32[x];
+
+			output32[x*2] = dw;
+			if (leading_lum) {
+				dw &= 0xFFFFFF00;
+				dw |= (uint8_t)(dw>>16);
+			} else {
+				dw &= 0xFFFF00FF;
+				dw |= (dw>>16) & 0xFF00;
+			}
+			output32[x*2+1] = dw;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* Plain C                                                                   */
+
+static void decompress_422_c(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	uint32_t width_d2 = min_uint32(in_linesize/4, out_linesize/8);
 	uint32_t y;
 
 	register const uint32_t *input32;
@@ -322,3 +975,177 @@ void decompress_422(
 		}
 	}
 }
+
+/* ------------------------------------------------------------------------- */
+/* Runtime dispatch                                                          */
+
+typedef void (*compress_func_t)(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+
+typedef void (*decompress_planar_func_t)(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize);
+
+typedef void (*decompress_packed_func_t)(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum);
+
+struct conversion_funcs {
+	const char               *name;
+	compress_func_t          uyvx_to_i420;
+	compress_func_t          uyvx_to_nv12;
+	compress_func_t          uyvx_to_i444;
+	decompress_planar_func_t decompress_420;
+	decompress_planar_func_t decompress_nv12;
+	decompress_packed_func_t decompress_422;
+};
+
+static const struct conversion_funcs funcs_sse2 = {
+	"SSE2",
+	compress_uyvx_to_i420_sse2,
+	compress_uyvx_to_nv12_sse2,
+	convert_uyvx_to_i444_sse2,
+	decompress_420_sse2,
+	decompress_nv12_sse2,
+	decompress_422_c
+};
+
+static const struct conversion_funcs funcs_ssse3 = {
+	"SSSE3",
+	compress_uyvx_to_i420_ssse3,
+	compress_uyvx_to_nv12_ssse3,
+	convert_uyvx_to_i444_ssse3,
+	decompress_420_sse2,
+	decompress_nv12_sse2,
+	decompress_422_ssse3
+};
+
+static const struct conversion_funcs funcs_avx2 = {
+	"AVX2",
+	compress_uyvx_to_i420_avx2,
+	compress_uyvx_to_nv12_avx2,
+	convert_uyvx_to_i444_avx2,
+	decompress_420_avx2,
+	decompress_nv12_avx2,
+	decompress_422_avx2
+};
+
+static const struct conversion_funcs *volatile funcs = NULL;
+static pthread_once_t funcs_init_token = PTHREAD_ONCE_INIT;
+
+static inline void set_funcs(const struct conversion_funcs *new_funcs)
+{
+	os_atomic_set_ptr((void *volatile*)&funcs, (void*)new_funcs);
+}
+
+static void init_funcs(void)
+{
+	uint32_t features = os_get_cpu_features();
+
+	if (features & OS_CPU_AVX2)
+		set_funcs(&funcs_avx2);
+	else if (features & OS_CPU_SSSE3)
+		set_funcs(&funcs_ssse3);
+	else
+		set_funcs(&funcs_sse2);
+}
+
+/* frames are converted on the video and gpu threads, so the first call may
+ * race */
+static inline const struct conversion_funcs *get_funcs(void)
+{
+	pthread_once(&funcs_init_token, init_funcs);
+	return os_atomic_load_ptr((void *const volatile*)&funcs);
+}
+
+const char *format_conversion_get_isa(void)
+{
+	return get_funcs()->name;
+}
+
+bool format_conversion_set_isa(const char *name)
+{
+	static const struct conversion_funcs *all_funcs[] = {
+		&funcs_sse2, &funcs_ssse3, &funcs_avx2
+	};
+	static const uint32_t required[] = {
+		0, OS_CPU_SSSE3, OS_CPU_AVX2
+	};
+
+	uint32_t features = os_get_cpu_features();
+
+	/* detect first so that detection cannot replace the forced choice */
+	pthread_once(&funcs_init_token, init_funcs);
+
+	for (size_t i = 0; i < sizeof(all_funcs)/sizeof(all_funcs[0]); i++) {
+		if (astrcmpi(all_funcs[i]->name, name) != 0)
+			continue;
+		if ((features & required[i]) != required[i])
+			return false;
+
+		set_funcs(all_funcs[i]);
+		return true;
+	}
+
+	return false;
+}
+
+void compress_uyvx_to_i420(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	get_funcs()->uyvx_to_i420(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void compress_uyvx_to_nv12(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	get_funcs()->uyvx_to_nv12(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void convert_uyvx_to_i444(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	get_funcs()->uyvx_to_i444(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void decompress_420(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	get_funcs()->decompress_420(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void decompress_nv12(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	get_funcs()->decompress_nv12(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void decompress_422(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	get_funcs()->decompress_422(input, in_linesize, start_y, end_y,
+			output, out_linesize, leading_lum);
+}
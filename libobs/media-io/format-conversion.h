@@ -25,8 +25,20 @@ extern "C" {
 
 /*
  * Functions for converting to and from packed 444 YUV
+ *
+ * The fastest implementation supported by the CPU (SSE2, SSSE3 or AVX2) is
+ * chosen the first time any of these functions are called.
  */
 
+/** Returns the name of the instruction set currently in use */
+EXPORT const char *format_conversion_get_isa(void);
+
+/**
+ * Forces a specific implementation ("SSE2", "SSSE3" or "AVX2").  Returns
+ * false if the name is unknown or the CPU does not support it.
+ */
+EXPORT bool format_conversion_set_isa(const char *name);
+
 EXPORT void compress_uyvx_to_i420(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
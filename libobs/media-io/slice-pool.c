@@ -0,0 +1,197 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "../util/bmem.h"
+#include "../util/dstr.h"
+#include "../util/platform.h"
+#include "../util/threading.h"
+
+#include "slice-pool.h"
+
+struct slice_pool;
+
+struct slice_worker {
+	struct slice_pool *pool;
+	pthread_t         thread;
+	os_sem_t          *start_sem;
+	bool              thread_created;
+
+	uint32_t          start;
+	uint32_t          end;
+};
+
+struct slice_pool {
+	size_t              num_threads;
+	struct slice_worker *workers;
+	os_sem_t            *finished_sem;
+	struct dstr         name;
+
+	slice_pool_job_t    job;
+	void                *param;
+	volatile bool       stop;
+};
+
+static void *slice_worker_thread(void *data)
+{
+	struct slice_worker *worker = data;
+	struct slice_pool   *pool   = worker->pool;
+
+	os_set_thread_name(pool->name.array);
+
+	while (os_sem_wait(worker->start_sem) == 0) {
+		if (os_atomic_load_bool(&pool->stop))
+			break;
+
+		pool->job(pool->param, worker->start, worker->end);
+		os_sem_post(pool->finished_sem);
+	}
+
+	return NULL;
+}
+
+static inline size_t default_thread_count(void)
+{
+	/* conversion is mostly memory bound, so using every core does not
+	 * help much and only takes time away from the encoders */
+	int cores = os_get_logical_cores();
+	size_t threads = cores > 1 ? (size_t)cores / 2 : 1;
+
+	return threads < 4 ? threads : 4;
+}
+
+slice_pool_t *slice_pool_create(size_t num_threads, const char *name)
+{
+	struct slice_pool *pool = bzalloc(sizeof(struct slice_pool));
+
+	if (!num_threads)
+		num_threads = default_thread_count();
+	if (num_threads > SLICE_POOL_MAX_THREADS)
+		num_threads = SLICE_POOL_MAX_THREADS;
+
+	pool->num_threads = num_threads;
+	dstr_printf(&pool->name, "slice-pool: %s", name ? name : "worker");
+
+	if (num_threads == 1)
+		return pool;
+
+	if (os_sem_init(&pool->finished_sem, 0) != 0)
+		goto fail;
+
+	pool->workers = bzalloc(sizeof(struct slice_worker) *
+			(num_threads - 1));
+
+	for (size_t i = 0; i < num_threads - 1; i++) {
+		struct slice_worker *worker = &pool->workers[i];
+		worker->pool = pool;
+
+		if (os_sem_init(&worker->start_sem, 0) != 0)
+			goto fail;
+		if (pthread_create(&worker->thread, NULL, slice_worker_thread,
+					worker) != 0)
+			goto fail;
+
+		worker->thread_created = true;
+	}
+
+	return pool;
+
+fail:
+	blog(LOG_ERROR, "slice_pool_create: Failed to create '%s' threads",
+			pool->name.array);
+	slice_pool_destroy(pool);
+	return NULL;
+}
+
+void slice_pool_destroy(slice_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	os_atomic_set_bool(&pool->stop, true);
+
+	if (pool->workers) {
+		for (size_t i = 0; i < pool->num_threads - 1; i++) {
+			struct slice_worker *worker = &pool->workers[i];
+
+			if (worker->thread_created) {
+				os_sem_post(worker->start_sem);
+				pthread_join(worker->thread, NULL);
+			}
+
+			os_sem_destroy(worker->start_sem);
+		}
+
+		bfree(pool->workers);
+	}
+
+	os_sem_destroy(pool->finished_sem);
+	dstr_free(&pool->name);
+	bfree(pool);
+}
+
+size_t slice_pool_get_threads(const slice_pool_t *pool)
+{
+	return pool ? pool->num_threads : 1;
+}
+
+void slice_pool_run(slice_pool_t *pool, slice_pool_job_t job,
+		void *param, uint32_t count, uint32_t granularity)
+{
+	uint32_t num_slices;
+	uint32_t slice_size;
+	uint32_t first_end;
+	size_t   posted = 0;
+
+	if (!granularity)
+		granularity = 1;
+
+	num_slices = (count + granularity - 1) / granularity;
+	if (pool && num_slices > pool->num_threads)
+		num_slices = (uint32_t)pool->num_threads;
+
+	if (!pool || num_slices <= 1) {
+		job(param, 0, count);
+		return;
+	}
+
+	slice_size = (count + num_slices - 1) / num_slices;
+	slice_size = (slice_size + granularity - 1) / granularity * granularity;
+
+	pool->job   = job;
+	pool->param = param;
+
+	first_end = slice_size < count ? slice_size : count;
+
+	for (uint32_t i = 1; i < num_slices; i++) {
+		struct slice_worker *worker = &pool->workers[i - 1];
+		uint32_t start = slice_size * i;
+		uint32_t end   = start + slice_size;
+
+		if (start >= count)
+			break;
+
+		worker->start = start;
+		worker->end   = end < count ? end : count;
+		os_sem_post(worker->start_sem);
+		posted++;
+	}
+
+	job(param, 0, first_end);
+
+	while (posted--)
+		os_sem_wait(pool->finished_sem);
+}
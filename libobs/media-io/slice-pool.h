@@ -0,0 +1,64 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Small worker pool for splitting a job into contiguous ranges (typically
+ * rows of a frame) and running the ranges in parallel.  The calling thread
+ * always processes the first range itself, so a pool of N threads only
+ * creates N-1 worker threads.
+ *
+ * A pool runs one job at a time; slice_pool_run must not be called from
+ * more than one thread at once on the same pool.
+ */
+
+struct slice_pool;
+typedef struct slice_pool slice_pool_t;
+
+typedef void (*slice_pool_job_t)(void *param, uint32_t start, uint32_t end);
+
+#define SLICE_POOL_MAX_THREADS 8
+
+/**
+ * Creates a slice pool.  If num_threads is 0, a thread count suitable for
+ * the current machine is chosen.  Returns NULL on failure.
+ */
+EXPORT slice_pool_t *slice_pool_create(size_t num_threads, const char *name);
+EXPORT void slice_pool_destroy(slice_pool_t *pool);
+
+EXPORT size_t slice_pool_get_threads(const slice_pool_t *pool);
+
+/**
+ * Runs job over [0, count), split into at most one range per thread.  Range
+ * boundaries are always multiples of granularity (except for the final end
+ * value), and no range is smaller than granularity.  Blocks until every
+ * range has completed.  If pool is NULL, the job is run on the calling
+ * thread.
+ */
+EXPORT void slice_pool_run(slice_pool_t *pool, slice_pool_job_t job,
+		void *param, uint32_t count, uint32_t granularity);
+
+#ifdef __cplusplus
+}
+#endif
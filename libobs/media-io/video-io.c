@@ -26,6 +26,7 @@
 #include "video-io.h"
 #include "video-frame.h"
 #include "video-scaler.h"
+#include "slice-pool.h"
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
@@ -43,6 +44,9 @@ struct video_input {
 	struct video_frame        frame[MAX_CONVERT_BUFFERS];
 	int                       cur_frame;
 
+	struct video_data         scaled_frame;
+	bool                      scaled;
+
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
@@ -70,6 +74,9 @@ struct video_output {
 
 	pthread_mutex_t            input_mutex;
 	DARRAY(struct video_input) inputs;
+	size_t                     num_scalers;
+
+	slice_pool_t               *scale_pool;
 
 	size_t                     available_frames;
 	size_t                     first_added;
@@ -110,6 +117,29 @@ static inline bool scale_video_output(struct video_input *input,
 	return success;
 }
 
+static void scale_inputs_slice(void *param, uint32_t start, uint32_t end)
+{
+	struct video_output *video = param;
+
+	for (uint32_t i = start; i < end; i++) {
+		struct video_input *input = video->inputs.array+i;
+		input->scaled = scale_video_output(input, &input->scaled_frame);
+	}
+}
+
+static inline void scale_inputs(struct video_output *video,
+		const struct video_data *frame)
+{
+	for (size_t i = 0; i < video->inputs.num; i++)
+		video->inputs.array[i].scaled_frame = *frame;
+
+	/* only bother waking up the pool when there's more than one input
+	 * that actually needs to be scaled */
+	slice_pool_run(video->num_scalers > 1 ? video->scale_pool : NULL,
+			scale_inputs_slice, video,
+			(uint32_t)video->inputs.num, 1);
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
@@ -127,12 +157,13 @@ static inline bool video_output_cur_frame(struct video_output *video)
 
 	pthread_mutex_lock(&video->input_mutex);
 
+	scale_inputs(video, &frame_info->frame);
+
 	for (size_t i = 0; i < video->inputs.num; i++) {
 		struct video_input *input = video->inputs.array+i;
-		struct video_data frame = frame_info->frame;
 
-		if (scale_video_output(input, &frame))
-			input->callback(input->param, &frame);
+		if (input->scaled)
+			input->callback(input->param, &input->scaled_frame);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -238,6 +269,7 @@ int video_output_open(video_t **video, struct video_output_info *info)
 		goto fail;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
 		goto fail;
+	out->scale_pool = slice_pool_create(0, "video-io scaler");
 	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
 		goto fail;
 
@@ -263,6 +295,8 @@ void video_output_close(video_t *video)
 		video_input_free(&video->inputs.array[i]);
 	da_free(video->inputs);
 
+	slice_pool_destroy(video->scale_pool);
+
 	for (size_t i = 0; i < video->info.cache_size; i++)
 		video_frame_free((struct video_frame*)&video->cache[i]);
 
@@ -354,8 +388,11 @@ bool video_output_connect(video_t *video,
 			input.conversion.height = video->info.height;
 
 		success = video_input_init(&input, video);
-		if (success)
+		if (success) {
+			if (input.scaler)
+				video->num_scalers++;
 			da_push_back(video->inputs, &input);
+		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -374,6 +411,8 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
+		if (video->inputs.array[idx].scaler)
+			video->num_scalers--;
 		video_input_free(video->inputs.array+idx);
 		da_erase(video->inputs, idx);
 	}
@@ -59,6 +59,13 @@ struct meter_cb {
 	void                   *param;
 };
 
+struct meter_levels {
+	float                  level;
+	float                  magnitude;
+	float                  peak;
+	bool                   muted;
+};
+
 struct obs_volmeter {
 	pthread_mutex_t        mutex;
 	obs_fader_conversion_t pos_to_db;
@@ -69,6 +76,13 @@ struct obs_volmeter {
 
 	pthread_mutex_t        callback_mutex;
 	DARRAY(struct meter_cb)callbacks;
+	volatile long          num_callbacks;
+
+	/* latest levels for obs_volmeter_get_levels.  written only by the
+	 * audio capture callback; the sequence is odd while a write is in
+	 * progress, and 0 until the first levels are available */
+	volatile long          levels_seq;
+	struct meter_levels    levels;
 
 	unsigned int           channels;
 	unsigned int           update_ms;
@@ -208,6 +222,10 @@ static void signal_levels_updated(struct obs_volmeter *volmeter,
 		const float level, const float magnitude, const float peak,
 		bool muted)
 {
+	/* meters that are polled have no callbacks */
+	if (!os_atomic_load_long(&volmeter->num_callbacks))
+		return;
+
 	pthread_mutex_lock(&volmeter->callback_mutex);
 	for (size_t i = volmeter->callbacks.num; i > 0; i--) {
 		struct meter_cb cb = volmeter->callbacks.array[i - 1];
@@ -269,22 +287,20 @@ static void volmeter_source_destroyed(void *vptr, calldata_t *calldata)
 static void volmeter_sum_and_max(float *data[MAX_AV_PLANES], size_t frames,
 		float *sum, float *max)
 {
-	float s  = *sum;
-	float m  = *max;
-
 	for (size_t plane = 0; plane < MAX_AV_PLANES; plane++) {
 		if (!data[plane])
 			break;
 
-		for (float *c = data[plane]; c < data[plane] + frames; ++c) {
-			const float pow = *c * *c;
-			s += pow;
-			m  = (m > pow) ? m : pow;
-		}
+		audio_sum_squares_max(data[plane], frames, sum, max);
 	}
+}
 
-	*sum = s;
-	*max = m;
+static void store_levels(struct obs_volmeter *volmeter,
+		const struct meter_levels *levels)
+{
+	os_atomic_inc_long(&volmeter->levels_seq);
+	volmeter->levels = *levels;
+	os_atomic_inc_long(&volmeter->levels_seq);
 }
 
 /**
@@ -367,26 +383,33 @@ static void volmeter_source_data_received(void *vptr, obs_source_t *source,
 		const struct audio_data *data, bool muted)
 {
 	struct obs_volmeter *volmeter = (struct obs_volmeter *) vptr;
+	struct meter_levels levels;
 	bool updated = false;
-	float mul, level, mag, peak;
+	float mul;
 
 	pthread_mutex_lock(&volmeter->mutex);
 
 	updated = volmeter_process_audio_data(volmeter, data);
 
 	if (updated) {
-		mul   = db_to_mul(volmeter->cur_db);
+		mul = db_to_mul(volmeter->cur_db);
 
-		level = volmeter->db_to_pos(mul_to_db(volmeter->vol_max * mul));
-		mag   = volmeter->db_to_pos(mul_to_db(volmeter->vol_mag * mul));
-		peak  = volmeter->db_to_pos(
+		levels.level     = volmeter->db_to_pos(
+				mul_to_db(volmeter->vol_max * mul));
+		levels.magnitude = volmeter->db_to_pos(
+				mul_to_db(volmeter->vol_mag * mul));
+		levels.peak      = volmeter->db_to_pos(
 				mul_to_db(volmeter->vol_peak * mul));
+		levels.muted     = muted;
+
+		store_levels(volmeter, &levels);
 	}
 
 	pthread_mutex_unlock(&volmeter->mutex);
 
 	if (updated)
-		signal_levels_updated(volmeter, level, mag, peak, muted);
+		signal_levels_updated(volmeter, levels.level,
+				levels.magnitude, levels.peak, muted);
 
 	UNUSED_PARAMETER(source);
 }
@@ -789,6 +812,8 @@ void obs_volmeter_add_callback(obs_volmeter_t *volmeter,
 
 	pthread_mutex_lock(&volmeter->callback_mutex);
 	da_push_back(volmeter->callbacks, &cb);
+	os_atomic_set_long(&volmeter->num_callbacks,
+			(long)volmeter->callbacks.num);
 	pthread_mutex_unlock(&volmeter->callback_mutex);
 }
 
@@ -802,5 +827,42 @@ void obs_volmeter_remove_callback(obs_volmeter_t *volmeter,
 
 	pthread_mutex_lock(&volmeter->callback_mutex);
 	da_erase_item(volmeter->callbacks, &cb);
+	os_atomic_set_long(&volmeter->num_callbacks,
+			(long)volmeter->callbacks.num);
 	pthread_mutex_unlock(&volmeter->callback_mutex);
 }
+
+bool obs_volmeter_get_levels(obs_volmeter_t *volmeter, float *level,
+		float *magnitude, float *peak, bool *muted)
+{
+	struct meter_levels levels;
+	long seq;
+
+	if (!obs_ptr_valid(volmeter, "obs_volmeter_get_levels"))
+		return false;
+
+	/* the writer only holds the sequence odd for the duration of a
+	 * small struct copy, so just retry until a consistent copy is made */
+	for (;;) {
+		seq = os_atomic_load_long(&volmeter->levels_seq);
+		if (seq & 1)
+			continue;
+
+		levels = volmeter->levels;
+
+		/* keep the copy from being read after the re-check */
+		os_atomic_fence_acquire();
+
+		if (os_atomic_load_long(&volmeter->levels_seq) == seq)
+			break;
+	}
+
+	if (!seq)
+		return false;
+
+	if (level)     *level     = levels.level;
+	if (magnitude) *magnitude = levels.magnitude;
+	if (peak)      *peak      = levels.peak;
+	if (muted)     *muted     = levels.muted;
+	return true;
+}
@@ -259,6 +259,24 @@ EXPORT void obs_volmeter_add_callback(obs_volmeter_t *volmeter,
 EXPORT void obs_volmeter_remove_callback(obs_volmeter_t *volmeter,
 		obs_volmeter_updated_t callback, void *param);
 
+/**
+ * @brief Get the most recent levels of the volume meter
+ * @param volmeter pointer to the volume meter object
+ * @param level receives the level, may be NULL
+ * @param magnitude receives the magnitude, may be NULL
+ * @param peak receives the peak, may be NULL
+ * @param muted receives whether the source was muted, may be NULL
+ * @return false if no levels have been computed yet
+ *
+ * These are the same values that are passed to obs_volmeter_updated_t
+ * callbacks.  This never blocks the audio thread, so a UI can call it at its
+ * own display rate instead of adding a callback that is invoked for every
+ * update interval.  When a volume meter has no callbacks, the audio thread
+ * skips the callback path entirely.
+ */
+EXPORT bool obs_volmeter_get_levels(obs_volmeter_t *volmeter, float *level,
+		float *magnitude, float *peak, bool *muted);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,7 @@
 
 #include <inttypes.h>
 #include "obs-internal.h"
+#include "media-io/audio-math.h"
 
 struct ts_info {
 	uint64_t start;
@@ -26,6 +27,9 @@ struct ts_info {
 #define DEBUG_AUDIO 0
 #define MAX_BUFFERING_TICKS 45
 
+/* below this many sources, waking the render pool costs more than it saves */
+#define MIN_PARALLEL_AUDIO_SOURCES 8
+
 static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 {
 	struct obs_core_audio *audio = p;
@@ -44,8 +48,8 @@ static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 }
 
 static inline void mix_audio(struct audio_output_data *mixes,
-		obs_source_t *source, size_t channels, size_t sample_rate,
-		struct ts_info *ts)
+		obs_source_t *source, uint32_t mixers, size_t channels,
+		size_t sample_rate, struct ts_info *ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
@@ -63,18 +67,13 @@ static inline void mix_audio(struct audio_output_data *mixes,
 	}
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
-				source->audio_output_buf[mix_idx][ch];
-			register float *end;
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
 
-			mix += start_point;
-			end = aud + total_floats;
-
-			while (aud < end)
-				*(mix++) += *(aud++);
-		}
+		for (size_t ch = 0; ch < channels; ch++)
+			audio_add(mixes[mix_idx].data[ch] + start_point,
+					source->audio_output_buf[mix_idx][ch],
+					total_floats);
 	}
 }
 
@@ -353,6 +352,149 @@ static inline void release_audio_sources(struct obs_core_audio *audio)
 		obs_source_release(audio->render_order.array[i]);
 }
 
+static void clear_audio_tree_cache(struct obs_core_audio *audio)
+{
+	for (size_t i = 0; i < audio->cached_render_order.num; i++)
+		obs_weak_source_release(audio->cached_render_order.array[i]);
+	da_resize(audio->cached_render_order, 0);
+	audio->tree_cached = false;
+}
+
+static void cache_audio_tree(struct obs_core_audio *audio,
+		obs_source_t **roots, long version)
+{
+	clear_audio_tree_cache(audio);
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+		obs_weak_source_t *weak = obs_source_get_weak_source(source);
+		da_push_back(audio->cached_render_order, &weak);
+	}
+
+	memcpy(audio->cached_roots, roots, sizeof(audio->cached_roots));
+	audio->cached_tree_version = version;
+	audio->tree_cached = true;
+}
+
+/* fills render_order from the cache.  fails if the tree has changed since it
+ * was cached, or if any cached source has since been destroyed */
+static bool get_cached_audio_tree(struct obs_core_audio *audio,
+		obs_source_t **roots, long version)
+{
+	if (!audio->tree_cached || audio->cached_tree_version != version)
+		return false;
+	if (memcmp(audio->cached_roots, roots, sizeof(audio->cached_roots)))
+		return false;
+
+	for (size_t i = 0; i < audio->cached_render_order.num; i++) {
+		obs_weak_source_t *weak = audio->cached_render_order.array[i];
+		obs_source_t *source = obs_weak_source_get_source(weak);
+
+		if (!source) {
+			release_audio_sources(audio);
+			da_resize(audio->render_order, 0);
+			return false;
+		}
+
+		da_push_back(audio->render_order, &source);
+	}
+
+	return true;
+}
+
+static void build_audio_tree(struct obs_core_audio *audio,
+		obs_source_t **roots)
+{
+	struct obs_core_data *data = &obs->data;
+	struct obs_source *source;
+
+	/* NOTE: these are source channels, not audio channels */
+	for (uint32_t i = 0; i < MAX_CHANNELS; i++) {
+		if (roots[i]) {
+			obs_source_enum_active_tree(roots[i], push_audio_tree,
+					audio);
+			push_audio_tree(NULL, roots[i], audio);
+		}
+	}
+
+	pthread_mutex_lock(&data->audio_sources_mutex);
+
+	source = data->first_audio_source;
+	while (source) {
+		push_audio_tree(NULL, source, audio);
+		source = (struct obs_source*)source->next_audio_source;
+	}
+
+	pthread_mutex_unlock(&data->audio_sources_mutex);
+}
+
+struct audio_render_job {
+	obs_source_t **sources;
+	uint32_t     mixers;
+	size_t       channels;
+	size_t       sample_rate;
+	size_t       size;
+};
+
+static void render_audio_slice(void *param, uint32_t start, uint32_t end)
+{
+	struct audio_render_job *job = param;
+
+	for (uint32_t i = start; i < end; i++)
+		obs_source_audio_render(job->sources[i], job->mixers,
+				job->channels, job->sample_rate, job->size);
+}
+
+static inline bool is_audio_leaf(const obs_source_t *source)
+{
+	return !source->info.audio_render;
+}
+
+static void render_audio_sources(struct obs_core_audio *audio,
+		uint32_t mixers, size_t channels, size_t sample_rate,
+		size_t size)
+{
+	struct audio_render_job job = {
+		.mixers      = mixers,
+		.channels    = channels,
+		.sample_rate = sample_rate,
+		.size        = size
+	};
+
+	/* sources with a custom audio_render (scenes, transitions) mix in
+	 * the output of their children, which always come before them in the
+	 * render order.  every other source only reads its own input buffer
+	 * (its filters already ran when the audio was output), so all of
+	 * those can be rendered at once, followed by the composite sources
+	 * in their original order */
+	da_resize(audio->render_leaves, 0);
+
+	if (slice_pool_get_threads(audio->render_pool) > 1) {
+		for (size_t i = 0; i < audio->render_order.num; i++) {
+			obs_source_t *source = audio->render_order.array[i];
+			if (is_audio_leaf(source))
+				da_push_back(audio->render_leaves, &source);
+		}
+	}
+
+	if (audio->render_leaves.num < MIN_PARALLEL_AUDIO_SOURCES) {
+		job.sources = audio->render_order.array;
+		render_audio_slice(&job, 0, (uint32_t)audio->render_order.num);
+		return;
+	}
+
+	job.sources = audio->render_leaves.array;
+	slice_pool_run(audio->render_pool, render_audio_slice, &job,
+			(uint32_t)audio->render_leaves.num, 1);
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+		if (!is_audio_leaf(source))
+			obs_source_audio_render(source, mixers, channels,
+					sample_rate, size);
+	}
+}
+
 bool audio_callback(void *param,
 		uint64_t start_ts_in, uint64_t end_ts_in, uint64_t *out_ts,
 		uint32_t mixers, struct audio_output_data *mixes)
@@ -363,8 +505,10 @@ bool audio_callback(void *param,
 	size_t sample_rate = audio_output_get_sample_rate(audio->audio);
 	size_t channels = audio_output_get_channels(audio->audio);
 	struct ts_info ts = {start_ts_in, end_ts_in};
+	obs_source_t *roots[MAX_CHANNELS];
 	size_t audio_size;
 	uint64_t min_ts;
+	long version;
 
 	da_resize(audio->render_order, 0);
 	da_resize(audio->root_nodes, 0);
@@ -380,36 +524,30 @@ bool audio_callback(void *param,
 #endif
 
 	/* ------------------------------------------------ */
-	/* build audio render order
-	 * NOTE: these are source channels, not audio channels */
+	/* build audio render order.  walking the whole source tree is
+	 * expensive with large collections, so the previous order is reused
+	 * until something marks the tree as changed.  the version has to be
+	 * read before the walk so that changes made during it are not lost */
+	version = os_atomic_load_long(&audio->tree_version);
+
 	for (uint32_t i = 0; i < MAX_CHANNELS; i++) {
-		obs_source_t *source = obs_get_output_source(i);
-		if (source) {
-			obs_source_enum_active_tree(source, push_audio_tree,
-					audio);
-			push_audio_tree(NULL, source, audio);
-			da_push_back(audio->root_nodes, &source);
-			obs_source_release(source);
-		}
+		roots[i] = obs_get_output_source(i);
+		if (roots[i])
+			da_push_back(audio->root_nodes, &roots[i]);
 	}
 
-	pthread_mutex_lock(&data->audio_sources_mutex);
-
-	source = data->first_audio_source;
-	while (source) {
-		push_audio_tree(NULL, source, audio);
-		source = (struct obs_source*)source->next_audio_source;
+	if (!get_cached_audio_tree(audio, roots, version)) {
+		build_audio_tree(audio, roots);
+		cache_audio_tree(audio, roots, version);
 	}
 
-	pthread_mutex_unlock(&data->audio_sources_mutex);
+	/* the render order holds references to every root */
+	for (uint32_t i = 0; i < MAX_CHANNELS; i++)
+		obs_source_release(roots[i]);
 
 	/* ------------------------------------------------ */
 	/* render audio data */
-	for (size_t i = 0; i < audio->render_order.num; i++) {
-		obs_source_t *source = audio->render_order.array[i];
-		obs_source_audio_render(source, mixers, channels, sample_rate,
-				audio_size);
-	}
+	render_audio_sources(audio, mixers, channels, sample_rate, audio_size);
 
 	/* ------------------------------------------------ */
 	/* get minimum audio timestamp */
@@ -434,8 +572,8 @@ bool audio_callback(void *param,
 			pthread_mutex_lock(&source->audio_buf_mutex);
 
 			if (source->audio_output_buf[0][0] && source->audio_ts)
-				mix_audio(mixes, source, channels, sample_rate,
-						&ts);
+				mix_audio(mixes, source, mixers, channels,
+						sample_rate, &ts);
 
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
@@ -32,6 +32,9 @@ struct obs_data_item {
 	volatile long        ref;
 	struct obs_data      *parent;
 	struct obs_data_item *next;
+	struct obs_data_item *prev;
+	struct obs_data_item *hash_next;
+	uint32_t             name_hash;
 	enum obs_data_type   type;
 	size_t               name_len;
 	size_t               data_len;
@@ -46,8 +49,17 @@ struct obs_data {
 	volatile long        ref;
 	char                 *json;
 	struct obs_data_item *first_item;
+	struct obs_data_item *last_item;
+	size_t               num_items;
+
+	/* name index, only built once the object has enough items that a
+	 * linear search starts to cost more than hashing the name */
+	struct obs_data_item **buckets;
+	size_t               num_buckets;
 };
 
+#define OBS_DATA_INDEX_MIN_ITEMS 16
+
 struct obs_data_array {
 	volatile long        ref;
 	DARRAY(obs_data_t*)   objects;
@@ -261,6 +273,18 @@ static inline void item_autoselect_data_addref(struct obs_data_item *item)
 	}
 }
 
+static inline uint32_t get_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
 static struct obs_data_item *obs_data_item_create(const char *name,
 		const void *data, size_t size, enum obs_data_type type,
 		bool default_data, bool autoselect_data)
@@ -276,10 +300,11 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 
 	item = bzalloc(total_size);
 
-	item->capacity = total_size;
-	item->type     = type;
-	item->name_len = name_size;
-	item->ref      = 1;
+	item->capacity  = total_size;
+	item->type      = type;
+	item->name_len  = name_size;
+	item->name_hash = get_name_hash(name);
+	item->ref       = 1;
 
 	if (default_data) {
 		item->default_len = size;
@@ -300,45 +325,170 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 	return item;
 }
 
-static struct obs_data_item **get_item_prev_next(struct obs_data *data,
-		struct obs_data_item *current)
+/* ------------------------------------------------------------------------- */
+/* Name index */
+
+static inline struct obs_data_item **get_bucket(struct obs_data *data,
+		uint32_t hash)
 {
-	if (!current || !data)
-		return NULL;
+	return &data->buckets[hash & (data->num_buckets - 1)];
+}
 
-	struct obs_data_item **prev_next = &data->first_item;
-	struct obs_data_item *item       = data->first_item;
+static inline void index_add(struct obs_data *data,
+		struct obs_data_item *item)
+{
+	struct obs_data_item **bucket = get_bucket(data, item->name_hash);
+	item->hash_next = *bucket;
+	*bucket = item;
+}
 
-	while (item) {
-		if (item == current)
-			return prev_next;
+static inline struct obs_data_item **index_find_link(struct obs_data *data,
+		uint32_t hash, struct obs_data_item *item)
+{
+	struct obs_data_item **link = get_bucket(data, hash);
 
-		prev_next = &item->next;
-		item      = item->next;
+	while (*link) {
+		if (*link == item)
+			return link;
+		link = &(*link)->hash_next;
 	}
 
 	return NULL;
 }
 
-static inline void obs_data_item_detach(struct obs_data_item *item)
+static void index_rebuild(struct obs_data *data, size_t num_buckets)
+{
+	struct obs_data_item *item = data->first_item;
+
+	bfree(data->buckets);
+	data->buckets     = bzalloc(sizeof(struct obs_data_item*) *
+			num_buckets);
+	data->num_buckets = num_buckets;
+
+	while (item) {
+		index_add(data, item);
+		item = item->next;
+	}
+}
+
+static inline void index_insert(struct obs_data *data,
+		struct obs_data_item *item)
 {
-	struct obs_data_item **prev_next = get_item_prev_next(item->parent,
-			item);
+	/* once built, the index is kept up to date even if items are removed
+	 * again, otherwise items added after that would not be found */
+	if (!data->buckets && data->num_items < OBS_DATA_INDEX_MIN_ITEMS)
+		return;
 
-	if (prev_next) {
-		*prev_next = item->next;
-		item->next = NULL;
+	/* keep the load factor at or below 1 */
+	if (data->num_items > data->num_buckets) {
+		size_t size = data->num_buckets ?
+			data->num_buckets * 2 : OBS_DATA_INDEX_MIN_ITEMS * 2;
+
+		/* the item has already been linked in to the list */
+		index_rebuild(data, size);
+		return;
 	}
+
+	index_add(data, item);
+}
+
+static inline void index_remove(struct obs_data *data,
+		struct obs_data_item *item)
+{
+	struct obs_data_item **link;
+
+	if (!data->buckets)
+		return;
+
+	link = index_find_link(data, item->name_hash, item);
+	if (link)
+		*link = item->hash_next;
+	item->hash_next = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline bool obs_data_item_attached(struct obs_data *data,
+		struct obs_data_item *item)
+{
+	return data && (item->prev || data->first_item == item);
+}
+
+static void obs_data_item_attach(struct obs_data *data,
+		struct obs_data_item *prev, struct obs_data_item *item)
+{
+	struct obs_data_item *next = prev ? prev->next : data->first_item;
+
+	item->parent = data;
+	item->prev   = prev;
+	item->next   = next;
+
+	if (prev)
+		prev->next = item;
+	else
+		data->first_item = item;
+
+	if (next)
+		next->prev = item;
+	else
+		data->last_item = item;
+
+	data->num_items++;
+	index_insert(data, item);
+}
+
+static inline void obs_data_item_detach(struct obs_data_item *item)
+{
+	struct obs_data *data = item->parent;
+
+	if (!obs_data_item_attached(data, item))
+		return;
+
+	index_remove(data, item);
+
+	if (item->prev)
+		item->prev->next = item->next;
+	else
+		data->first_item = item->next;
+
+	if (item->next)
+		item->next->prev = item->prev;
+	else
+		data->last_item = item->prev;
+
+	item->prev = NULL;
+	item->next = NULL;
+	data->num_items--;
 }
 
+/* brealloc may have moved the item, so everything that points to the old
+ * address (its list neighbors and its index bucket) needs to be updated */
 static inline void obs_data_item_reattach(struct obs_data_item *old_ptr,
 		struct obs_data_item *new_ptr)
 {
-	struct obs_data_item **prev_next = get_item_prev_next(new_ptr->parent,
-			old_ptr);
+	struct obs_data *data = new_ptr->parent;
+	struct obs_data_item **link;
+
+	if (old_ptr == new_ptr)
+		return;
+	if (!data || (!new_ptr->prev && data->first_item != old_ptr))
+		return;
 
-	if (prev_next)
-		*prev_next = new_ptr;
+	if (new_ptr->prev)
+		new_ptr->prev->next = new_ptr;
+	else
+		data->first_item = new_ptr;
+
+	if (new_ptr->next)
+		new_ptr->next->prev = new_ptr;
+	else
+		data->last_item = new_ptr;
+
+	if (data->buckets) {
+		link = index_find_link(data, new_ptr->name_hash, old_ptr);
+		if (link)
+			*link = new_ptr;
+	}
 }
 
 static struct obs_data_item *obs_data_item_ensure_capacity(
@@ -706,10 +856,20 @@ static inline void obs_data_destroy(struct obs_data *data)
 
 	while (item) {
 		struct obs_data_item *next = item->next;
+
+		/* items can still be referenced elsewhere, so they must not
+		 * try to detach themselves from this object later on */
+		item->parent    = NULL;
+		item->prev      = NULL;
+		item->next      = NULL;
+		item->hash_next = NULL;
+
 		obs_data_item_release(&item);
 		item = next;
 	}
 
+	bfree(data->buckets);
+
 	/* NOTE: don't use bfree for json text, allocated by json */
 	free(data->json);
 	bfree(data);
@@ -767,7 +927,24 @@ static struct obs_data_item *get_item(struct obs_data *data, const char *name)
 {
 	if (!data) return NULL;
 
-	struct obs_data_item *item = data->first_item;
+	struct obs_data_item *item;
+
+	if (data->buckets) {
+		uint32_t hash = get_name_hash(name);
+		item = *get_bucket(data, hash);
+
+		while (item) {
+			if (item->name_hash == hash &&
+			    strcmp(get_item_name(item), name) == 0)
+				return item;
+
+			item = item->hash_next;
+		}
+
+		return NULL;
+	}
+
+	item = data->first_item;
 
 	while (item) {
 		if (strcmp(get_item_name(item), name) == 0)
@@ -779,6 +956,29 @@ static struct obs_data_item *get_item(struct obs_data *data, const char *name)
 	return NULL;
 }
 
+/* returns the item that a new item with the given name should be inserted
+ * after, or NULL if it should become the first item */
+static struct obs_data_item *get_insert_prev(struct obs_data *data,
+		const char *name)
+{
+	struct obs_data_item *prev = data->last_item;
+
+	/* objects are usually built (and loaded from json) in sorted order,
+	 * so check the end of the list first */
+	if (!prev || strcmp(get_item_name(prev), name) < 0)
+		return prev;
+
+	prev = NULL;
+	for (struct obs_data_item *item = data->first_item; item;
+			item = item->next) {
+		if (strcmp(get_item_name(item), name) > 0)
+			break;
+		prev = item;
+	}
+
+	return prev;
+}
+
 static void set_item_data(struct obs_data *data, struct obs_data_item **item,
 		const char *name, const void *ptr, size_t size,
 		enum obs_data_type type,
@@ -789,31 +989,11 @@ static void set_item_data(struct obs_data *data, struct obs_data_item **item,
 	if ((!item || (item && !*item)) && data) {
 		new_item = obs_data_item_create(name, ptr, size, type,
 				default_data, autoselect_data);
+		if (!new_item)
+			return;
 
-		obs_data_item_t *prev = obs_data_first(data);
-		obs_data_item_t *next = obs_data_first(data);
-		obs_data_item_next(&next);
-		for (; prev && next; obs_data_item_next(&prev),
-				obs_data_item_next(&next)) {
-			if (strcmp(get_item_name(next), name) > 0)
-				break;
-		}
-
-		new_item->parent = data;
-		if (prev && strcmp(get_item_name(prev), name) < 0) {
-			prev->next     = new_item;
-			new_item->next = next;
-
-		} else {
-			data->first_item = new_item;
-			new_item->next   = prev;
-		}
-
-		if (!prev)
-			data->first_item = new_item;
-
-		obs_data_item_release(&prev);
-		obs_data_item_release(&next);
+		obs_data_item_attach(data, get_insert_prev(data, name),
+				new_item);
 
 	} else if (default_data) {
 		obs_data_item_set_default_data(item, ptr, size, type);
@@ -106,7 +106,8 @@ static struct obs_encoder *create_encoder(const char *id,
 
 	obs_context_data_insert(&encoder->context,
 			&obs->data.encoders_mutex,
-			&obs->data.first_encoder);
+			&obs->data.first_encoder,
+			&obs->data.encoders_index);
 
 	blog(LOG_DEBUG, "encoder '%s' (%s) created", name, id);
 	return encoder;
@@ -427,10 +428,17 @@ void obs_encoder_shutdown(obs_encoder_t *encoder)
 		encoder->first_received  = false;
 		encoder->offset_usec     = 0;
 		encoder->start_ts        = 0;
+		encoder->latency_usec    = 0;
 	}
 	pthread_mutex_unlock(&encoder->init_mutex);
 }
 
+static inline void reset_frame_times(struct obs_encoder *encoder)
+{
+	for (size_t i = 0; i < ENCODER_LATENCY_FRAMES; i++)
+		encoder->frame_times[i].pts = -1;
+}
+
 static inline size_t get_callback_idx(
 		const struct obs_encoder *encoder,
 		void (*new_packet)(void *param, struct encoder_packet *packet),
@@ -468,6 +476,7 @@ static inline void obs_encoder_start_internal(obs_encoder_t *encoder,
 
 	if (first) {
 		encoder->cur_pts = 0;
+		reset_frame_times(encoder);
 		add_connection(encoder);
 	}
 }
@@ -708,6 +717,20 @@ bool obs_encoder_active(const obs_encoder_t *encoder)
 		encoder_active(encoder) : false;
 }
 
+size_t obs_encoder_get_active_output_count(obs_encoder_t *encoder)
+{
+	size_t count;
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_active_output_count"))
+		return 0;
+
+	pthread_mutex_lock(&encoder->callbacks_mutex);
+	count = encoder->callbacks.num;
+	pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+	return count;
+}
+
 static inline bool get_sei(const struct obs_encoder *encoder,
 		uint8_t **sei, size_t *size)
 {
@@ -744,10 +767,14 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	first_packet.data = data.array;
 	first_packet.size = data.num;
 
+	/* outputs expect every packet to be a shared instance */
+	obs_encoder_packet_create_instance(&first_packet, &first_packet);
+	da_free(data);
+
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&first_packet);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -771,6 +798,37 @@ static void full_stop(struct obs_encoder *encoder)
 }
 
 static const char *do_encode_name = "do_encode";
+static inline struct encoder_frame_time *get_frame_time(
+		struct obs_encoder *encoder, int64_t pts)
+{
+	size_t idx = (size_t)(pts / encoder->timebase_num) &
+		(ENCODER_LATENCY_FRAMES - 1);
+	return &encoder->frame_times[idx];
+}
+
+/* pts values only count the frames that reached the encoder, so the time of
+ * the raw frame is looked up by pts rather than calculated from it */
+static inline void update_latency(struct obs_encoder *encoder,
+		const struct encoder_packet *pkt)
+{
+	struct encoder_frame_time *frame_time;
+	int64_t latency;
+	long    avg;
+
+	if (pkt->pts < 0)
+		return;
+
+	frame_time = get_frame_time(encoder, pkt->pts);
+	if (frame_time->pts != pkt->pts)
+		return;
+
+	latency = (int64_t)(os_gettime_ns() - frame_time->ts) / 1000;
+	avg     = os_atomic_load_long(&encoder->latency_usec);
+
+	os_atomic_set_long(&encoder->latency_usec, avg ?
+			avg + (long)((latency - avg) / 8) : (long)latency);
+}
+
 static inline void do_encode(struct obs_encoder *encoder,
 		struct encoder_frame *frame)
 {
@@ -811,12 +869,24 @@ static inline void do_encode(struct obs_encoder *encoder,
 			packet_dts_usec(&pkt) - encoder->offset_usec;
 		pkt.sys_dts_usec = pkt.dts_usec;
 
+		if (encoder->info.type == OBS_ENCODER_VIDEO)
+			update_latency(encoder, &pkt);
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
-		for (size_t i = encoder->callbacks.num; i > 0; i--) {
-			struct encoder_callback *cb;
-			cb = encoder->callbacks.array+(i-1);
-			send_packet(encoder, cb, &pkt);
+		/* copy the data out of the encoder's buffer once, every
+		 * output then holds a reference to the same payload */
+		if (encoder->callbacks.num) {
+			struct encoder_packet shared;
+			obs_encoder_packet_create_instance(&shared, &pkt);
+
+			for (size_t i = encoder->callbacks.num; i > 0; i--) {
+				struct encoder_callback *cb;
+				cb = encoder->callbacks.array+(i-1);
+				send_packet(encoder, cb, &shared);
+			}
+
+			obs_encoder_packet_release(&shared);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
@@ -833,6 +903,7 @@ static void receive_video(void *param, struct video_data *frame)
 	struct obs_encoder    *encoder  = param;
 	struct obs_encoder    *pair     = encoder->paired_encoder;
 	struct encoder_frame  enc_frame;
+	struct encoder_frame_time *frame_time;
 
 	if (!encoder->first_received && pair) {
 		if (!pair->first_received ||
@@ -854,6 +925,10 @@ static void receive_video(void *param, struct video_data *frame)
 	enc_frame.frames = 1;
 	enc_frame.pts    = encoder->cur_pts;
 
+	frame_time = get_frame_time(encoder, enc_frame.pts);
+	frame_time->pts = enc_frame.pts;
+	frame_time->ts  = frame->timestamp;
+
 	do_encode(encoder, &enc_frame);
 
 	encoder->cur_pts += encoder->timebase_num;
@@ -1047,6 +1122,54 @@ void obs_free_encoder_packet(struct encoder_packet *packet)
 	memset(packet, 0, sizeof(struct encoder_packet));
 }
 
+/* shared packet data is prefixed with its reference count, padded so that
+ * the data keeps the 16 byte alignment of the allocation */
+#define PACKET_REFS_SIZE 16
+
+static inline long *packet_refs(const struct encoder_packet *packet)
+{
+	return (long*)(packet->data - PACKET_REFS_SIZE);
+}
+
+void obs_encoder_packet_create_instance(struct encoder_packet *dst,
+		const struct encoder_packet *src)
+{
+	const uint8_t *src_data = src->data;
+	uint8_t *buf = bmalloc(PACKET_REFS_SIZE + src->size);
+
+	*(long*)buf = 1;
+	memcpy(buf + PACKET_REFS_SIZE, src_data, src->size);
+
+	*dst = *src;
+	dst->data = buf + PACKET_REFS_SIZE;
+}
+
+void obs_encoder_packet_ref(struct encoder_packet *dst,
+		struct encoder_packet *src)
+{
+	if (!src)
+		return;
+
+	if (src->data)
+		os_atomic_inc_long(packet_refs(src));
+
+	*dst = *src;
+}
+
+void obs_encoder_packet_release(struct encoder_packet *packet)
+{
+	if (!packet)
+		return;
+
+	if (packet->data) {
+		long *refs = packet_refs(packet);
+		if (os_atomic_dec_long(refs) == 0)
+			bfree(refs);
+	}
+
+	memset(packet, 0, sizeof(struct encoder_packet));
+}
+
 void obs_encoder_set_preferred_video_format(obs_encoder_t *encoder,
 		enum video_format format)
 {
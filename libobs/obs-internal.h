@@ -20,6 +20,7 @@
 #include "util/c99defs.h"
 #include "util/darray.h"
 #include "util/circlebuf.h"
+#include "util/spsc-ring.h"
 #include "util/dstr.h"
 #include "util/threading.h"
 #include "util/platform.h"
@@ -32,6 +33,7 @@
 
 #include "media-io/audio-resampler.h"
 #include "media-io/video-io.h"
+#include "media-io/slice-pool.h"
 #include "media-io/audio-io.h"
 
 #include "obs.h"
@@ -256,6 +258,7 @@ struct obs_core_video {
 	uint32_t                        plane_offsets[3];
 	uint32_t                        plane_sizes[3];
 	uint32_t                        plane_linewidth[3];
+	slice_pool_t                    *convert_pool;
 
 	uint32_t                        output_width;
 	uint32_t                        output_height;
@@ -283,6 +286,18 @@ struct obs_core_audio {
 	DARRAY(struct obs_source*)      render_order;
 	DARRAY(struct obs_source*)      root_nodes;
 
+	/* sources without a custom audio_render, rendered in parallel */
+	DARRAY(struct obs_source*)      render_leaves;
+	slice_pool_t                    *render_pool;
+
+	/* render order from the last tree walk, reused until the tree
+	 * changes (see obs_audio_tree_changed) */
+	DARRAY(obs_weak_source_t*)      cached_render_order;
+	struct obs_source               *cached_roots[MAX_CHANNELS];
+	volatile long                   tree_version;
+	long                            cached_tree_version;
+	bool                            tree_cached;
+
 	uint64_t                        buffered_ts;
 	struct circlebuf                buffered_timestamps;
 	int                             buffering_wait_ticks;
@@ -292,6 +307,14 @@ struct obs_core_audio {
 };
 
 /* user sources, output channels, and displays */
+/* name -> context hash, protected by the mutex of the list it indexes */
+struct obs_context_index {
+	struct obs_context_data         **buckets;
+	size_t                          num_buckets;
+	size_t                          num;
+	uint64_t                        next_order;
+};
+
 struct obs_core_data {
 	struct obs_source               *first_source;
 	struct obs_source               *first_audio_source;
@@ -307,6 +330,11 @@ struct obs_core_data {
 	pthread_mutex_t                 services_mutex;
 	pthread_mutex_t                 audio_sources_mutex;
 
+	struct obs_context_index        sources_index;
+	struct obs_context_index        outputs_index;
+	struct obs_context_index        encoders_index;
+	struct obs_context_index        services_index;
+
 	struct obs_view                 main_view;
 
 	long long                       unnamed_index;
@@ -412,6 +440,15 @@ struct obs_context_data {
 	struct obs_context_data         *next;
 	struct obs_context_data         **prev_next;
 
+	struct obs_context_index        *index;
+	struct obs_context_data         *hash_next;
+	struct obs_context_data         **hash_prev_next;
+	uint32_t                        name_hash;
+
+	/* position in the list, chains are kept newest first so lookups
+	 * find the same context as walking the list would */
+	uint64_t                        index_order;
+
 	bool                            private;
 };
 
@@ -425,7 +462,8 @@ extern bool obs_context_data_init(
 extern void obs_context_data_free(struct obs_context_data *context);
 
 extern void obs_context_data_insert(struct obs_context_data *context,
-		pthread_mutex_t *mutex, void *first);
+		pthread_mutex_t *mutex, void *first,
+		struct obs_context_index *index);
 extern void obs_context_data_remove(struct obs_context_data *context);
 
 extern void obs_context_data_setname(struct obs_context_data *context,
@@ -477,12 +515,6 @@ static inline bool obs_weak_ref_get_ref(struct obs_weak_ref *ref)
 /* ------------------------------------------------------------------------- */
 /* sources  */
 
-struct async_frame {
-	struct obs_source_frame *frame;
-	long unused_count;
-	bool used;
-};
-
 enum audio_action_type {
 	AUDIO_ACTION_VOL,
 	AUDIO_ACTION_MUTE,
@@ -584,7 +616,6 @@ struct obs_source {
 	struct obs_source_frame         *cur_async_frame;
 	bool                            async_gpu_conversion;
 	enum video_format               async_format;
-	enum video_format               async_cache_format;
 	enum gs_color_format            async_texture_format;
 	float                           async_color_matrix[16];
 	bool                            async_full_range;
@@ -593,13 +624,37 @@ struct obs_source {
 	int                             async_plane_offset[2];
 	bool                            async_flip;
 	bool                            async_active;
-	DARRAY(struct async_frame)      async_cache;
-	DARRAY(struct obs_source_frame*)async_frames;
+
+	/* frames queued for display; capture threads push under
+	 * async_producer_mutex and the video thread pops under async_mutex */
+	struct spsc_ring                async_frames;
+
+	/* frames returned for reuse; released under async_mutex, reused
+	 * under async_producer_mutex */
+	struct spsc_ring                async_free_frames;
+	struct obs_source_frame         *async_spare_frame;
+	long                            async_idle_count;
+
+	/* serializes obs_source_output_video, borrow/commit/discard_frame,
+	 * never taken by the video thread */
+	pthread_mutex_t                 async_producer_mutex;
+
+	/* backlog policy, see obs_source_set_async_backlog */
+	volatile long                   async_backlog_policy;
+	volatile long                   async_max_frames;
+	volatile long                   async_block_timeout_ms;
+	os_event_t                      *async_space_event;
+	volatile bool                   async_capture_waiting;
+
+	volatile uint64_t               async_frames_queued;
+	volatile uint64_t               async_frames_dropped;
+	volatile uint64_t               async_frames_trimmed;
+	volatile uint64_t               async_capture_block_ns;
+	volatile uint64_t               async_video_block_ns;
+
 	pthread_mutex_t                 async_mutex;
 	uint32_t                        async_width;
 	uint32_t                        async_height;
-	uint32_t                        async_cache_width;
-	uint32_t                        async_cache_height;
 	uint32_t                        async_convert_width;
 	uint32_t                        async_convert_height;
 
@@ -684,6 +739,14 @@ enum view_type {
 	AUX_VIEW
 };
 
+/* must be called after anything that changes what
+ * obs_source_enum_active_tree returns, or the set of audio sources */
+static inline void obs_audio_tree_changed(void)
+{
+	if (obs)
+		os_atomic_inc_long(&obs->audio.tree_version);
+}
+
 static inline void obs_source_dosignal(struct obs_source *source,
 		const char *signal_obs, const char *signal_source)
 {
@@ -741,6 +804,13 @@ extern bool update_async_texture(struct obs_source *source,
 		gs_texture_t *tex, gs_texrender_t *texrender);
 extern bool set_async_texture_size(struct obs_source *source,
 		const struct obs_source_frame *frame);
+static inline struct obs_source_frame *async_frame_peek(
+		obs_source_t *source, size_t idx)
+{
+	return (struct obs_source_frame*)spsc_ring_peek(&source->async_frames,
+			idx);
+}
+
 extern void remove_async_frame(obs_source_t *source,
 		struct obs_source_frame *frame);
 
@@ -768,6 +838,13 @@ struct delay_data {
 
 typedef void (*encoded_callback_t)(void *data, struct encoder_packet *packet);
 
+#define OUTPUT_BITRATE_SAMPLES 16
+
+struct output_bitrate_sample {
+	uint64_t ts;
+	uint64_t bytes;
+};
+
 struct obs_weak_output {
 	struct obs_weak_ref ref;
 	struct obs_output *output;
@@ -792,7 +869,11 @@ struct obs_output {
 	pthread_t                       end_data_capture_thread;
 	os_event_t                      *stopping_event;
 	pthread_mutex_t                 interleaved_mutex;
-	DARRAY(struct encoder_packet)   interleaved_packets;
+
+	/* one dts-ordered queue of encoder_packets per track, with video at
+	 * index 0 and audio track N at index N+1; the queues are merged by
+	 * dts when sending */
+	struct circlebuf                interleaved_packets[MAX_AUDIO_MIXES + 1];
 	int                             stop_code;
 
 	int                             reconnect_retry_sec;
@@ -839,6 +920,14 @@ struct obs_output {
 	volatile long                   delay_restart_refs;
 	volatile bool                   delay_active;
 	volatile bool                   delay_capturing;
+
+	/* stats, see obs_output_get_stats */
+	volatile long                   track_packets[MAX_AUDIO_MIXES + 1];
+	pthread_mutex_t                 stats_mutex;
+	uint64_t                        stats_start_ns;
+	struct output_bitrate_sample    bitrate_samples[OUTPUT_BITRATE_SAMPLES];
+	size_t                          bitrate_sample_pos;
+	size_t                          num_bitrate_samples;
 };
 
 static inline void do_output_signal(struct obs_output *output,
@@ -880,6 +969,15 @@ struct encoder_callback {
 	void *param;
 };
 
+/* enough to cover the frames a video encoder holds on to (lookahead,
+ * b-frames), must be a power of two */
+#define ENCODER_LATENCY_FRAMES 128
+
+struct encoder_frame_time {
+	int64_t  pts;
+	uint64_t ts;
+};
+
 struct obs_encoder {
 	struct obs_context_data         context;
 	struct obs_encoder_info         info;
@@ -924,6 +1022,12 @@ struct obs_encoder {
 	uint64_t                        first_raw_ts;
 	uint64_t                        start_ts;
 
+	/* smoothed raw frame timestamp to packet time, in microseconds.  the
+	 * timestamp of each raw video frame is kept by pts until its packet
+	 * comes out of the encoder */
+	volatile long                   latency_usec;
+	struct encoder_frame_time       frame_times[ENCODER_LATENCY_FRAMES];
+
 	pthread_mutex_t                 outputs_mutex;
 	DARRAY(obs_output_t*)            outputs;
 
@@ -99,11 +99,14 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 	output = bzalloc(sizeof(struct obs_output));
 	pthread_mutex_init_value(&output->interleaved_mutex);
 	pthread_mutex_init_value(&output->delay_mutex);
+	pthread_mutex_init_value(&output->stats_mutex);
 
 	if (pthread_mutex_init(&output->interleaved_mutex, NULL) != 0)
 		goto fail;
 	if (pthread_mutex_init(&output->delay_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&output->stats_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&output->stopping_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 	if (!init_output_handlers(output, name, settings, hotkey_data))
@@ -144,7 +147,8 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 
 	obs_context_data_insert(&output->context,
 			&obs->data.outputs_mutex,
-			&obs->data.first_output);
+			&obs->data.first_output,
+			&obs->data.outputs_index);
 
 	blog(LOG_DEBUG, "output '%s' (%s) created", name, id);
 	return output;
@@ -156,9 +160,17 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_free_encoder_packet(output->interleaved_packets.array+i);
-	da_free(output->interleaved_packets);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++) {
+		struct circlebuf *queue = &output->interleaved_packets[i];
+		struct encoder_packet packet;
+
+		while (queue->size) {
+			circlebuf_pop_front(queue, &packet, sizeof(packet));
+			obs_encoder_packet_release(&packet);
+		}
+
+		circlebuf_free(queue);
+	}
 }
 
 void obs_output_destroy(obs_output_t *output)
@@ -198,6 +210,7 @@ void obs_output_destroy(obs_output_t *output)
 		os_event_destroy(output->stopping_event);
 		pthread_mutex_destroy(&output->interleaved_mutex);
 		pthread_mutex_destroy(&output->delay_mutex);
+		pthread_mutex_destroy(&output->stats_mutex);
 		os_event_destroy(output->reconnect_stop_event);
 		obs_context_data_free(&output->context);
 		circlebuf_free(&output->delay_data);
@@ -679,6 +692,113 @@ int obs_output_get_total_frames(const obs_output_t *output)
 		output->total_frames : 0;
 }
 
+static inline size_t packet_queue_idx(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : packet->track_idx + 1;
+}
+
+static inline size_t queue_num_packets(const struct circlebuf *queue)
+{
+	return queue->size / sizeof(struct encoder_packet);
+}
+
+#define BITRATE_SAMPLE_INTERVAL_NS 100000000ULL
+#define BITRATE_WINDOW_NS          1000000000ULL
+
+static inline double kbps(uint64_t bytes, uint64_t ns)
+{
+	return ns ? (double)bytes * 8000000.0 / (double)ns : 0.0;
+}
+
+/* the bitrate is taken over the newest sample that is at least a second old
+ * (or the oldest sample there is), so it does not depend on how often or
+ * from how many places the stats are polled */
+static double get_bitrate(struct obs_output *output, uint64_t ts,
+		uint64_t bytes)
+{
+	struct output_bitrate_sample *samples = output->bitrate_samples;
+	struct output_bitrate_sample *ref = NULL;
+	size_t newest = 0;
+
+	if (output->num_bitrate_samples) {
+		newest = (output->bitrate_sample_pos + OUTPUT_BITRATE_SAMPLES - 1)
+			% OUTPUT_BITRATE_SAMPLES;
+
+		/* byte count restarted */
+		if (bytes < samples[newest].bytes)
+			output->num_bitrate_samples = 0;
+	}
+
+	if (!output->num_bitrate_samples ||
+	    ts - samples[newest].ts >= BITRATE_SAMPLE_INTERVAL_NS) {
+		samples[output->bitrate_sample_pos].ts    = ts;
+		samples[output->bitrate_sample_pos].bytes = bytes;
+
+		output->bitrate_sample_pos = (output->bitrate_sample_pos + 1) %
+			OUTPUT_BITRATE_SAMPLES;
+		if (output->num_bitrate_samples < OUTPUT_BITRATE_SAMPLES)
+			output->num_bitrate_samples++;
+	}
+
+	for (size_t i = output->num_bitrate_samples; i > 0; i--) {
+		size_t idx = (output->bitrate_sample_pos +
+				OUTPUT_BITRATE_SAMPLES - i) %
+			OUTPUT_BITRATE_SAMPLES;
+
+		if (!ref || ts - samples[idx].ts >= BITRATE_WINDOW_NS)
+			ref = &samples[idx];
+	}
+
+	return kbps(bytes - ref->bytes, ts - ref->ts);
+}
+
+bool obs_output_get_stats(obs_output_t *output, struct obs_output_stats *stats)
+{
+	uint64_t ts = os_gettime_ns();
+
+	if (!obs_output_valid(output, "obs_output_get_stats"))
+		return false;
+	if (!obs_ptr_valid(stats, "obs_output_get_stats"))
+		return false;
+
+	memset(stats, 0, sizeof(struct obs_output_stats));
+
+	stats->total_bytes    = obs_output_get_total_bytes(output);
+	stats->total_frames   = output->total_frames;
+	stats->frames_dropped = obs_output_get_frames_dropped(output);
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++)
+		stats->track_packets[i] = (uint64_t)os_atomic_load_long(
+				&output->track_packets[i]);
+
+	pthread_mutex_lock(&output->interleaved_mutex);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++)
+		stats->interleaved_packets += queue_num_packets(
+				&output->interleaved_packets[i]);
+	pthread_mutex_unlock(&output->interleaved_mutex);
+
+	pthread_mutex_lock(&output->delay_mutex);
+	stats->delayed_packets =
+		output->delay_data.size / sizeof(struct delay_data);
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	if (output->video_encoder)
+		stats->encoder_latency_ms = (double)os_atomic_load_long(
+				&output->video_encoder->latency_usec) / 1000.0;
+
+	pthread_mutex_lock(&output->stats_mutex);
+	stats->bitrate_kbps = get_bitrate(output, ts, stats->total_bytes);
+	if (output->stats_start_ns && ts > output->stats_start_ns)
+		stats->avg_bitrate_kbps = kbps(stats->total_bytes,
+				ts - output->stats_start_ns);
+	pthread_mutex_unlock(&output->stats_mutex);
+
+	if (output->info.get_stats && output->context.data)
+		output->info.get_stats(output->context.data, stats);
+
+	return true;
+}
+
 void obs_output_set_preferred_size(obs_output_t *output, uint32_t width,
 		uint32_t height)
 {
@@ -942,9 +1062,70 @@ static inline bool has_higher_opposing_ts(struct obs_output *output,
 		return output->highest_video_ts > packet->dts_usec;
 }
 
+static inline struct encoder_packet *queue_packet(struct circlebuf *queue,
+		size_t idx)
+{
+	return circlebuf_data(queue, idx * sizeof(struct encoder_packet));
+}
+
+/* interleaved packets are ordered by dts, then by track (video first) */
+static inline bool packet_before(const struct encoder_packet *a, size_t a_queue,
+		const struct encoder_packet *b, size_t b_queue)
+{
+	if (a->dts_usec != b->dts_usec)
+		return a->dts_usec < b->dts_usec;
+	return a_queue < b_queue;
+}
+
+/* returns the index of the queue holding the earliest packet, or
+ * DARRAY_INVALID if there are no packets */
+static size_t first_packet_queue(struct obs_output *output)
+{
+	struct encoder_packet *first = NULL;
+	size_t first_queue = DARRAY_INVALID;
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++) {
+		struct encoder_packet *packet =
+			queue_packet(&output->interleaved_packets[i], 0);
+
+		if (packet && (!first || packet_before(packet, i,
+						first, first_queue))) {
+			first = packet;
+			first_queue = i;
+		}
+	}
+
+	return first_queue;
+}
+
+/* outputs that don't share packets own the one they receive (and may free it
+ * with obs_free_encoder_packet), so they get a copy of the shared data */
+static void send_owned_packet(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	struct encoder_packet copy;
+
+	if ((output->info.flags & OBS_OUTPUT_SHARED_PACKETS) != 0) {
+		output->info.encoded_packet(output->context.data, packet);
+		return;
+	}
+
+	obs_duplicate_encoder_packet(&copy, packet);
+	output->info.encoded_packet(output->context.data, &copy);
+	obs_free_encoder_packet(&copy);
+}
+
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct encoder_packet out;
+	struct circlebuf *queue;
+	size_t queue_idx = first_packet_queue(output);
+
+	if (queue_idx == DARRAY_INVALID)
+		return;
+
+	queue = &output->interleaved_packets[queue_idx];
+	out = *queue_packet(queue, 0);
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timstamp in the interleave buffer.
@@ -955,9 +1136,11 @@ static inline void send_interleaved(struct obs_output *output)
 	if (out.type == OBS_ENCODER_VIDEO)
 		output->total_frames++;
 
-	da_erase(output->interleaved_packets, 0);
-	output->info.encoded_packet(output->context.data, &out);
-	obs_free_encoder_packet(&out);
+	os_atomic_inc_long(&output->track_packets[queue_idx]);
+
+	circlebuf_pop_front(queue, NULL, sizeof(out));
+	send_owned_packet(output, &out);
+	obs_encoder_packet_release(&out);
 }
 
 static inline void set_higher_ts(struct obs_output *output,
@@ -974,111 +1157,167 @@ static inline void set_higher_ts(struct obs_output *output,
 
 static inline struct encoder_packet *find_first_packet_type(
 		struct obs_output *output, enum obs_encoder_type type,
-		size_t audio_idx);
-static int find_first_packet_type_idx(struct obs_output *output,
-		enum obs_encoder_type type, size_t audio_idx);
+		size_t audio_idx)
+{
+	size_t queue_idx = type == OBS_ENCODER_VIDEO ? 0 : audio_idx + 1;
+	return queue_packet(&output->interleaved_packets[queue_idx], 0);
+}
 
-/* gets the point where audio and video are closest together */
-static size_t get_interleaved_start_idx(struct obs_output *output)
+static inline struct encoder_packet *find_last_packet_type(
+		struct obs_output *output, enum obs_encoder_type type,
+		size_t audio_idx)
+{
+	size_t queue_idx = type == OBS_ENCODER_VIDEO ? 0 : audio_idx + 1;
+	struct circlebuf *queue = &output->interleaved_packets[queue_idx];
+	size_t num = queue_num_packets(queue);
+
+	return num ? queue_packet(queue, num - 1) : NULL;
+}
+
+/* gets the point where audio and video are closest together.  returns false
+ * if there is nothing before that point */
+static bool get_interleaved_start(struct obs_output *output,
+		size_t *start_queue, size_t *start_pos)
 {
 	int64_t closest_diff = 0x7FFFFFFFFFFFFFFFLL;
 	struct encoder_packet *first_video = find_first_packet_type(output,
 			OBS_ENCODER_VIDEO, 0);
-	size_t video_idx = DARRAY_INVALID;
-	size_t idx = 0;
-
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		int64_t diff;
-
-		if (packet->type != OBS_ENCODER_AUDIO) {
-			if (packet == first_video)
-				video_idx = i;
-			continue;
+	struct encoder_packet *closest = NULL;
+	size_t closest_queue = 0;
+	size_t closest_pos = 0;
+
+	for (size_t i = 1; i < MAX_AUDIO_MIXES + 1; i++) {
+		struct circlebuf *queue = &output->interleaved_packets[i];
+		size_t num = queue_num_packets(queue);
+
+		for (size_t j = 0; j < num; j++) {
+			struct encoder_packet *packet = queue_packet(queue, j);
+			int64_t diff;
+
+			diff = llabs(packet->dts_usec - first_video->dts_usec);
+			if (diff < closest_diff || (diff == closest_diff &&
+					packet_before(packet, i,
+						closest, closest_queue))) {
+				closest_diff = diff;
+				closest = packet;
+				closest_queue = i;
+				closest_pos = j;
+			}
 		}
+	}
 
-		diff = llabs(packet->dts_usec - first_video->dts_usec);
-		if (diff < closest_diff) {
-			closest_diff = diff;
-			idx = i;
-		}
+	if (!closest)
+		return false;
+
+	if (packet_before(first_video, 0, closest, closest_queue)) {
+		*start_queue = 0;
+		*start_pos = 0;
+	} else {
+		*start_queue = closest_queue;
+		*start_pos = closest_pos;
 	}
 
-	return video_idx < idx ? video_idx : idx;
+	return true;
 }
 
-static int prune_premature_packets(struct obs_output *output)
+/* returns -1 if a track has no packets yet, 1 if every packet up to and
+ * including the first packet of 'prune_queue' should be pruned, or 0 */
+static int prune_premature_packets(struct obs_output *output,
+		size_t *prune_queue)
 {
 	size_t audio_mixes = num_audio_mixes(output);
 	struct encoder_packet *video;
-	int video_idx;
-	int max_idx;
+	struct encoder_packet *last_first;
+	size_t last_first_queue = 0;
 	int64_t duration_usec;
-	int64_t max_diff = 0;
 	int64_t diff = 0;
 
-	video_idx = find_first_packet_type_idx(output, OBS_ENCODER_VIDEO, 0);
-	if (video_idx == -1) {
+	video = find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
+	if (!video) {
 		output->received_video = false;
 		return -1;
 	}
 
-	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
+	last_first = video;
 	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
 
 	for (size_t i = 0; i < audio_mixes; i++) {
 		struct encoder_packet *audio;
-		int audio_idx;
 
-		audio_idx = find_first_packet_type_idx(output,
-				OBS_ENCODER_AUDIO, i);
-		if (audio_idx == -1) {
+		audio = find_first_packet_type(output, OBS_ENCODER_AUDIO, i);
+		if (!audio) {
 			output->received_audio = false;
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
-		if (audio_idx > max_idx)
-			max_idx = audio_idx;
+		if (packet_before(last_first, last_first_queue, audio, i + 1)) {
+			last_first = audio;
+			last_first_queue = i + 1;
+		}
 
 		diff = audio->dts_usec - video->dts_usec;
-		if (diff > max_diff)
-			max_diff = diff;
 	}
 
-	return diff > duration_usec ? max_idx + 1 : 0;
+	*prune_queue = last_first_queue;
+	return diff > duration_usec ? 1 : 0;
 }
 
-static void discard_to_idx(struct obs_output *output, size_t idx)
+/* frees every packet ordered before the packet at 'pos' in queue
+ * 'cut_queue', and that packet itself if 'inclusive' is set.  returns the
+ * number of packets freed */
+static size_t discard_to_packet(struct obs_output *output, size_t cut_queue,
+		size_t pos, bool inclusive)
 {
-	for (size_t i = 0; i < idx; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		obs_free_encoder_packet(packet);
+	struct circlebuf *queue = &output->interleaved_packets[cut_queue];
+	struct encoder_packet cut = *queue_packet(queue, pos);
+	size_t count = inclusive ? pos + 1 : pos;
+	size_t discarded = 0;
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++) {
+		struct encoder_packet packet;
+		queue = &output->interleaved_packets[i];
+
+		while (queue->size) {
+			circlebuf_peek_front(queue, &packet, sizeof(packet));
+
+			if (i == cut_queue) {
+				if (!count)
+					break;
+				count--;
+			} else if (!packet_before(&packet, i, &cut, cut_queue)) {
+				break;
+			}
+
+			circlebuf_pop_front(queue, NULL, sizeof(packet));
+			obs_encoder_packet_release(&packet);
+			discarded++;
+		}
 	}
 
-	da_erase_range(output->interleaved_packets, 0, idx);
+	return discarded;
 }
 
 #define DEBUG_STARTING_PACKETS 0
 
 static bool prune_interleaved_packets(struct obs_output *output)
 {
-	size_t start_idx = 0;
-	int prune_start = prune_premature_packets(output);
+	size_t start_queue = 0;
+	size_t start_pos = 0;
+	int prune_start = prune_premature_packets(output, &start_queue);
 
 #if DEBUG_STARTING_PACKETS == 1
 	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
-				packet->type == OBS_ENCODER_AUDIO ?
-				"audio" : "video", (int)packet->track_idx,
-				packet->dts_usec,
-				(int)i < prune_start ? "true" : "false");
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++) {
+		struct circlebuf *queue = &output->interleaved_packets[i];
+
+		for (size_t j = 0; j < queue_num_packets(queue); j++) {
+			struct encoder_packet *packet = queue_packet(queue, j);
+			blog(LOG_DEBUG, "packet: %s %d, ts: %lld",
+					packet->type == OBS_ENCODER_AUDIO ?
+					"audio" : "video",
+					(int)packet->track_idx,
+					packet->dts_usec);
+		}
 	}
 #endif
 
@@ -1086,72 +1325,13 @@ static bool prune_interleaved_packets(struct obs_output *output)
 	if (prune_start == -1)
 		return false;
 	else if (prune_start != 0)
-		start_idx = (size_t)prune_start;
-	else
-		start_idx = get_interleaved_start_idx(output);
-
-	if (start_idx)
-		discard_to_idx(output, start_idx);
+		discard_to_packet(output, start_queue, 0, true);
+	else if (get_interleaved_start(output, &start_queue, &start_pos))
+		discard_to_packet(output, start_queue, start_pos, false);
 
 	return true;
 }
 
-static int find_first_packet_type_idx(struct obs_output *output,
-		enum obs_encoder_type type, size_t audio_idx)
-{
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)i;
-		}
-	}
-
-	return -1;
-}
-
-static int find_last_packet_type_idx(struct obs_output *output,
-		enum obs_encoder_type type, size_t audio_idx)
-{
-	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i - 1];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)(i - 1);
-		}
-	}
-
-	return -1;
-}
-
-static inline struct encoder_packet *find_first_packet_type(
-		struct obs_output *output, enum obs_encoder_type type,
-		size_t audio_idx)
-{
-	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
-static inline struct encoder_packet *find_last_packet_type(
-		struct obs_output *output, enum obs_encoder_type type,
-		size_t audio_idx)
-{
-	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
 static bool get_audio_and_video_packets(struct obs_output *output,
 		struct encoder_packet **video,
 		struct encoder_packet **audio, size_t audio_mixes)
@@ -1181,7 +1361,8 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	struct encoder_packet *audio[MAX_AUDIO_MIXES];
 	struct encoder_packet *last_audio[MAX_AUDIO_MIXES];
 	size_t audio_mixes = num_audio_mixes(output);
-	size_t start_idx;
+	size_t start_queue;
+	size_t start_pos;
 
 	if (!get_audio_and_video_packets(output, &video, audio, audio_mixes))
 		return false;
@@ -1199,9 +1380,8 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	}
 
 	/* clear out excess starting audio if it hasn't been already */
-	start_idx = get_interleaved_start_idx(output);
-	if (start_idx) {
-		discard_to_idx(output, start_idx);
+	if (get_interleaved_start(output, &start_queue, &start_pos) &&
+	    discard_to_packet(output, start_queue, start_pos, false)) {
 		if (!get_audio_and_video_packets(output, &video, audio,
 					audio_mixes))
 			return false;
@@ -1226,11 +1406,15 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_audio_ts -= audio[0]->dts_usec;
 	output->highest_video_ts -= video->dts_usec;
 
-	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
+	/* apply new offsets to all existing packet DTS/PTS values.  every
+	 * packet of a track is shifted by the same amount, so the queues stay
+	 * sorted */
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++) {
+		struct circlebuf *queue = &output->interleaved_packets[i];
+
+		for (size_t j = 0; j < queue_num_packets(queue); j++)
+			apply_interleaved_packet_offset(output,
+					queue_packet(queue, j));
 	}
 
 	return true;
@@ -1239,47 +1423,45 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 static inline void insert_interleaved_packet(struct obs_output *output,
 		struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
+	struct circlebuf *queue =
+		&output->interleaved_packets[packet_queue_idx(out)];
+	size_t idx = queue_num_packets(queue);
 
-		if (out->dts_usec < cur_packet->dts_usec)
-			break;
-	}
-
-	da_insert(output->interleaved_packets, idx, out);
-}
-
-static void resort_interleaved_packets(struct obs_output *output)
-{
-	DARRAY(struct encoder_packet) old_array;
+	circlebuf_push_back(queue, out, sizeof(*out));
 
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-			sizeof(output->interleaved_packets));
+	/* packets of a single track normally arrive in dts order, so this
+	 * only moves anything if an encoder goes backwards */
+	while (idx > 0) {
+		struct encoder_packet *prev = queue_packet(queue, idx - 1);
+		struct encoder_packet *cur = queue_packet(queue, idx);
+		struct encoder_packet tmp;
 
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
+		if (prev->dts_usec <= cur->dts_usec)
+			break;
 
-	da_free(old_array);
+		tmp = *prev;
+		*prev = *cur;
+		*cur = tmp;
+		idx--;
+	}
 }
 
 static void discard_unused_audio_packets(struct obs_output *output,
 		int64_t dts_usec)
 {
-	size_t idx = 0;
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++) {
+		struct circlebuf *queue = &output->interleaved_packets[i];
+		struct encoder_packet packet;
 
-	for (; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *p =
-			&output->interleaved_packets.array[idx];
+		while (queue->size) {
+			circlebuf_peek_front(queue, &packet, sizeof(packet));
+			if (packet.dts_usec >= dts_usec)
+				break;
 
-		if (p->dts_usec >= dts_usec)
-			break;
+			circlebuf_pop_front(queue, NULL, sizeof(packet));
+			obs_encoder_packet_release(&packet);
+		}
 	}
-
-	if (idx)
-		discard_to_idx(output, idx);
 }
 
 static void interleave_packets(void *data, struct encoder_packet *packet)
@@ -1304,7 +1486,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 		pthread_mutex_unlock(&output->interleaved_mutex);
 
 		if (output->active_delay_ns)
-			obs_free_encoder_packet(packet);
+			obs_encoder_packet_release(packet);
 		return;
 	}
 
@@ -1313,7 +1495,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_duplicate_encoder_packet(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
@@ -1328,10 +1510,8 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->received_audio && output->received_video) {
 		if (!was_started) {
 			if (prune_interleaved_packets(output)) {
-				if (initialize_interleaved_packets(output)) {
-					resort_interleaved_packets(output);
+				if (initialize_interleaved_packets(output))
 					send_interleaved(output);
-				}
 			}
 		} else {
 			send_interleaved(output);
@@ -1349,14 +1529,23 @@ static void default_encoded_callback(void *param, struct encoder_packet *packet)
 		if (packet->type == OBS_ENCODER_AUDIO)
 			packet->track_idx = get_track_index(output, packet);
 
-		output->info.encoded_packet(output->context.data, packet);
+		os_atomic_inc_long(
+			&output->track_packets[packet_queue_idx(packet)]);
+
+		/* without a delay the packet is the encoder's own, which
+		 * outputs have never been allowed to free */
+		if (output->active_delay_ns)
+			send_owned_packet(output, packet);
+		else
+			output->info.encoded_packet(output->context.data,
+					packet);
 
 		if (packet->type == OBS_ENCODER_VIDEO)
 			output->total_frames++;
 	}
 
 	if (output->active_delay_ns)
-		obs_free_encoder_packet(packet);
+		obs_encoder_packet_release(packet);
 }
 
 static void default_raw_video_callback(void *param, struct video_data *frame)
@@ -1601,6 +1790,18 @@ bool obs_output_initialize_encoders(obs_output_t *output, uint32_t flags)
 	return true;
 }
 
+static void reset_stats(struct obs_output *output)
+{
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++)
+		os_atomic_set_long(&output->track_packets[i], 0);
+
+	pthread_mutex_lock(&output->stats_mutex);
+	output->stats_start_ns      = os_gettime_ns();
+	output->num_bitrate_samples = 0;
+	output->bitrate_sample_pos  = 0;
+	pthread_mutex_unlock(&output->stats_mutex);
+}
+
 static bool begin_delayed_capture(obs_output_t *output)
 {
 	if (delay_capturing(output))
@@ -1632,6 +1833,7 @@ bool obs_output_begin_data_capture(obs_output_t *output, uint32_t flags)
 	if (active(output)) return false;
 
 	output->total_frames   = 0;
+	reset_stats(output);
 
 	convert_flags(output, flags, &encoded, &has_video, &has_audio,
 			&has_service);
@@ -28,8 +28,49 @@ extern "C" {
 #define OBS_OUTPUT_SERVICE     (1<<3)
 #define OBS_OUTPUT_MULTI_TRACK (1<<4)
 
+/**
+ * The output receives encoded packets whose data is shared with other outputs
+ * instead of a private copy.  It must not free them with
+ * obs_free_encoder_packet, and must use obs_encoder_packet_ref to keep one
+ * past the encoded_packet callback.
+ */
+#define OBS_OUTPUT_SHARED_PACKETS (1<<5)
+
 struct encoder_packet;
 
+/**
+ * Snapshot of an output's statistics, filled in by obs_output_get_stats.
+ * The output specific values are left at 0 if the output does not implement
+ * obs_output_info.get_stats.
+ */
+struct obs_output_stats {
+	uint64_t total_bytes;
+	int      total_frames;
+	int      frames_dropped;
+
+	/** Over roughly the last second, and since data capture started */
+	double   bitrate_kbps;
+	double   avg_bitrate_kbps;
+
+	/** Packets waiting to be interleaved, and waiting in the delay queue */
+	size_t   interleaved_packets;
+	size_t   delayed_packets;
+
+	/** Packets passed to the output; video at 0, audio track N at N+1 */
+	uint64_t track_packets[MAX_AUDIO_MIXES + 1];
+
+	/** Raw frame timestamp to encoded packet, for the video encoder */
+	double   encoder_latency_ms;
+
+	/* output specific */
+
+	/** From 0.0 (not congested) to 1.0 (frames are being dropped) */
+	float    congestion;
+
+	/** Encoded packet received by the output to packet sent */
+	double   send_latency_ms;
+};
+
 struct obs_output_info {
 	/* required */
 	const char *id;
@@ -64,6 +105,9 @@ struct obs_output_info {
 
 	void *type_data;
 	void (*free_type_data)(void *type_data);
+
+	/* only needs to fill in the output specific values */
+	void (*get_stats)(void *data, struct obs_output_stats *stats);
 };
 
 EXPORT void obs_register_output_s(const struct obs_output_info *info,
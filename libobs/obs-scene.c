@@ -18,6 +18,7 @@
 
 #include "util/threading.h"
 #include "graphics/math-defs.h"
+#include "media-io/audio-math.h"
 #include "obs-scene.h"
 
 /* NOTE: For proper mutex lock order (preventing mutual cross-locks), never
@@ -565,6 +566,7 @@ static void set_visibility(struct obs_scene_item *item, bool vis)
 	item->user_visible = vis;
 
 	pthread_mutex_unlock(&item->actions_mutex);
+	obs_audio_tree_changed();
 }
 
 static void scene_load_item(struct obs_scene *scene, obs_data_t *item_data)
@@ -818,27 +820,16 @@ static inline bool apply_scene_item_volume(struct obs_scene_item *item,
 	return false;
 }
 
-static void mix_audio_with_buf(float *p_out, float *p_in, float *buf_in,
-		size_t pos, size_t count)
+static inline void mix_audio_with_buf(float *p_out, float *p_in,
+		float *buf_in, size_t pos, size_t count)
 {
-	register float *out = p_out;
-	register float *buf = buf_in + pos;
-	register float *in = p_in + pos;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++) * *(buf++);
+	audio_add_mul(p_out, p_in + pos, buf_in + pos, count);
 }
 
 static inline void mix_audio(float *p_out, float *p_in,
 		size_t pos, size_t count)
 {
-	register float *out = p_out;
-	register float *in = p_in + pos;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++);
+	audio_add(p_out, p_in + pos, count);
 }
 
 static bool scene_audio_render(void *data, uint64_t *ts_out,
@@ -1306,6 +1297,7 @@ obs_sceneitem_t *obs_scene_add(obs_scene_t *scene, obs_source_t *source)
 	}
 
 	full_unlock(scene);
+	obs_audio_tree_changed();
 
 	if (!scene->source->context.private)
 		init_hotkeys(scene, item, obs_source_get_name(source));
@@ -1380,6 +1372,7 @@ void obs_sceneitem_remove(obs_sceneitem_t *item)
 	detach_sceneitem(item);
 
 	full_unlock(scene);
+	obs_audio_tree_changed();
 
 	obs_sceneitem_release(item);
 }
@@ -19,7 +19,7 @@
 
 static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 {
-	struct obs_source_frame *next_frame = source->async_frames.array[0];
+	struct obs_source_frame *next_frame = async_frame_peek(source, 0);
 	struct obs_source_frame *prev_frame = NULL;
 	struct obs_source_frame *frame      = NULL;
 	uint64_t sys_offset = sys_time - source->last_sys_timestamp;
@@ -28,14 +28,14 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 	size_t idx = 1;
 
 	if ((source->flags & OBS_SOURCE_FLAG_UNBUFFERED) != 0) {
-		while (source->async_frames.num > 2) {
-			da_erase(source->async_frames, 0);
+		while (spsc_ring_size(&source->async_frames) > 2) {
+			spsc_ring_pop(&source->async_frames);
 			remove_async_frame(source, next_frame);
-			next_frame = source->async_frames.array[0];
+			next_frame = async_frame_peek(source, 0);
 		}
 
-		if (source->async_frames.num == 2)
-			source->async_frames.array[0]->prev_frame = true;
+		if (spsc_ring_size(&source->async_frames) == 2)
+			async_frame_peek(source, 0)->prev_frame = true;
 		source->deinterlace_offset = 0;
 		return true;
 	}
@@ -60,17 +60,18 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 			break;
 
 		if (prev_frame) {
-			da_erase(source->async_frames, 0);
+			spsc_ring_pop(&source->async_frames);
 			remove_async_frame(source, prev_frame);
 		}
 
-		if (source->async_frames.num <= 2) {
+		if (spsc_ring_size(&source->async_frames) <= 2) {
 			bool exit = true;
 
 			if (prev_frame) {
 				prev_frame->prev_frame = true;
 
-			} else if (!frame && source->async_frames.num == 2) {
+			} else if (!frame &&
+			           spsc_ring_size(&source->async_frames) == 2) {
 				exit = false;
 			}
 
@@ -87,7 +88,7 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 
 		prev_frame = frame;
 		frame = next_frame;
-		next_frame = source->async_frames.array[idx];
+		next_frame = async_frame_peek(source, idx);
 
 		/* more timestamp checking and compensating */
 		if ((next_frame->timestamp - frame_time) > MAX_TS_VAR) {
@@ -111,8 +112,8 @@ static inline bool first_frame(obs_source_t *s)
 	if (s->last_frame_ts)
 		return false;
 
-	if (s->async_frames.num >= 2)
-		s->async_frames.array[0]->prev_frame = true;
+	if (spsc_ring_size(&s->async_frames) >= 2)
+		async_frame_peek(s, 0)->prev_frame = true;
 	return true;
 }
 
@@ -127,7 +128,7 @@ static inline void deinterlace_get_closest_frames(obs_source_t *s,
 	const struct video_output_info *info;
 	uint64_t half_interval;
 
-	if (!s->async_frames.num)
+	if (!spsc_ring_size(&s->async_frames))
 		return;
 
 	info = video_output_get_info(obs->video.video);
@@ -138,15 +139,11 @@ static inline void deinterlace_get_closest_frames(obs_source_t *s,
 		uint64_t offset;
 
 		s->prev_async_frame = NULL;
-		s->cur_async_frame = s->async_frames.array[0];
-
-		da_erase(s->async_frames, 0);
+		s->cur_async_frame = spsc_ring_pop(&s->async_frames);
 
 		if (s->cur_async_frame->prev_frame) {
 			s->prev_async_frame = s->cur_async_frame;
-			s->cur_async_frame = s->async_frames.array[0];
-
-			da_erase(s->async_frames, 0);
+			s->cur_async_frame = spsc_ring_pop(&s->async_frames);
 
 			s->deinterlace_half_duration = (uint32_t)
 				((s->cur_async_frame->timestamp -
@@ -643,6 +643,8 @@ static void obs_transition_stop(obs_source_t *transition)
 	transition->transition_source_active[1] = false;
 	transition->transition_sources[0] = transition->transition_sources[1];
 	transition->transition_sources[1] = NULL;
+
+	obs_audio_tree_changed();
 }
 
 void obs_transition_video_render(obs_source_t *transition,
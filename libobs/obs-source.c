@@ -20,6 +20,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-math.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "callback/calldata.h"
@@ -29,6 +30,11 @@
 #include "obs.h"
 #include "obs-internal.h"
 
+#define DEFAULT_ASYNC_FRAMES 30
+
+/* every backlog policy keeps the queue at or below max_frames */
+#define ASYNC_RING_SIZE  OBS_ASYNC_BACKLOG_MAX_FRAMES
+
 static inline bool data_valid(const struct obs_source *source, const char *f)
 {
 	return obs_source_valid(source, f) && source->context.data;
@@ -69,6 +75,7 @@ static const char *source_signals[] = {
 	"void volume(ptr source, in out float volume)",
 	"void update_properties(ptr source)",
 	"void update_flags(ptr source, int flags)",
+	"void async_frames_dropped(ptr source, int count)",
 	"void audio_sync(ptr source, int out int offset)",
 	"void audio_mixers(ptr source, in out int mixers)",
 	"void filter_add(ptr source, ptr filter)",
@@ -142,6 +149,7 @@ bool obs_source_init(struct obs_source *source)
 	source->sync_offset = 0;
 	pthread_mutex_init_value(&source->filter_mutex);
 	pthread_mutex_init_value(&source->async_mutex);
+	pthread_mutex_init_value(&source->async_producer_mutex);
 	pthread_mutex_init_value(&source->audio_mutex);
 	pthread_mutex_init_value(&source->audio_buf_mutex);
 	pthread_mutex_init_value(&source->audio_cb_mutex);
@@ -162,10 +170,23 @@ bool obs_source_init(struct obs_source *source)
 		return false;
 	if (pthread_mutex_init(&source->async_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&source->async_producer_mutex, NULL) != 0)
+		return false;
 
 	if (is_audio_source(source) || is_composite_source(source))
 		allocate_audio_output_buffer(source);
 
+	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0) {
+		if (os_event_init(&source->async_space_event,
+					OS_EVENT_TYPE_AUTO) != 0)
+			return false;
+
+		spsc_ring_init(&source->async_frames, ASYNC_RING_SIZE);
+		spsc_ring_init(&source->async_free_frames, ASYNC_RING_SIZE);
+		source->async_backlog_policy = OBS_ASYNC_BACKLOG_DROP_OLDEST;
+		source->async_max_frames = DEFAULT_ASYNC_FRAMES;
+	}
+
 	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION) {
 		if (!obs_transition_init(source))
 			return false;
@@ -188,11 +209,13 @@ bool obs_source_init(struct obs_source *source)
 		obs->data.first_audio_source = source;
 
 		pthread_mutex_unlock(&obs->data.audio_sources_mutex);
+		obs_audio_tree_changed();
 	}
 
 	obs_context_data_insert(&source->context,
 			&obs->data.sources_mutex,
-			&obs->data.first_source);
+			&obs->data.first_source,
+			&obs->data.sources_index);
 	return true;
 }
 
@@ -463,6 +486,73 @@ static inline void obs_source_frame_decref(struct obs_source_frame *frame)
 static bool obs_source_filter_remove_refless(obs_source_t *source,
 		obs_source_t *filter);
 
+/* frees every pooled and queued frame; frames still held through
+ * obs_source_get_frame are freed when they are released */
+static void free_async_frames(obs_source_t *source)
+{
+	struct obs_source_frame *frame;
+
+	while ((frame = spsc_ring_pop(&source->async_frames)) != NULL)
+		obs_source_frame_decref(frame);
+	while ((frame = spsc_ring_pop(&source->async_free_frames)) != NULL)
+		obs_source_frame_decref(frame);
+
+	if (source->async_spare_frame)
+		obs_source_frame_decref(source->async_spare_frame);
+	if (source->cur_async_frame)
+		obs_source_frame_decref(source->cur_async_frame);
+	if (source->prev_async_frame)
+		obs_source_frame_decref(source->prev_async_frame);
+
+	source->async_spare_frame = NULL;
+	source->cur_async_frame   = NULL;
+	source->prev_async_frame  = NULL;
+}
+
+static void signal_async_frames_dropped(obs_source_t *source, long count)
+{
+	struct calldata data;
+	uint8_t stack[128];
+
+	calldata_init_fixed(&data, stack, sizeof(stack));
+	calldata_set_ptr(&data, "source", source);
+	calldata_set_int(&data, "count", count);
+
+	signal_handler_signal(source->context.signals, "async_frames_dropped",
+			&data);
+}
+
+/* returns the oldest queued frames to the pool until at most max_frames
+ * are left.  frames are only ever taken off the queue with async_mutex held,
+ * which keeps it single-consumer no matter which thread calls this.
+ * Returns the number of frames dropped. */
+static long drop_oldest_async_frames(obs_source_t *source, size_t max_frames)
+{
+	long dropped = 0;
+
+	while (spsc_ring_size(&source->async_frames) > max_frames) {
+		remove_async_frame(source, spsc_ring_pop(&source->async_frames));
+		dropped++;
+	}
+
+	if (dropped)
+		os_atomic_add_uint64(&source->async_frames_trimmed,
+				(uint64_t)dropped);
+	return dropped;
+}
+
+/* video thread: with OBS_ASYNC_BACKLOG_DROP_OLDEST, frames queued before
+ * the backlog depth was lowered are dropped here */
+static long trim_async_frames(obs_source_t *source)
+{
+	if (os_atomic_load_long(&source->async_backlog_policy) !=
+			OBS_ASYNC_BACKLOG_DROP_OLDEST)
+		return 0;
+
+	return drop_oldest_async_frames(source,
+			(size_t)os_atomic_load_long(&source->async_max_frames));
+}
+
 void obs_source_destroy(struct obs_source *source)
 {
 	size_t i;
@@ -505,8 +595,8 @@ void obs_source_destroy(struct obs_source *source)
 	obs_hotkey_unregister(source->push_to_mute_key);
 	obs_hotkey_pair_unregister(source->mute_unmute_key);
 
-	for (i = 0; i < source->async_cache.num; i++)
-		obs_source_frame_decref(source->async_cache.array[i].frame);
+	free_async_frames(source);
+	os_event_destroy(source->async_space_event);
 
 	gs_enter_context(obs->video.graphics);
 	if (source->async_texrender)
@@ -533,8 +623,8 @@ void obs_source_destroy(struct obs_source *source)
 
 	da_free(source->audio_actions);
 	da_free(source->audio_cb_list);
-	da_free(source->async_cache);
-	da_free(source->async_frames);
+	spsc_ring_free(&source->async_frames);
+	spsc_ring_free(&source->async_free_frames);
 	da_free(source->filters);
 	pthread_mutex_destroy(&source->filter_mutex);
 	pthread_mutex_destroy(&source->audio_actions_mutex);
@@ -542,6 +632,7 @@ void obs_source_destroy(struct obs_source *source)
 	pthread_mutex_destroy(&source->audio_cb_mutex);
 	pthread_mutex_destroy(&source->audio_mutex);
 	pthread_mutex_destroy(&source->async_mutex);
+	pthread_mutex_destroy(&source->async_producer_mutex);
 	obs_context_data_free(&source->context);
 
 	if (source->owns_info_id)
@@ -932,8 +1023,14 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 
 	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0) {
 		uint64_t sys_time = obs->video.video_time;
+		uint64_t lock_time = os_gettime_ns();
+		long dropped;
 
 		pthread_mutex_lock(&source->async_mutex);
+		os_atomic_add_uint64(&source->async_video_block_ns,
+				os_gettime_ns() - lock_time);
+
+		dropped = trim_async_frames(source);
 
 		if (deinterlacing_enabled(source)) {
 			deinterlace_process_last_frame(source, sys_time);
@@ -950,6 +1047,11 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 
 		source->last_sys_timestamp = sys_time;
 		pthread_mutex_unlock(&source->async_mutex);
+
+		if (os_atomic_load_bool(&source->async_capture_waiting))
+			os_event_signal(source->async_space_event);
+		if (dropped)
+			signal_async_frames_dropped(source, dropped);
 	}
 
 	if (source->defer_update)
@@ -2124,111 +2226,202 @@ static void copy_frame_data(struct obs_source_frame *dst,
 	}
 }
 
-static inline bool async_texture_changed(struct obs_source *source,
-		const struct obs_source_frame *frame)
+static inline bool frame_reusable(const struct obs_source_frame *frame,
+		enum video_format format, uint32_t width, uint32_t height)
+{
+	return frame->format == format &&
+	       frame->width  == width  &&
+	       frame->height == height;
+}
+
+#define MAX_UNUSED_FRAME_DURATION 5
+
+/* frees one spare frame allocation if spare frames have been sitting in the
+ * pool for a specific period of time */
+static void clean_cache(obs_source_t *source)
 {
-	enum convert_type prev, cur;
-	prev = get_convert_type(source->async_cache_format);
-	cur  = get_convert_type(frame->format);
+	struct obs_source_frame *frame;
 
-	return source->async_cache_width  != frame->width ||
-	       source->async_cache_height != frame->height ||
-	       prev != cur;
+	if (!spsc_ring_size(&source->async_free_frames)) {
+		source->async_idle_count = 0;
+		return;
+	}
+
+	if (++source->async_idle_count < MAX_UNUSED_FRAME_DURATION)
+		return;
+
+	frame = spsc_ring_pop(&source->async_free_frames);
+	if (frame)
+		obs_source_frame_decref(frame);
+	source->async_idle_count = 0;
 }
 
-static inline void free_async_cache(struct obs_source *source)
+/* capture thread: waits for the video thread to make room in the frame
+ * queue, returns false on timeout */
+static bool wait_for_queue_space(struct obs_source *source, size_t max_frames)
 {
-	for (size_t i = 0; i < source->async_cache.num; i++)
-		obs_source_frame_decref(source->async_cache.array[i].frame);
+	uint64_t timeout = (uint64_t)os_atomic_load_long(
+			&source->async_block_timeout_ms) * 1000000ULL;
+	uint64_t deadline = os_gettime_ns() + timeout;
+	bool success = true;
 
-	da_resize(source->async_cache, 0);
-	da_resize(source->async_frames, 0);
-	source->cur_async_frame = NULL;
-	source->prev_async_frame = NULL;
+	os_atomic_set_bool(&source->async_capture_waiting, true);
+
+	while (spsc_ring_size(&source->async_frames) >= max_frames) {
+		uint64_t now = os_gettime_ns();
+		if (now >= deadline) {
+			success = false;
+			break;
+		}
+
+		os_event_timedwait(source->async_space_event,
+				(unsigned long)((deadline - now + 999999) /
+					1000000));
+	}
+
+	os_atomic_set_bool(&source->async_capture_waiting, false);
+	return success;
 }
 
-#define MAX_UNUSED_FRAME_DURATION 5
+/* capture thread: drops the oldest queued frames to make room for one more */
+static void evict_oldest_frames(struct obs_source *source, size_t max_frames)
+{
+	long dropped;
 
-/* frees frame allocations if they haven't been used for a specific period
- * of time */
-static void clean_cache(obs_source_t *source)
+	pthread_mutex_lock(&source->async_mutex);
+	dropped = drop_oldest_async_frames(source, max_frames - 1);
+	pthread_mutex_unlock(&source->async_mutex);
+
+	if (dropped)
+		signal_async_frames_dropped(source, dropped);
+}
+
+/* capture thread: checks the backlog policy, returns false if the incoming
+ * frame should be dropped */
+static bool make_queue_space(struct obs_source *source)
 {
-	for (size_t i = source->async_cache.num; i > 0; i--) {
-		struct async_frame *af = &source->async_cache.array[i - 1];
-		if (!af->used) {
-			if (++af->unused_count == MAX_UNUSED_FRAME_DURATION) {
-				obs_source_frame_destroy(af->frame);
-				da_erase(source->async_cache, i - 1);
-			}
-		}
+	size_t max_frames =
+		(size_t)os_atomic_load_long(&source->async_max_frames);
+	size_t queued = spsc_ring_size(&source->async_frames);
+
+	if (queued < max_frames)
+		return true;
+
+	switch (os_atomic_load_long(&source->async_backlog_policy)) {
+	case OBS_ASYNC_BACKLOG_DROP_OLDEST:
+		evict_oldest_frames(source, max_frames);
+		return true;
+	case OBS_ASYNC_BACKLOG_BLOCK:
+		return wait_for_queue_space(source, max_frames);
 	}
+
+	return false;
 }
 
-#define MAX_ASYNC_FRAMES 30
+/* the producer side cannot push to the free ring, so a frame that is not
+ * queued is kept aside for the next request instead.  called with
+ * async_producer_mutex held */
+static void keep_spare_frame(struct obs_source *source,
+		struct obs_source_frame *frame)
+{
+	if (!source->async_spare_frame)
+		source->async_spare_frame = frame;
+	else
+		obs_source_frame_decref(frame);
+}
 
-static inline struct obs_source_frame *cache_video(struct obs_source *source,
-		const struct obs_source_frame *frame)
+/* returns an unused frame from the pool (or a newly allocated one) without
+ * taking any lock shared with the video thread, or NULL if the frame should
+ * be dropped according to the backlog policy.  called with
+ * async_producer_mutex held */
+static struct obs_source_frame *get_cached_frame(struct obs_source *source,
+		enum video_format format, uint32_t width, uint32_t height)
 {
 	struct obs_source_frame *new_frame = NULL;
 
-	pthread_mutex_lock(&source->async_mutex);
-
-	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
-		free_async_cache(source);
-		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
+	if (!make_queue_space(source))
 		return NULL;
-	}
 
-	if (async_texture_changed(source, frame)) {
-		free_async_cache(source);
-		source->async_cache_width  = frame->width;
-		source->async_cache_height = frame->height;
-		source->async_cache_format = frame->format;
-	}
+	new_frame = source->async_spare_frame;
+	source->async_spare_frame = NULL;
 
-	for (size_t i = 0; i < source->async_cache.num; i++) {
-		struct async_frame *af = &source->async_cache.array[i];
-		if (!af->used) {
-			new_frame = af->frame;
-			af->used = true;
-			af->unused_count = 0;
-			break;
-		}
+	if (!new_frame)
+		new_frame = spsc_ring_pop(&source->async_free_frames);
+
+	/* frames left over from a different format or size are freed as
+	 * they come back around */
+	while (new_frame && !frame_reusable(new_frame, format, width, height)) {
+		obs_source_frame_decref(new_frame);
+		new_frame = spsc_ring_pop(&source->async_free_frames);
 	}
 
 	clean_cache(source);
 
 	if (!new_frame) {
-		struct async_frame new_af;
-
-		new_frame = obs_source_frame_create(frame->format,
-				frame->width, frame->height);
-		new_af.frame = new_frame;
-		new_af.used = true;
-		new_af.unused_count = 0;
+		new_frame = obs_source_frame_create(format, width, height);
 		new_frame->refs = 1;
+	}
+
+	return new_frame;
+}
 
-		da_push_back(source->async_cache, &new_af);
+/* queues a filled frame for the video thread, returns false if the queue
+ * was full.  called with async_producer_mutex held */
+static bool queue_frame(struct obs_source *source,
+		struct obs_source_frame *frame)
+{
+	if (!spsc_ring_push(&source->async_frames, frame)) {
+		keep_spare_frame(source, frame);
+		return false;
 	}
 
-	os_atomic_inc_long(&new_frame->refs);
+	os_atomic_add_uint64(&source->async_frames_queued, 1);
+	source->async_active = true;
+	return true;
+}
 
-	pthread_mutex_unlock(&source->async_mutex);
+static void drop_incoming_frame(struct obs_source *source)
+{
+	os_atomic_add_uint64(&source->async_frames_dropped, 1);
+	signal_async_frames_dropped(source, 1);
+}
+
+static struct obs_source_frame *borrow_frame(struct obs_source *source,
+		enum video_format format, uint32_t width, uint32_t height)
+{
+	struct obs_source_frame *frame;
+	uint64_t start_time = os_gettime_ns();
 
-	copy_frame_data(new_frame, frame);
+	pthread_mutex_lock(&source->async_producer_mutex);
+	frame = get_cached_frame(source, format, width, height);
+	pthread_mutex_unlock(&source->async_producer_mutex);
 
-	if (os_atomic_dec_long(&new_frame->refs) == 0) {
-		obs_source_frame_destroy(new_frame);
-		new_frame = NULL;
-	}
+	os_atomic_add_uint64(&source->async_capture_block_ns,
+			os_gettime_ns() - start_time);
 
-	return new_frame;
+	if (!frame)
+		drop_incoming_frame(source);
+	return frame;
+}
+
+static void commit_frame(struct obs_source *source,
+		struct obs_source_frame *frame)
+{
+	bool queued;
+
+	pthread_mutex_lock(&source->async_producer_mutex);
+	queued = queue_frame(source, frame);
+	pthread_mutex_unlock(&source->async_producer_mutex);
+
+	if (!queued)
+		drop_incoming_frame(source);
 }
 
 void obs_source_output_video(obs_source_t *source,
 		const struct obs_source_frame *frame)
 {
+	struct obs_source_frame *output;
+
 	if (!obs_source_valid(source, "obs_source_output_video"))
 		return;
 
@@ -2237,19 +2430,110 @@ void obs_source_output_video(obs_source_t *source,
 		return;
 	}
 
-	struct obs_source_frame *output = !!frame ?
-		cache_video(source, frame) : NULL;
-
-	/* ------------------------------------------- */
+	output = borrow_frame(source, frame->format,
+			frame->width, frame->height);
 
 	if (output) {
-		pthread_mutex_lock(&source->async_mutex);
-		da_push_back(source->async_frames, &output);
-		pthread_mutex_unlock(&source->async_mutex);
-		source->async_active = true;
+		copy_frame_data(output, frame);
+		commit_frame(source, output);
 	}
 }
 
+struct obs_source_frame *obs_source_borrow_frame(obs_source_t *source,
+		enum video_format format, uint32_t width, uint32_t height)
+{
+	struct obs_source_frame *frame;
+
+	if (!obs_source_valid(source, "obs_source_borrow_frame"))
+		return NULL;
+
+	frame = borrow_frame(source, format, width, height);
+	if (frame)
+		frame->prev_frame = false;
+
+	return frame;
+}
+
+void obs_source_commit_frame(obs_source_t *source,
+		struct obs_source_frame *frame)
+{
+	if (!frame)
+		return;
+	if (!obs_source_valid(source, "obs_source_commit_frame"))
+		return;
+
+	commit_frame(source, frame);
+}
+
+void obs_source_discard_frame(obs_source_t *source,
+		struct obs_source_frame *frame)
+{
+	if (!frame)
+		return;
+	if (!obs_source_valid(source, "obs_source_discard_frame"))
+		return;
+
+	pthread_mutex_lock(&source->async_producer_mutex);
+	keep_spare_frame(source, frame);
+	pthread_mutex_unlock(&source->async_producer_mutex);
+}
+
+void obs_source_get_async_stats(const obs_source_t *source,
+		struct obs_source_async_stats *stats)
+{
+	if (!stats)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (!obs_source_valid(source, "obs_source_get_async_stats"))
+		return;
+
+	stats->frames_queued    =
+		os_atomic_load_uint64(&source->async_frames_queued);
+	stats->frames_dropped   =
+		os_atomic_load_uint64(&source->async_frames_dropped) +
+		os_atomic_load_uint64(&source->async_frames_trimmed);
+	stats->queue_depth      = spsc_ring_size(&source->async_frames);
+	stats->capture_block_ns =
+		os_atomic_load_uint64(&source->async_capture_block_ns);
+	stats->video_block_ns   =
+		os_atomic_load_uint64(&source->async_video_block_ns);
+}
+
+void obs_source_set_async_backlog(obs_source_t *source,
+		enum obs_async_backlog_policy policy, size_t max_frames,
+		uint32_t block_timeout_ms)
+{
+	if (!obs_source_valid(source, "obs_source_set_async_backlog"))
+		return;
+
+	if (max_frames < 1)
+		max_frames = 1;
+	else if (max_frames > OBS_ASYNC_BACKLOG_MAX_FRAMES)
+		max_frames = OBS_ASYNC_BACKLOG_MAX_FRAMES;
+
+	os_atomic_set_long(&source->async_max_frames, (long)max_frames);
+	os_atomic_set_long(&source->async_block_timeout_ms,
+			(long)block_timeout_ms);
+	os_atomic_set_long(&source->async_backlog_policy, (long)policy);
+}
+
+enum obs_async_backlog_policy obs_source_get_async_backlog(
+		const obs_source_t *source, size_t *max_frames,
+		uint32_t *block_timeout_ms)
+{
+	if (!obs_source_valid(source, "obs_source_get_async_backlog"))
+		return OBS_ASYNC_BACKLOG_DROP_OLDEST;
+
+	if (max_frames)
+		*max_frames = (size_t)source->async_max_frames;
+	if (block_timeout_ms)
+		*block_timeout_ms = (uint32_t)source->async_block_timeout_ms;
+
+	return (enum obs_async_backlog_policy)source->async_backlog_policy;
+}
+
 static inline struct obs_audio_data *filter_async_audio(obs_source_t *source,
 		struct obs_audio_data *in)
 {
@@ -2421,36 +2705,34 @@ void obs_source_output_audio(obs_source_t *source,
 	pthread_mutex_unlock(&source->filter_mutex);
 }
 
+/* returns a frame to the pool so the capture thread can reuse it.  must be
+ * called with async_mutex held, which keeps the free ring single-producer */
 void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame)
 {
-	if (frame)
-		frame->prev_frame = false;
+	if (!frame)
+		return;
 
-	for (size_t i = 0; i < source->async_cache.num; i++) {
-		struct async_frame *f = &source->async_cache.array[i];
+	frame->prev_frame = false;
 
-		if (f->frame == frame) {
-			f->used = false;
-			break;
-		}
-	}
+	if (!spsc_ring_push(&source->async_free_frames, frame))
+		obs_source_frame_decref(frame);
 }
 
 /* #define DEBUG_ASYNC_FRAMES 1 */
 
 static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 {
-	struct obs_source_frame *next_frame = source->async_frames.array[0];
+	struct obs_source_frame *next_frame = async_frame_peek(source, 0);
 	struct obs_source_frame *frame      = NULL;
 	uint64_t sys_offset = sys_time - source->last_sys_timestamp;
 	uint64_t frame_time = next_frame->timestamp;
 	uint64_t frame_offset = 0;
 
 	if ((source->flags & OBS_SOURCE_FLAG_UNBUFFERED) != 0) {
-		while (source->async_frames.num > 1) {
-			da_erase(source->async_frames, 0);
+		while (spsc_ring_size(&source->async_frames) > 1) {
+			spsc_ring_pop(&source->async_frames);
 			remove_async_frame(source, next_frame);
-			next_frame = source->async_frames.array[0];
+			next_frame = async_frame_peek(source, 0);
 		}
 
 		return true;
@@ -2462,7 +2744,7 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 			"number of frames: %lu",
 			source->last_frame_ts, frame_time, sys_offset,
 			frame_time - source->last_frame_ts,
-			(unsigned long)source->async_frames.num);
+			(unsigned long)spsc_ring_size(&source->async_frames));
 #endif
 
 	/* account for timestamp invalidation */
@@ -2487,7 +2769,7 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 			break;
 
 		if (frame)
-			da_erase(source->async_frames, 0);
+			spsc_ring_pop(&source->async_frames);
 
 #if DEBUG_ASYNC_FRAMES
 		blog(LOG_DEBUG, "new frame, "
@@ -2499,11 +2781,11 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 
 		remove_async_frame(source, frame);
 
-		if (source->async_frames.num == 1)
+		if (spsc_ring_size(&source->async_frames) == 1)
 			return true;
 
 		frame = next_frame;
-		next_frame = source->async_frames.array[1];
+		next_frame = async_frame_peek(source, 1);
 
 		/* more timestamp checking and compensating */
 		if ((next_frame->timestamp - frame_time) > MAX_TS_VAR) {
@@ -2529,12 +2811,12 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
 		uint64_t sys_time)
 {
-	if (!source->async_frames.num)
+	if (!spsc_ring_size(&source->async_frames))
 		return NULL;
 
 	if (!source->last_frame_ts || ready_async_frame(source, sys_time)) {
-		struct obs_source_frame *frame = source->async_frames.array[0];
-		da_erase(source->async_frames, 0);
+		struct obs_source_frame *frame =
+			spsc_ring_pop(&source->async_frames);
 
 		if (!source->last_frame_ts)
 			source->last_frame_ts = frame->timestamp;
@@ -3013,6 +3295,7 @@ bool obs_source_add_active_child(obs_source_t *parent, obs_source_t *child)
 		obs_source_activate(child, type);
 	}
 
+	obs_audio_tree_changed();
 	return true;
 }
 
@@ -3028,6 +3311,8 @@ void obs_source_remove_active_child(obs_source_t *parent, obs_source_t *child)
 		type = (i < parent->activate_refs) ? MAIN_VIEW : AUX_VIEW;
 		obs_source_deactivate(child, type);
 	}
+
+	obs_audio_tree_changed();
 }
 
 void obs_source_save(obs_source_t *source)
@@ -3492,24 +3777,16 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 static inline void multiply_output_audio(obs_source_t *source, size_t mix,
 		size_t channels, float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
-
-	while (out < end)
-		*(out++) *= vol;
+	audio_mul_scalar(source->audio_output_buf[mix][0], vol,
+			AUDIO_OUTPUT_FRAMES * channels);
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix,
 		size_t channels, float *vol_data)
 {
-	for (size_t ch = 0; ch < channels; ch++) {
-		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
-		register float *vol = vol_data;
-
-		while (out < end)
-			*(out++) *= *(vol++);
-	}
+	for (size_t ch = 0; ch < channels; ch++)
+		audio_mul(source->audio_output_buf[mix][ch], vol_data,
+				AUDIO_OUTPUT_FRAMES);
 }
 
 static inline void apply_audio_action(obs_source_t *source,
@@ -419,31 +419,61 @@ static void set_gpu_converted_data(struct obs_core_video *video,
 	}
 }
 
-static void convert_frame(
-		struct video_frame *output, const struct video_data *input,
-		const struct video_output_info *info)
+struct convert_frame_data {
+	struct video_frame              *output;
+	const struct video_data         *input;
+	const struct video_output_info  *info;
+};
+
+static void convert_frame_slice(void *param, uint32_t start_y, uint32_t end_y)
 {
-	if (info->format == VIDEO_FORMAT_I420) {
+	struct convert_frame_data *data   = param;
+	struct video_frame        *output = data->output;
+	const struct video_data   *input  = data->input;
+
+	if (data->info->format == VIDEO_FORMAT_I420) {
 		compress_uyvx_to_i420(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
-	} else if (info->format == VIDEO_FORMAT_NV12) {
+	} else if (data->info->format == VIDEO_FORMAT_NV12) {
 		compress_uyvx_to_nv12(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
-	} else if (info->format == VIDEO_FORMAT_I444) {
+	} else {
 		convert_uyvx_to_i444(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
+	}
+}
 
-	} else {
+/* slices must start on an even row for the 4:2:0 formats; a larger
+ * granularity also keeps small frames from being split pointlessly */
+#define CONVERT_SLICE_ROWS 64
+
+static void convert_frame(struct obs_core_video *video,
+		struct video_frame *output, const struct video_data *input,
+		const struct video_output_info *info)
+{
+	struct convert_frame_data data = {
+		.output = output,
+		.input  = input,
+		.info   = info
+	};
+
+	if (info->format != VIDEO_FORMAT_I420 &&
+	    info->format != VIDEO_FORMAT_NV12 &&
+	    info->format != VIDEO_FORMAT_I444) {
 		blog(LOG_ERROR, "convert_frame: unsupported texture format");
+		return;
 	}
+
+	slice_pool_run(video->convert_pool, convert_frame_slice, &data,
+			info->height, CONVERT_SLICE_ROWS);
 }
 
 static inline void copy_rgbx_frame(
@@ -482,7 +512,7 @@ static inline void output_video_data(struct obs_core_video *video,
 					input_frame, info);
 
 		} else if (format_is_yuv(info->format)) {
-			convert_frame(&output_frame, input_frame, info);
+			convert_frame(video, &output_frame, input_frame, info);
 		} else {
 			copy_rgbx_frame(&output_frame, input_frame, info);
 		}
@@ -384,6 +384,9 @@ static int obs_init_video(struct obs_video_info *ovi)
 
 	gs_leave_context();
 
+	if (!ovi->gpu_conversion)
+		video->convert_pool = slice_pool_create(0, "video conversion");
+
 	errorcode = pthread_create(&video->video_thread, NULL,
 			obs_video_thread, obs);
 	if (errorcode != 0)
@@ -416,6 +419,9 @@ static void obs_free_video(void)
 		video_output_close(video->video);
 		video->video = NULL;
 
+		slice_pool_destroy(video->convert_pool);
+		video->convert_pool = NULL;
+
 		if (!video->graphics)
 			return;
 
@@ -491,6 +497,7 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	/* TODO: sound subsystem */
 
 	audio->user_volume    = 1.0f;
+	audio->render_pool    = slice_pool_create(0, "audio render");
 
 	errorcode = audio_output_open(&audio->audio, ai);
 	if (errorcode == AUDIO_OUTPUT_SUCCESS)
@@ -509,9 +516,16 @@ static void obs_free_audio(void)
 	if (audio->audio)
 		audio_output_close(audio->audio);
 
+	slice_pool_destroy(audio->render_pool);
+
 	circlebuf_free(&audio->buffered_timestamps);
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
+	da_free(audio->render_leaves);
+
+	for (size_t i = 0; i < audio->cached_render_order.num; i++)
+		obs_weak_source_release(audio->cached_render_order.array[i]);
+	da_free(audio->cached_render_order);
 
 	memset(audio, 0, sizeof(struct obs_core_audio));
 }
@@ -596,6 +610,11 @@ static void obs_free_data(void)
 	pthread_mutex_destroy(&data->outputs_mutex);
 	pthread_mutex_destroy(&data->encoders_mutex);
 	pthread_mutex_destroy(&data->services_mutex);
+
+	bfree(data->sources_index.buckets);
+	bfree(data->outputs_index.buckets);
+	bfree(data->encoders_index.buckets);
+	bfree(data->services_index.buckets);
 }
 
 static const char *obs_signals[] = {
@@ -1275,21 +1294,48 @@ void obs_enum_services(bool (*enum_proc)(void*, obs_service_t*), void *param)
 			enum_proc, param);
 }
 
-static inline void *get_context_by_name(void *vfirst, const char *name,
-		pthread_mutex_t *mutex, void *(*addref)(void*))
+static inline uint32_t context_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static inline struct obs_context_data **context_index_bucket(
+		struct obs_context_index *index, uint32_t hash)
+{
+	return &index->buckets[hash & (index->num_buckets - 1)];
+}
+
+static inline void *get_context_by_name(struct obs_context_index *index,
+		const char *name, pthread_mutex_t *mutex,
+		void *(*addref)(void*))
 {
-	struct obs_context_data **first = vfirst;
-	struct obs_context_data *context;
+	struct obs_context_data *context = NULL;
+	uint32_t hash;
+
+	if (!name)
+		return NULL;
+
+	hash = context_name_hash(name);
 
 	pthread_mutex_lock(mutex);
 
-	context = *first;
+	if (index->num_buckets)
+		context = *context_index_bucket(index, hash);
+
 	while (context) {
-		if (!context->private && strcmp(context->name, name) == 0) {
+		if (context->name_hash == hash &&
+		    strcmp(context->name, name) == 0) {
 			context = addref(context);
 			break;
 		}
-		context = context->next;
+		context = context->hash_next;
 	}
 
 	pthread_mutex_unlock(mutex);
@@ -1324,28 +1370,28 @@ static inline void *obs_id_(void *data)
 obs_source_t *obs_get_source_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_source, name,
+	return get_context_by_name(&obs->data.sources_index, name,
 			&obs->data.sources_mutex, obs_source_addref_safe_);
 }
 
 obs_output_t *obs_get_output_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_output, name,
+	return get_context_by_name(&obs->data.outputs_index, name,
 			&obs->data.outputs_mutex, obs_output_addref_safe_);
 }
 
 obs_encoder_t *obs_get_encoder_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_encoder, name,
+	return get_context_by_name(&obs->data.encoders_index, name,
 			&obs->data.encoders_mutex, obs_encoder_addref_safe_);
 }
 
 obs_service_t *obs_get_service_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_service, name,
+	return get_context_by_name(&obs->data.services_index, name,
 			&obs->data.services_mutex, obs_service_addref_safe_);
 }
 
@@ -1760,8 +1806,83 @@ void obs_context_data_free(struct obs_context_data *context)
 	memset(context, 0, sizeof(*context));
 }
 
+#define CONTEXT_INDEX_MIN_BUCKETS 64
+
+static void context_index_link(struct obs_context_index *index,
+		struct obs_context_data *context)
+{
+	struct obs_context_data **pos =
+		context_index_bucket(index, context->name_hash);
+
+	/* new contexts go straight to the front, only renamed and rehashed
+	 * contexts walk the chain */
+	while (*pos && (*pos)->index_order > context->index_order)
+		pos = &(*pos)->hash_next;
+
+	context->hash_prev_next = pos;
+	context->hash_next      = *pos;
+	if (*pos)
+		(*pos)->hash_prev_next = &context->hash_next;
+	*pos = context;
+}
+
+static void context_index_grow(struct obs_context_index *index)
+{
+	struct obs_context_data **old_buckets = index->buckets;
+	size_t old_size = index->num_buckets;
+
+	index->num_buckets = old_size ?
+		old_size * 2 : CONTEXT_INDEX_MIN_BUCKETS;
+	index->buckets = bzalloc(sizeof(struct obs_context_data*) *
+			index->num_buckets);
+
+	for (size_t i = 0; i < old_size; i++) {
+		struct obs_context_data *context = old_buckets[i];
+
+		while (context) {
+			struct obs_context_data *next = context->hash_next;
+			context_index_link(index, context);
+			context = next;
+		}
+	}
+
+	bfree(old_buckets);
+}
+
+/* private contexts can never be found by name, so they are not indexed.
+ * must be called with the list mutex held */
+static void context_index_add(struct obs_context_data *context)
+{
+	struct obs_context_index *index = context->index;
+
+	if (!index || context->private || !context->name)
+		return;
+
+	if (index->num >= index->num_buckets)
+		context_index_grow(index);
+
+	context->name_hash = context_name_hash(context->name);
+	context_index_link(index, context);
+	index->num++;
+}
+
+static void context_index_remove(struct obs_context_data *context)
+{
+	if (!context->hash_prev_next)
+		return;
+
+	*context->hash_prev_next = context->hash_next;
+	if (context->hash_next)
+		context->hash_next->hash_prev_next = context->hash_prev_next;
+
+	context->hash_next      = NULL;
+	context->hash_prev_next = NULL;
+	context->index->num--;
+}
+
 void obs_context_data_insert(struct obs_context_data *context,
-		pthread_mutex_t *mutex, void *pfirst)
+		pthread_mutex_t *mutex, void *pfirst,
+		struct obs_context_index *index)
 {
 	struct obs_context_data **first = pfirst;
 
@@ -1777,6 +1898,11 @@ void obs_context_data_insert(struct obs_context_data *context,
 	*first              = context;
 	if (context->next)
 		context->next->prev_next = &context->next;
+
+	context->index = index;
+	if (index)
+		context->index_order = ++index->next_order;
+	context_index_add(context);
 	pthread_mutex_unlock(mutex);
 }
 
@@ -1788,6 +1914,9 @@ void obs_context_data_remove(struct obs_context_data *context)
 			*context->prev_next = context->next;
 		if (context->next)
 			context->next->prev_next = context->prev_next;
+
+		context_index_remove(context);
+		context->index = NULL;
 		pthread_mutex_unlock(context->mutex);
 
 		context->mutex = NULL;
@@ -1797,13 +1926,25 @@ void obs_context_data_remove(struct obs_context_data *context)
 void obs_context_data_setname(struct obs_context_data *context,
 		const char *name)
 {
+	pthread_mutex_t *mutex = context->mutex;
+
+	/* the list mutex protects the index, so it has to be locked first
+	 * to keep the lock order the same as lookups */
+	if (mutex)
+		pthread_mutex_lock(mutex);
 	pthread_mutex_lock(&context->rename_cache_mutex);
 
+	context_index_remove(context);
+
 	if (context->name)
 		da_push_back(context->rename_cache, &context->name);
 	context->name = dup_name(name, context->private);
 
+	context_index_add(context);
+
 	pthread_mutex_unlock(&context->rename_cache_mutex);
+	if (mutex)
+		pthread_mutex_unlock(mutex);
 }
 
 profiler_name_store_t *obs_get_profiler_name_store(void)
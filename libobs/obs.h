@@ -954,6 +954,74 @@ EXPORT void obs_source_draw(gs_texture_t *image, int x, int y,
 EXPORT void obs_source_output_video(obs_source_t *source,
 		const struct obs_source_frame *frame);
 
+/**
+ * Borrows a frame from the source's async frame pool so that video can be
+ * written into it directly instead of being copied by
+ * obs_source_output_video.  The planes are allocated for the given format
+ * and size.  Fill in the image data, timestamp and color information, then
+ * pass the frame to either obs_source_commit_frame or
+ * obs_source_discard_frame.
+ *
+ * Returns NULL if the source's frame queue is full and its backlog policy
+ * drops incoming frames, in which case the frame should be dropped.  With
+ * OBS_ASYNC_BACKLOG_BLOCK this may block until there is room.
+ *
+ * These functions and obs_source_output_video may be called from more than
+ * one thread; frames are queued in the order they are committed.
+ */
+EXPORT struct obs_source_frame *obs_source_borrow_frame(obs_source_t *source,
+		enum video_format format, uint32_t width, uint32_t height);
+
+/** Queues a frame obtained with obs_source_borrow_frame for display */
+EXPORT void obs_source_commit_frame(obs_source_t *source,
+		struct obs_source_frame *frame);
+
+/** Returns a borrowed frame to the pool without displaying it */
+EXPORT void obs_source_discard_frame(obs_source_t *source,
+		struct obs_source_frame *frame);
+
+struct obs_source_async_stats {
+	uint64_t frames_queued;
+	uint64_t frames_dropped;
+	size_t   queue_depth;
+
+	/** Total time the capture thread spent acquiring and queueing frames */
+	uint64_t capture_block_ns;
+
+	/** Total time the video thread spent waiting for the frame queue */
+	uint64_t video_block_ns;
+};
+
+/** Gets async video queue statistics for a source */
+EXPORT void obs_source_get_async_stats(const obs_source_t *source,
+		struct obs_source_async_stats *stats);
+
+enum obs_async_backlog_policy {
+	/** Discard the oldest queued frames to make room (default) */
+	OBS_ASYNC_BACKLOG_DROP_OLDEST,
+	/** Discard incoming frames while the queue is full */
+	OBS_ASYNC_BACKLOG_DROP_NEWEST,
+	/** Block the capture thread until there is room, up to a timeout,
+	 * then discard the incoming frame */
+	OBS_ASYNC_BACKLOG_BLOCK,
+};
+
+#define OBS_ASYNC_BACKLOG_MAX_FRAMES 64
+
+/**
+ * Sets how an async video source behaves when frames are output faster than
+ * they are displayed.  max_frames is the queue depth (1 to
+ * OBS_ASYNC_BACKLOG_MAX_FRAMES, default 30), and block_timeout_ms is only
+ * used with OBS_ASYNC_BACKLOG_BLOCK.  Frame buffers are kept pooled in every
+ * mode, and each drop emits the 'async_frames_dropped' signal.
+ */
+EXPORT void obs_source_set_async_backlog(obs_source_t *source,
+		enum obs_async_backlog_policy policy, size_t max_frames,
+		uint32_t block_timeout_ms);
+EXPORT enum obs_async_backlog_policy obs_source_get_async_backlog(
+		const obs_source_t *source, size_t *max_frames,
+		uint32_t *block_timeout_ms);
+
 /** Outputs audio data (always asynchronous) */
 EXPORT void obs_source_output_audio(obs_source_t *source,
 		const struct obs_source_audio *audio);
@@ -1441,6 +1509,13 @@ EXPORT uint64_t obs_output_get_total_bytes(const obs_output_t *output);
 EXPORT int obs_output_get_frames_dropped(const obs_output_t *output);
 EXPORT int obs_output_get_total_frames(const obs_output_t *output);
 
+/**
+ * Gets a snapshot of the output's statistics.  This only takes a few short
+ * locks, so it can be polled several times per second.
+ */
+EXPORT bool obs_output_get_stats(obs_output_t *output,
+		struct obs_output_stats *stats);
+
 /**
  * Sets the preferred scaled resolution for this output.  Set width and height
  * to 0 to disable scaling.
@@ -1644,6 +1719,13 @@ EXPORT audio_t *obs_encoder_audio(const obs_encoder_t *encoder);
 /** Returns true if encoder is active, false otherwise */
 EXPORT bool obs_encoder_active(const obs_encoder_t *encoder);
 
+/**
+ * Returns the number of active outputs that currently receive packets from
+ * this encoder.  Settings changed while more than one output uses it affect
+ * all of them.
+ */
+EXPORT size_t obs_encoder_get_active_output_count(obs_encoder_t *encoder);
+
 EXPORT void *obs_encoder_get_type_data(obs_encoder_t *encoder);
 
 EXPORT const char *obs_encoder_get_id(const obs_encoder_t *encoder);
@@ -1656,6 +1738,24 @@ EXPORT void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 
 EXPORT void obs_free_encoder_packet(struct encoder_packet *packet);
 
+/**
+ * Copies a packet's data into a new reference counted buffer.  dst and src
+ * may be the same packet.  The result must be freed with
+ * obs_encoder_packet_release.
+ */
+EXPORT void obs_encoder_packet_create_instance(struct encoder_packet *dst,
+		const struct encoder_packet *src);
+
+/**
+ * Adds a reference to the data of a packet created with
+ * obs_encoder_packet_create_instance instead of copying it.  Outputs with the
+ * OBS_OUTPUT_SHARED_PACKETS flag receive packets that are shared this way,
+ * other outputs receive a private copy.
+ */
+EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
+		struct encoder_packet *src);
+EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
+
 
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
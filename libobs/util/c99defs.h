@@ -33,6 +33,15 @@
 #define FORCE_INLINE inline __attribute__((always_inline))
 #endif
 
+/* Allows a single function to be compiled for an instruction set newer than
+ * the one the rest of the file targets.  Only call such functions after
+ * checking os_get_cpu_features(). */
+#ifdef _MSC_VER
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+
 #ifdef _MSC_VER
 
 #pragma warning (disable : 4996)
@@ -231,6 +231,25 @@ static inline void circlebuf_peek_back(struct circlebuf *cb, void *data,
 	}
 }
 
+/**
+ * Returns a pointer to the data at a byte offset from the front, or NULL if
+ * out of range.  Only valid when the buffer is only ever pushed and popped
+ * in units of the same size, so that no item wraps around the end.
+ */
+static inline void *circlebuf_data(struct circlebuf *cb, size_t idx)
+{
+	uint8_t *ptr = (uint8_t*)cb->data;
+	size_t offset = cb->start_pos + idx;
+
+	if (idx >= cb->size)
+		return NULL;
+
+	if (offset >= cb->capacity)
+		offset -= cb->capacity;
+
+	return ptr + offset;
+}
+
 static inline void circlebuf_pop_front(struct circlebuf *cb, void *data,
 		size_t size)
 {
@@ -76,6 +76,12 @@ void os_dlclose(void *module)
 		dlclose(module);
 }
 
+int os_get_logical_cores(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+}
+
 #if !defined(__APPLE__)
 
 struct os_cpu_usage_info {
@@ -136,6 +142,17 @@ bool os_sleepto_ns(uint64_t time_target)
 	if (time_target < current)
 		return false;
 
+#if !defined(__APPLE__)
+	/* os_gettime_ns uses CLOCK_MONOTONIC, so sleep until the target as an
+	 * absolute time.  a relative sleep would wake late by however long it
+	 * took to get from the clock read to the sleep call */
+	struct timespec req;
+	req.tv_sec = (time_t)(time_target/1000000000);
+	req.tv_nsec = (long)(time_target%1000000000);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req,
+				NULL) == EINTR);
+#else
 	time_target -= current;
 
 	struct timespec req, remain;
@@ -148,6 +165,7 @@ bool os_sleepto_ns(uint64_t time_target)
 		req = remain;
 		memset(&remain, 0, sizeof(remain));
 	}
+#endif
 
 	return true;
 }
@@ -120,6 +120,13 @@ void os_dlclose(void *module)
 	FreeLibrary(module);
 }
 
+int os_get_logical_cores(void)
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (int)si.dwNumberOfProcessors;
+}
+
 union time_data {
 	FILETIME           ft;
 	unsigned long long val;
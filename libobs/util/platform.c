@@ -25,6 +25,14 @@
 #include "utf8.h"
 #include "dstr.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#define CPU_X86
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#define CPU_X86
+#endif
+
 FILE *os_wfopen(const wchar_t *path, const char *mode)
 {
 	FILE *file = NULL;
@@ -634,6 +642,83 @@ int os_mkdirs(const char *dir)
 	return ret;
 }
 
+#ifdef CPU_X86
+static void get_cpuid(uint32_t leaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, (int)leaf, 0);
+	for (size_t i = 0; i < 4; i++)
+		regs[i] = (uint32_t)info[i];
+#else
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t get_xcr0(void)
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile (".byte 0x0f, 0x01, 0xd0" /* xgetbv */
+			: "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static uint32_t detect_cpu_features(void)
+{
+	uint32_t regs[4];
+	uint32_t max_leaf;
+	uint32_t features = 0;
+	bool     os_avx   = false;
+
+	get_cpuid(0, regs);
+	max_leaf = regs[0];
+	if (max_leaf < 1)
+		return 0;
+
+	get_cpuid(1, regs);
+	if (regs[3] & (1<<26))
+		features |= OS_CPU_SSE2;
+	if (regs[2] & (1<<9))
+		features |= OS_CPU_SSSE3;
+	if (regs[2] & (1<<19))
+		features |= OS_CPU_SSE41;
+
+	/* OSXSAVE + AVX, and the OS has to preserve xmm/ymm state */
+	if ((regs[2] & (1<<27)) && (regs[2] & (1<<28)))
+		os_avx = (get_xcr0() & 0x6) == 0x6;
+
+	if (os_avx) {
+		features |= OS_CPU_AVX;
+
+		if (max_leaf >= 7) {
+			get_cpuid(7, regs);
+			if (regs[1] & (1<<5))
+				features |= OS_CPU_AVX2;
+		}
+	}
+
+	return features;
+}
+#endif
+
+uint32_t os_get_cpu_features(void)
+{
+#ifdef CPU_X86
+	static volatile long features = -1;
+
+	if (features == -1)
+		features = (long)detect_cpu_features();
+
+	return (uint32_t)features;
+#else
+	return 0;
+#endif
+}
+
 const char *os_get_path_extension(const char *path)
 {
 	struct dstr temp;
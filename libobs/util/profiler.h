@@ -20,6 +20,15 @@ EXPORT void profile_register_root(const char *name,
 EXPORT void profile_start(const char *name);
 EXPORT void profile_end(const char *name);
 
+/**
+ * Records an already completed call (timestamps from os_gettime_ns) as if
+ * profile_start/profile_end had been called at those times.  Useful for
+ * measuring things that are not a scope on the current thread, such as how
+ * late a thread woke up relative to its deadline.
+ */
+EXPORT void profile_record(const char *name, uint64_t start_time,
+		uint64_t end_time);
+
 EXPORT void profile_reenable_thread(void);
 
 /* ------------------------------------------------------------------------- */
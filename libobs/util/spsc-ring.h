@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2013 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+
+#include "bmem.h"
+#include "threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bounded lock-free ring of pointers for exactly one producer thread and one
+ * consumer thread.  The producer only ever writes 'head' and the consumer
+ * only ever writes 'tail', so neither side has to wait on the other.
+ *
+ * push is producer-only; pop, peek and size are consumer-only (size may also
+ * be called by the producer, in which case it can only be an overestimate).
+ * NULL cannot be stored in the ring.
+ */
+
+struct spsc_ring {
+	void          **items;
+	size_t        capacity;
+
+	volatile long head;
+	volatile long tail;
+};
+
+/* capacity is rounded up to a power of two */
+static inline void spsc_ring_init(struct spsc_ring *ring, size_t capacity)
+{
+	size_t size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	memset(ring, 0, sizeof(struct spsc_ring));
+	ring->items    = (void**)bzalloc(sizeof(void*) * size);
+	ring->capacity = size;
+}
+
+static inline void spsc_ring_free(struct spsc_ring *ring)
+{
+	bfree(ring->items);
+	memset(ring, 0, sizeof(struct spsc_ring));
+}
+
+static inline size_t spsc_ring_size(const struct spsc_ring *ring)
+{
+	unsigned long head = (unsigned long)os_atomic_load_long(&ring->head);
+	unsigned long tail = (unsigned long)os_atomic_load_long(&ring->tail);
+	return (size_t)(head - tail);
+}
+
+static inline bool spsc_ring_push(struct spsc_ring *ring, void *item)
+{
+	unsigned long head = (unsigned long)ring->head;
+	unsigned long tail = (unsigned long)os_atomic_load_long(&ring->tail);
+
+	if ((size_t)(head - tail) >= ring->capacity)
+		return false;
+
+	ring->items[head & (ring->capacity - 1)] = item;
+
+	/* full barrier, publishes the item before the new head */
+	os_atomic_inc_long(&ring->head);
+	return true;
+}
+
+/* returns the item 'idx' places from the front, or NULL if there is none */
+static inline void *spsc_ring_peek(const struct spsc_ring *ring, size_t idx)
+{
+	unsigned long head = (unsigned long)os_atomic_load_long(&ring->head);
+	unsigned long tail = (unsigned long)ring->tail;
+
+	if (idx >= (size_t)(head - tail))
+		return NULL;
+
+	return ring->items[(tail + idx) & (ring->capacity - 1)];
+}
+
+static inline void *spsc_ring_pop(struct spsc_ring *ring)
+{
+	void *item = spsc_ring_peek(ring, 0);
+	if (item)
+		os_atomic_inc_long(&ring->tail);
+	return item;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -42,6 +42,22 @@ static inline bool os_atomic_compare_swap_long(volatile long *val,
 	return __sync_bool_compare_and_swap(val, old_val, new_val);
 }
 
+static inline uint64_t os_atomic_add_uint64(volatile uint64_t *val,
+		uint64_t add)
+{
+	return __atomic_add_fetch(val, add, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t os_atomic_load_uint64(const volatile uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline void os_atomic_fence_acquire(void)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
 static inline bool os_atomic_set_bool(volatile bool *ptr, bool val)
 {
 	return __sync_lock_test_and_set(ptr, val);
@@ -51,3 +67,13 @@ static inline bool os_atomic_load_bool(const volatile bool *ptr)
 {
 	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
 }
+
+static inline void *os_atomic_set_ptr(void *volatile *ptr, void *val)
+{
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline void *os_atomic_load_ptr(void *const volatile *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
@@ -44,6 +44,25 @@ static inline bool os_atomic_compare_swap_long(volatile long *val,
 	return _InterlockedCompareExchange(val, new_val, old_val) == old_val;
 }
 
+static inline uint64_t os_atomic_add_uint64(volatile uint64_t *val,
+		uint64_t add)
+{
+	return (uint64_t)_InterlockedExchangeAdd64((volatile __int64*)val,
+			(__int64)add) + add;
+}
+
+static inline uint64_t os_atomic_load_uint64(const volatile uint64_t *ptr)
+{
+	return (uint64_t)_InterlockedCompareExchange64((volatile __int64*)ptr,
+			0, 0);
+}
+
+static inline void os_atomic_fence_acquire(void)
+{
+	/* x86 does not reorder loads with other loads */
+	_ReadWriteBarrier();
+}
+
 static inline bool os_atomic_set_bool(volatile bool *ptr, bool val)
 {
 	return !!_InterlockedExchange8((volatile char*)ptr, (char)val);
@@ -53,3 +72,14 @@ static inline bool os_atomic_load_bool(const volatile bool *ptr)
 {
 	return !!_InterlockedOr8((volatile char*)ptr, 0);
 }
+
+static inline void *os_atomic_set_ptr(void *volatile *ptr, void *val)
+{
+	return _InterlockedExchangePointer(ptr, val);
+}
+
+static inline void *os_atomic_load_ptr(void *const volatile *ptr)
+{
+	return _InterlockedCompareExchangePointer((void *volatile*)ptr, NULL,
+			NULL);
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Optional shared memory transport between obs and ffmpeg-mux (linux only).
+ *
+ * Instead of writing packets to the child's stdin, obs writes the same
+ * ffm_packet_info + payload byte stream into a single producer/single
+ * consumer ring in a POSIX shared memory object.  The ring data is mapped
+ * twice back to back, so anything up to the ring capacity can always be
+ * accessed as one contiguous block, and the muxer can use packets in place.
+ *
+ * Each side only waits (with a futex) when the ring is empty or full, and
+ * the other side only makes a syscall to wake it up if it is waiting.
+ *
+ * stdin is kept open but unused while the transport is active, so that the
+ * muxer still sees EOF (and finishes the file) if obs goes away.
+ */
+
+#ifdef __linux__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define FFM_SHM_MAGIC       0x4d464653 /* "SFFM" */
+
+/* large enough for any page size, so the ring is always page aligned */
+#define FFM_SHM_HEADER_SIZE (64 * 1024)
+
+struct ffm_shm_header {
+	uint32_t          magic;
+	uint32_t          reserved;
+	uint64_t          capacity;
+	uint8_t           pad0[48];
+
+	/* written by obs */
+	volatile uint64_t write_pos;
+	volatile uint32_t data_seq;
+	volatile uint32_t reader_waiting;
+	volatile uint32_t writer_closed;
+	uint8_t           pad1[44];
+
+	/* written by ffmpeg-mux */
+	volatile uint64_t read_pos;
+	volatile uint32_t space_seq;
+	volatile uint32_t writer_waiting;
+	volatile uint32_t reader_attached;
+	volatile uint32_t reader_closed;
+
+	/* set instead of reader_attached if the muxer can't use the shared
+	 * memory; both sides then use the pipe */
+	volatile uint32_t reader_declined;
+};
+
+struct ffm_shm {
+	struct ffm_shm_header *header;
+	uint8_t               *data;
+	uint64_t              capacity;
+	size_t                map_size;
+};
+
+/* ------------------------------------------------------------------------- */
+
+static inline uint64_t ffm_load64(const volatile uint64_t *val)
+{
+	return __atomic_load_n(val, __ATOMIC_ACQUIRE);
+}
+
+static inline uint32_t ffm_load32(const volatile uint32_t *val)
+{
+	return __atomic_load_n(val, __ATOMIC_SEQ_CST);
+}
+
+static inline void ffm_futex_wait(volatile uint32_t *addr, uint32_t val,
+		int timeout_ms)
+{
+	struct timespec ts = {
+		.tv_sec  = timeout_ms / 1000,
+		.tv_nsec = (long)(timeout_ms % 1000) * 1000000
+	};
+
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static inline void ffm_futex_wake(volatile uint32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* bumps the sequence the other side waits on, and wakes it if it is
+ * waiting on it */
+static inline void ffm_shm_signal(volatile uint32_t *seq,
+		volatile uint32_t *waiting)
+{
+	__atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST))
+		ffm_futex_wake(seq);
+}
+
+/* 'seq' must have been loaded before the condition being waited on was
+ * checked, so that a signal in between is never missed */
+static inline void ffm_shm_wait(volatile uint32_t *seq,
+		volatile uint32_t *waiting, uint32_t prev_seq, int timeout_ms)
+{
+	__atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+	ffm_futex_wait(seq, prev_seq, timeout_ms);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* maps the header, then the ring data twice in a row after it */
+static inline bool ffm_shm_map(struct ffm_shm *shm, int fd, uint64_t capacity)
+{
+	size_t  map_size = FFM_SHM_HEADER_SIZE + (size_t)capacity * 2;
+	uint8_t *base;
+	void    *ptr;
+
+	base = mmap(NULL, map_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (base == MAP_FAILED)
+		return false;
+
+	ptr = mmap(base, FFM_SHM_HEADER_SIZE + (size_t)capacity,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+	if (ptr == MAP_FAILED)
+		goto fail;
+
+	ptr = mmap(base + FFM_SHM_HEADER_SIZE + capacity, (size_t)capacity,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+			FFM_SHM_HEADER_SIZE);
+	if (ptr == MAP_FAILED)
+		goto fail;
+
+	shm->header   = (struct ffm_shm_header*)base;
+	shm->data     = base + FFM_SHM_HEADER_SIZE;
+	shm->capacity = capacity;
+	shm->map_size = map_size;
+	return true;
+
+fail:
+	munmap(base, map_size);
+	return false;
+}
+
+static inline void ffm_shm_unmap(struct ffm_shm *shm)
+{
+	if (shm->header)
+		munmap(shm->header, shm->map_size);
+	memset(shm, 0, sizeof(*shm));
+}
+
+/* ------------------------------------------------------------------------- */
+/* producer (obs) */
+
+static inline uint64_t ffm_shm_free_space(const struct ffm_shm *shm)
+{
+	struct ffm_shm_header *h = shm->header;
+	return shm->capacity - (h->write_pos - ffm_load64(&h->read_pos));
+}
+
+static inline uint8_t *ffm_shm_write_ptr(const struct ffm_shm *shm)
+{
+	return shm->data + (shm->header->write_pos & (shm->capacity - 1));
+}
+
+static inline void ffm_shm_commit_write(struct ffm_shm *shm, uint64_t size)
+{
+	struct ffm_shm_header *h = shm->header;
+
+	__atomic_store_n(&h->write_pos, h->write_pos + size, __ATOMIC_RELEASE);
+	ffm_shm_signal(&h->data_seq, &h->reader_waiting);
+}
+
+/* ------------------------------------------------------------------------- */
+/* consumer (ffmpeg-mux) */
+
+static inline uint64_t ffm_shm_available(const struct ffm_shm *shm)
+{
+	struct ffm_shm_header *h = shm->header;
+	return ffm_load64(&h->write_pos) - h->read_pos;
+}
+
+static inline uint8_t *ffm_shm_read_ptr(const struct ffm_shm *shm)
+{
+	return shm->data + (shm->header->read_pos & (shm->capacity - 1));
+}
+
+static inline void ffm_shm_commit_read(struct ffm_shm *shm, uint64_t size)
+{
+	struct ffm_shm_header *h = shm->header;
+
+	__atomic_store_n(&h->read_pos, h->read_pos + size, __ATOMIC_RELEASE);
+	ffm_shm_signal(&h->space_seq, &h->writer_waiting);
+}
+
+#endif
@@ -27,6 +27,12 @@
 #include <stdlib.h>
 #include "ffmpeg-mux.h"
 
+#ifdef __linux__
+#include <poll.h>
+#include <sys/stat.h>
+#include "ffmpeg-mux-shm.h"
+#endif
+
 #include <libavformat/avformat.h>
 
 /* ------------------------------------------------------------------------- */
@@ -75,6 +81,7 @@ struct main_params {
 	int fps_den;
 	char *acodec;
 	char *muxer_settings;
+	char *shm_name;
 };
 
 struct audio_params {
@@ -100,6 +107,11 @@ struct ffmpeg_mux {
 	int                    num_audio_streams;
 	bool                   initialized;
 	char error[4096];
+
+#ifdef __linux__
+	struct ffm_shm         shm;
+	int                    shm_fd;
+#endif
 };
 
 static void header_free(struct header *header)
@@ -126,12 +138,20 @@ static void free_avformat(struct ffmpeg_mux *ffm)
 	ffm->num_audio_streams = 0;
 }
 
+#ifdef __linux__
+static void ffmpeg_mux_detach_shm(struct ffmpeg_mux *ffm);
+#endif
+
 static void ffmpeg_mux_free(struct ffmpeg_mux *ffm)
 {
 	if (ffm->initialized) {
 		av_write_trailer(ffm->output);
 	}
 
+#ifdef __linux__
+	ffmpeg_mux_detach_shm(ffm);
+#endif
+
 	free_avformat(ffm);
 
 	header_free(&ffm->video_header);
@@ -252,6 +272,10 @@ static bool init_params(int *argc, char ***argv, struct main_params *params,
 
 	get_opt_str(argc, argv, &params->muxer_settings, "muxer settings");
 
+	if (*argc)
+		get_opt_str(argc, argv, &params->shm_name,
+				"shared memory name");
+
 	return true;
 }
 
@@ -406,15 +430,152 @@ static size_t safe_read(void *vdata, size_t size)
 	return total;
 }
 
+/* ------------------------------------------------------------------------- */
+
+#ifdef __linux__
+#define SHM_WAIT_MS 100
+
+static bool ffmpeg_mux_attach_shm(struct ffmpeg_mux *ffm)
+{
+	struct flock lock = {
+		.l_type   = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_len    = 1
+	};
+	struct ffm_shm_header *header;
+	struct stat st;
+	int fd;
+
+	fd = shm_open(ffm->params.shm_name, O_RDWR, 0);
+	if (fd == -1) {
+		printf("Couldn't open shared memory '%s'\n",
+				ffm->params.shm_name);
+		return false;
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size <= FFM_SHM_HEADER_SIZE ||
+	    !ffm_shm_map(&ffm->shm, fd,
+		    (uint64_t)st.st_size - FFM_SHM_HEADER_SIZE)) {
+		printf("Couldn't map shared memory '%s'\n",
+				ffm->params.shm_name);
+		close(fd);
+		return false;
+	}
+
+	header = ffm->shm.header;
+	if (header->magic != FFM_SHM_MAGIC ||
+	    header->capacity != ffm->shm.capacity) {
+		printf("Invalid shared memory '%s'\n", ffm->params.shm_name);
+		ffm_shm_unmap(&ffm->shm);
+		close(fd);
+		return false;
+	}
+
+	/* held until this process exits (however it exits), which is how obs
+	 * can tell that the muxer is gone, so without it use the pipe */
+	if (fcntl(fd, F_SETLK, &lock) != 0) {
+		printf("Couldn't lock shared memory '%s', using the pipe\n",
+				ffm->params.shm_name);
+		__atomic_store_n(&header->reader_declined, 1, __ATOMIC_SEQ_CST);
+		ffm_shm_signal(&header->space_seq, &header->writer_waiting);
+		ffm_shm_unmap(&ffm->shm);
+		close(fd);
+		return true;
+	}
+
+	ffm->shm_fd = fd;
+
+	__atomic_store_n(&header->reader_attached, 1, __ATOMIC_SEQ_CST);
+	ffm_shm_signal(&header->space_seq, &header->writer_waiting);
+	return true;
+}
+
+static void ffmpeg_mux_detach_shm(struct ffmpeg_mux *ffm)
+{
+	struct ffm_shm_header *header = ffm->shm.header;
+
+	if (!header)
+		return;
+
+	__atomic_store_n(&header->reader_closed, 1, __ATOMIC_SEQ_CST);
+	ffm_shm_signal(&header->space_seq, &header->writer_waiting);
+
+	ffm_shm_unmap(&ffm->shm);
+	close(ffm->shm_fd);
+}
+
+/* obs keeps stdin open until it has closed the ring, so a hangup means obs
+ * itself is gone */
+static bool stdin_hung_up(void)
+{
+	struct pollfd fds = {.fd = STDIN_FILENO, .events = POLLIN};
+	return poll(&fds, 1, 0) > 0 && (fds.revents & (POLLHUP | POLLERR));
+}
+
+/* waits for at least 'size' bytes, returns false at the end of the stream */
+static bool shm_wait_data(struct ffmpeg_mux *ffm, uint64_t size)
+{
+	struct ffm_shm_header *header = ffm->shm.header;
+
+	for (;;) {
+		uint32_t seq = ffm_load32(&header->data_seq);
+
+		if (ffm_shm_available(&ffm->shm) >= size)
+			return true;
+		if (ffm_load32(&header->writer_closed))
+			return ffm_shm_available(&ffm->shm) >= size;
+		if (stdin_hung_up())
+			return false;
+
+		ffm_shm_wait(&header->data_seq, &header->reader_waiting, seq,
+				SHM_WAIT_MS);
+	}
+}
+
+static size_t shm_read(struct ffmpeg_mux *ffm, void *vdata, size_t size)
+{
+	uint8_t *data = vdata;
+	size_t  total = size;
+
+	while (size > 0) {
+		uint64_t chunk;
+
+		if (!shm_wait_data(ffm, 1))
+			return 0;
+
+		chunk = ffm_shm_available(&ffm->shm);
+		if (chunk > size)
+			chunk = size;
+
+		memcpy(data, ffm_shm_read_ptr(&ffm->shm), (size_t)chunk);
+		ffm_shm_commit_read(&ffm->shm, chunk);
+
+		size -= (size_t)chunk;
+		data += chunk;
+	}
+
+	return total;
+}
+#endif
+
+static size_t read_data(struct ffmpeg_mux *ffm, void *data, size_t size)
+{
+#ifdef __linux__
+	if (ffm->shm.header)
+		return shm_read(ffm, data, size);
+#endif
+	return safe_read(data, size);
+}
+
 static bool ffmpeg_mux_get_header(struct ffmpeg_mux *ffm)
 {
 	struct ffm_packet_info info = {0};
 
-	bool success = safe_read(&info, sizeof(info)) == sizeof(info);
+	bool success = read_data(ffm, &info, sizeof(info)) == sizeof(info);
 	if (success) {
 		uint8_t *data = malloc(info.size);
 
-		if (safe_read(data, info.size) == info.size) {
+		if (read_data(ffm, data, info.size) == info.size) {
 			ffmpeg_mux_header(ffm, data, &info);
 		} else {
 			success = false;
@@ -551,6 +712,16 @@ static int ffmpeg_mux_init_internal(struct ffmpeg_mux *ffm, int argc,
 			calloc(1, sizeof(struct header) * ffm->params.tracks);
 	}
 
+#ifdef __linux__
+	if (ffm->params.shm_name && !ffmpeg_mux_attach_shm(ffm))
+		return FFM_ERROR;
+#else
+	if (ffm->params.shm_name) {
+		puts("Shared memory transport is not supported");
+		return FFM_ERROR;
+	}
+#endif
+
 	av_register_all();
 
 	if (!ffmpeg_mux_get_extra_data(ffm))
@@ -628,6 +799,35 @@ static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
 	return av_interleaved_write_frame(ffm->output, &packet) >= 0;
 }
 
+#ifdef __linux__
+/* packets that fit in the ring are muxed straight out of it */
+static bool shm_mux_packets(struct ffmpeg_mux *ffm, struct resize_buf *rb)
+{
+	struct ffm_packet_info info = {0};
+
+	while (shm_read(ffm, &info, sizeof(info)) == sizeof(info)) {
+		if (info.size <= ffm->shm.capacity) {
+			if (!shm_wait_data(ffm, info.size))
+				return false;
+
+			ffmpeg_mux_packet(ffm, ffm_shm_read_ptr(&ffm->shm),
+					&info);
+			ffm_shm_commit_read(&ffm->shm, info.size);
+
+		} else {
+			resize_buf_resize(rb, info.size);
+
+			if (shm_read(ffm, rb->buf, info.size) != info.size)
+				return false;
+
+			ffmpeg_mux_packet(ffm, rb->buf, &info);
+		}
+	}
+
+	return true;
+}
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 #ifdef _WIN32
@@ -668,6 +868,11 @@ int main(int argc, char *argv[])
 		return ret;
 	}
 
+#ifdef __linux__
+	if (ffm.shm.header)
+		fail = !shm_mux_packets(&ffm, &rb);
+	else
+#endif
 	while (!fail && safe_read(&info, sizeof(info)) == sizeof(info)) {
 		resize_buf_resize(&rb, info.size);
 
@@ -17,11 +17,19 @@
 
 #include <obs-module.h>
 #include <obs-avc.h>
+#include <util/circlebuf.h>
 #include <util/dstr.h>
 #include <util/pipe.h>
+#include <util/platform.h>
+#include <util/profiler.h>
 #include <util/threading.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
 
+#ifdef __linux__
+#include <sys/stat.h>
+#include "ffmpeg-mux/ffmpeg-mux-shm.h"
+#endif
+
 #include <libavformat/avformat.h>
 
 #define do_log(level, format, ...) \
@@ -31,6 +39,30 @@
 #define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
 
+#define OPT_MAX_BUFFER_SIZE  "max_buffer_size"
+#define OPT_BUFFER_FULL      "buffer_full_policy"
+#define OPT_SHARED_MEMORY    "shared_memory"
+
+#ifdef __linux__
+#define SHM_SIZE                   (64 * 1024 * 1024)
+#define SHM_WAIT_MS                100
+#define SHM_ATTACH_TIMEOUT_NS      10000000000ULL
+#define SHM_ALIVE_CHECK_NS         1000000000ULL
+#endif
+
+/* what to do with new packets when the write queue is full because the
+ * muxer process or the disk can't keep up */
+enum buffer_full_policy {
+	BUFFER_FULL_DROP,
+	BUFFER_FULL_BLOCK,
+	BUFFER_FULL_STOP
+};
+
+struct queued_packet {
+	struct encoder_packet packet;
+	uint64_t              queued_ns;
+};
+
 struct ffmpeg_muxer {
 	obs_output_t      *output;
 	os_process_pipe_t *pipe;
@@ -40,6 +72,40 @@ struct ffmpeg_muxer {
 	volatile bool     active;
 	volatile bool     stopping;
 	volatile bool     capturing;
+
+	/* packets are written to the pipe from a separate thread so that a
+	 * stalled muxer process or disk never blocks the encoders */
+	pthread_mutex_t   write_mutex;
+	struct circlebuf  packets;
+	size_t            queued_bytes;
+	bool              end_of_stream;
+	bool              buffer_overflow;
+	pthread_t         write_thread;
+	bool              write_thread_active;
+	os_sem_t          *write_sem;
+	os_event_t        *space_event;
+
+	size_t            max_buffer_bytes;
+	enum buffer_full_policy policy;
+	bool              drop_until_keyframe;
+	int               dropped_frames;
+
+	/* write queue statistics */
+	size_t            peak_packets;
+	size_t            peak_bytes;
+	uint64_t          blocked_ns;
+	uint64_t          longest_write_ns;
+	volatile long     write_latency_usec;
+
+#ifdef __linux__
+	/* shared memory transport, only touched by the write thread once the
+	 * muxer process has been started */
+	struct ffm_shm    shm;
+	int               shm_fd;
+	struct dstr       shm_name;
+	bool              shm_unlinked;
+	uint64_t          shm_next_check_ns;
+#endif
 };
 
 static const char *ffmpeg_mux_getname(void *unused)
@@ -48,11 +114,54 @@ static const char *ffmpeg_mux_getname(void *unused)
 	return obs_module_text("FFmpegMuxer");
 }
 
+static void free_packets(struct ffmpeg_muxer *stream)
+{
+	while (stream->packets.size) {
+		struct queued_packet item;
+		circlebuf_pop_front(&stream->packets, &item, sizeof(item));
+		obs_encoder_packet_release(&item.packet);
+	}
+
+	stream->queued_bytes = 0;
+}
+
+static void end_write_thread(struct ffmpeg_muxer *stream)
+{
+	pthread_mutex_lock(&stream->write_mutex);
+	stream->end_of_stream = true;
+	os_atomic_set_bool(&stream->active, false);
+	pthread_mutex_unlock(&stream->write_mutex);
+
+	os_sem_post(stream->write_sem);
+}
+
+static inline void join_write_thread(struct ffmpeg_muxer *stream)
+{
+	if (stream->write_thread_active) {
+		pthread_join(stream->write_thread, NULL);
+		stream->write_thread_active = false;
+	}
+}
+
 static void ffmpeg_mux_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
+
+	if (stream->write_thread_active) {
+		end_write_thread(stream);
+		join_write_thread(stream);
+	}
+
 	os_process_pipe_destroy(stream->pipe);
+	free_packets(stream);
+	circlebuf_free(&stream->packets);
+	pthread_mutex_destroy(&stream->write_mutex);
+	os_sem_destroy(stream->write_sem);
+	os_event_destroy(stream->space_event);
 	dstr_free(&stream->path);
+#ifdef __linux__
+	dstr_free(&stream->shm_name);
+#endif
 	bfree(stream);
 }
 
@@ -61,8 +170,21 @@ static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
 
+	pthread_mutex_init_value(&stream->write_mutex);
+
+	if (pthread_mutex_init(&stream->write_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&stream->write_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&stream->space_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
 	UNUSED_PARAMETER(settings);
 	return stream;
+
+fail:
+	ffmpeg_mux_destroy(stream);
+	return NULL;
 }
 
 #ifdef _WIN32
@@ -213,33 +335,269 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd)
 	add_muxer_params(cmd, stream);
 }
 
+#ifdef __linux__
+static void destroy_shm(struct ffmpeg_muxer *stream)
+{
+	if (!stream->shm.header)
+		return;
+
+	ffm_shm_unmap(&stream->shm);
+	close(stream->shm_fd);
+
+	if (!stream->shm_unlinked)
+		shm_unlink(stream->shm_name.array);
+}
+
+static bool create_shm(struct ffmpeg_muxer *stream)
+{
+	static volatile long shm_id = 0;
+	struct ffm_shm_header *header;
+	int fd;
+
+	dstr_printf(&stream->shm_name, "/obs-ffmpeg-mux-%d-%ld",
+			(int)getpid(), os_atomic_inc_long(&shm_id));
+
+	fd = shm_open(stream->shm_name.array, O_RDWR | O_CREAT | O_EXCL,
+			0600);
+	if (fd == -1)
+		return false;
+
+	if (ftruncate(fd, FFM_SHM_HEADER_SIZE + SHM_SIZE) != 0 ||
+	    !ffm_shm_map(&stream->shm, fd, SHM_SIZE)) {
+		close(fd);
+		shm_unlink(stream->shm_name.array);
+		return false;
+	}
+
+	header = stream->shm.header;
+	header->magic    = FFM_SHM_MAGIC;
+	header->capacity = SHM_SIZE;
+
+	stream->shm_fd            = fd;
+	stream->shm_unlinked      = false;
+	stream->shm_next_check_ns = os_gettime_ns() + SHM_ATTACH_TIMEOUT_NS;
+	return true;
+}
+
+static void add_shm_param(struct ffmpeg_muxer *stream, struct dstr *cmd)
+{
+	if (!create_shm(stream)) {
+		warn("Failed to create shared memory, falling back to the "
+		     "pipe");
+		return;
+	}
+
+	dstr_catf(cmd, "\"%s\" ", stream->shm_name.array);
+	info("Using shared memory transport");
+}
+
+/* tells the muxer that there is nothing more to read */
+static void close_shm(struct ffmpeg_muxer *stream)
+{
+	struct ffm_shm_header *header = stream->shm.header;
+
+	if (header) {
+		__atomic_store_n(&header->writer_closed, 1, __ATOMIC_SEQ_CST);
+		ffm_shm_signal(&header->data_seq, &header->reader_waiting);
+	}
+}
+
+/* the muxer holds a lock on the shared memory for as long as it runs, so
+ * it is gone if the lock can be taken */
+static bool shm_reader_alive(struct ffmpeg_muxer *stream)
+{
+	struct ffm_shm_header *header = stream->shm.header;
+	struct flock lock = {
+		.l_type   = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_len    = 1
+	};
+
+	if (ffm_load32(&header->reader_closed))
+		return false;
+	if (!ffm_load32(&header->reader_attached))
+		return os_gettime_ns() < stream->shm_next_check_ns;
+	if (fcntl(stream->shm_fd, F_GETLK, &lock) != 0)
+		return true;
+
+	return lock.l_type != F_UNLCK;
+}
+
+static bool shm_wait_space(struct ffmpeg_muxer *stream, uint64_t size)
+{
+	struct ffm_shm_header *header = stream->shm.header;
+
+	for (;;) {
+		uint32_t seq = ffm_load32(&header->space_seq);
+
+		if (ffm_load32(&header->reader_attached) &&
+		    ffm_shm_free_space(&stream->shm) >= size)
+			return true;
+		if (ffm_load32(&header->reader_declined) ||
+		    !shm_reader_alive(stream))
+			return false;
+
+		ffm_shm_wait(&header->space_seq, &header->writer_waiting, seq,
+				SHM_WAIT_MS);
+	}
+}
+
+static bool shm_write(struct ffmpeg_muxer *stream, const void *vdata,
+		size_t size)
+{
+	const uint8_t *data = vdata;
+
+	while (size) {
+		uint64_t chunk;
+
+		if (!shm_wait_space(stream, 1))
+			return false;
+
+		chunk = ffm_shm_free_space(&stream->shm);
+		if (chunk > size)
+			chunk = size;
+
+		memcpy(ffm_shm_write_ptr(&stream->shm), data, (size_t)chunk);
+		ffm_shm_commit_write(&stream->shm, chunk);
+
+		data += chunk;
+		size -= (size_t)chunk;
+	}
+
+	return true;
+}
+
+static bool write_shm_packet(struct ffmpeg_muxer *stream,
+		const struct ffm_packet_info *info,
+		const struct encoder_packet *packet)
+{
+	size_t  total = sizeof(*info) + packet->size;
+	uint64_t ts   = os_gettime_ns();
+	uint8_t *ptr;
+
+	/* waiting for space notices if the muxer went away, but that might
+	 * never happen at low bitrates */
+	if (ts >= stream->shm_next_check_ns) {
+		if (!shm_reader_alive(stream))
+			return false;
+		stream->shm_next_check_ns = ts + SHM_ALIVE_CHECK_NS;
+	}
+
+	/* the name is only needed until the muxer has opened it */
+	if (!stream->shm_unlinked &&
+	    ffm_load32(&stream->shm.header->reader_attached)) {
+		shm_unlink(stream->shm_name.array);
+		stream->shm_unlinked = true;
+	}
+
+	if (total > stream->shm.capacity)
+		return shm_write(stream, info, sizeof(*info)) &&
+			shm_write(stream, packet->data, packet->size);
+
+	if (!shm_wait_space(stream, total))
+		return false;
+
+	ptr = ffm_shm_write_ptr(&stream->shm);
+	memcpy(ptr, info, sizeof(*info));
+	memcpy(ptr + sizeof(*info), packet->data, packet->size);
+	ffm_shm_commit_write(&stream->shm, total);
+	return true;
+}
+#endif
+
+static inline enum buffer_full_policy get_buffer_full_policy(
+		const char *policy)
+{
+	if (astrcmpi(policy, "block") == 0)
+		return BUFFER_FULL_BLOCK;
+	if (astrcmpi(policy, "stop") == 0)
+		return BUFFER_FULL_STOP;
+	return BUFFER_FULL_DROP;
+}
+
+static void reset_write_queue(struct ffmpeg_muxer *stream,
+		obs_data_t *settings)
+{
+	int max_mb = (int)obs_data_get_int(settings, OPT_MAX_BUFFER_SIZE);
+
+	stream->max_buffer_bytes = (size_t)(max_mb > 0 ? max_mb : 1) *
+		1024 * 1024;
+	stream->policy = get_buffer_full_policy(
+			obs_data_get_string(settings, OPT_BUFFER_FULL));
+
+	stream->end_of_stream       = false;
+	stream->buffer_overflow     = false;
+	stream->drop_until_keyframe = false;
+	stream->dropped_frames      = 0;
+	stream->peak_packets        = 0;
+	stream->peak_bytes          = 0;
+	stream->blocked_ns          = 0;
+	stream->longest_write_ns    = 0;
+	os_atomic_set_long(&stream->write_latency_usec, 0);
+}
+
+static void *write_thread(void *data);
+
 static bool ffmpeg_mux_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
 	obs_data_t *settings;
 	struct dstr cmd;
 	const char *path;
+	bool use_shm;
 
 	if (!obs_output_can_begin_data_capture(stream->output, 0))
 		return false;
 	if (!obs_output_initialize_encoders(stream->output, 0))
 		return false;
 
+	/* the previous recording's write thread has already finished (or is
+	 * just about to) by the time the output can be started again */
+	join_write_thread(stream);
+
 	settings = obs_output_get_settings(stream->output);
 	path = obs_data_get_string(settings, "path");
 	dstr_copy(&stream->path, path);
 	dstr_replace(&stream->path, "\"", "\"\"");
+	reset_write_queue(stream, settings);
+	use_shm = obs_data_get_bool(settings, OPT_SHARED_MEMORY);
 	obs_data_release(settings);
 
 	build_command_line(stream, &cmd);
+#ifdef __linux__
+	if (use_shm)
+		add_shm_param(stream, &cmd);
+#else
+	UNUSED_PARAMETER(use_shm);
+#endif
 	stream->pipe = os_process_pipe_create(cmd.array, "w");
 	dstr_free(&cmd);
 
 	if (!stream->pipe) {
 		warn("Failed to create process pipe");
+#ifdef __linux__
+		destroy_shm(stream);
+#endif
 		return false;
 	}
 
+	if (pthread_create(&stream->write_thread, NULL, write_thread,
+				stream) != 0) {
+		warn("Failed to create write thread");
+#ifdef __linux__
+		close_shm(stream);
+#endif
+		os_process_pipe_destroy(stream->pipe);
+		stream->pipe = NULL;
+#ifdef __linux__
+		destroy_shm(stream);
+#endif
+		return false;
+	}
+
+	stream->write_thread_active = true;
+	stream->sent_headers = false;
+
 	/* write headers and start capture */
 	os_atomic_set_bool(&stream->active, true);
 	os_atomic_set_bool(&stream->capturing, true);
@@ -249,17 +607,33 @@ static bool ffmpeg_mux_start(void *data)
 	return true;
 }
 
+static void log_write_stats(struct ffmpeg_muxer *stream)
+{
+	info("Write queue: peak of %d packets (%.1f MB), longest pipe write "
+	     "%d ms, encoders blocked for %d ms, %d frames dropped",
+			(int)stream->peak_packets,
+			(double)stream->peak_bytes / (1024.0 * 1024.0),
+			(int)(stream->longest_write_ns / 1000000),
+			(int)(stream->blocked_ns / 1000000),
+			stream->dropped_frames);
+}
+
+/* called from the write thread once it has stopped writing */
 static int deactivate(struct ffmpeg_muxer *stream)
 {
 	int ret = -1;
 
-	if (active(stream)) {
+	if (stream->pipe) {
+#ifdef __linux__
+		close_shm(stream);
+#endif
 		ret = os_process_pipe_destroy(stream->pipe);
 		stream->pipe = NULL;
+#ifdef __linux__
+		destroy_shm(stream);
+#endif
 
-		os_atomic_set_bool(&stream->active, false);
-		os_atomic_set_bool(&stream->sent_headers, false);
-
+		log_write_stats(stream);
 		info("Output of file '%s' stopped", stream->path.array);
 	}
 
@@ -281,9 +655,8 @@ static void ffmpeg_mux_stop(void *data, uint64_t ts)
 	}
 }
 
-static void signal_failure(struct ffmpeg_muxer *stream)
+static void signal_failure(struct ffmpeg_muxer *stream, int ret)
 {
-	int ret = deactivate(stream);
 	int code;
 
 	switch (ret) {
@@ -295,11 +668,37 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 	os_atomic_set_bool(&stream->capturing, false);
 }
 
+static bool write_pipe_packet(struct ffmpeg_muxer *stream,
+		const struct ffm_packet_info *info,
+		const struct encoder_packet *packet)
+{
+	size_t ret;
+
+	ret = os_process_pipe_write(stream->pipe, (const uint8_t*)info,
+			sizeof(*info));
+	if (ret != sizeof(*info)) {
+		warn("os_process_pipe_write for info structure failed");
+		return false;
+	}
+
+	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
+	if (ret != packet->size) {
+		warn("os_process_pipe_write for packet data failed");
+		return false;
+	}
+
+	return true;
+}
+
 static bool write_packet(struct ffmpeg_muxer *stream,
-		struct encoder_packet *packet)
+		struct queued_packet *item)
 {
+	struct encoder_packet *packet = &item->packet;
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
-	size_t ret;
+	uint64_t start_time = os_gettime_ns();
+	uint64_t end_time;
+	long latency_usec;
+	long prev_usec;
 
 	struct ffm_packet_info info = {
 		.pts = packet->pts,
@@ -310,22 +709,209 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 		.keyframe = packet->keyframe
 	};
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t*)&info,
-			sizeof(info));
-	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
+#ifdef __linux__
+	/* the muxer declines before anything has been written, so the
+	 * packet can still go through the pipe */
+	if (stream->shm.header && !write_shm_packet(stream, &info, packet)) {
+		if (!ffm_load32(&stream->shm.header->reader_declined)) {
+			warn("Failed to write packet to shared memory, the "
+			     "muxer process has stopped");
+			return false;
+		}
+
+		warn("The muxer can't use shared memory, using the pipe");
+		destroy_shm(stream);
+	}
+
+	if (!stream->shm.header &&
+	    !write_pipe_packet(stream, &info, packet))
+		return false;
+#else
+	if (!write_pipe_packet(stream, &info, packet))
 		return false;
+#endif
+
+	end_time = os_gettime_ns();
+	profile_record("ffmpeg_mux: pipe write", start_time, end_time);
+
+	if (end_time - start_time > stream->longest_write_ns)
+		stream->longest_write_ns = end_time - start_time;
+
+	latency_usec = (long)((end_time - item->queued_ns) / 1000);
+	prev_usec = os_atomic_load_long(&stream->write_latency_usec);
+	os_atomic_set_long(&stream->write_latency_usec, prev_usec ?
+			prev_usec + (latency_usec - prev_usec) / 8 :
+			latency_usec);
+	return true;
+}
+
+static void *write_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	bool success = true;
+	int ret;
+
+	os_set_thread_name("ffmpeg-mux: write_thread");
+
+	while (os_sem_wait(stream->write_sem) == 0) {
+		struct queued_packet item;
+		bool have_packet = false;
+		bool end;
+
+		pthread_mutex_lock(&stream->write_mutex);
+		if (stream->packets.size) {
+			circlebuf_pop_front(&stream->packets, &item,
+					sizeof(item));
+			stream->queued_bytes -= item.packet.size;
+			have_packet = true;
+		}
+		end = !have_packet && stream->end_of_stream;
+		pthread_mutex_unlock(&stream->write_mutex);
+
+		if (end)
+			break;
+		if (!have_packet)
+			continue;
+
+		if (stream->policy == BUFFER_FULL_BLOCK)
+			os_event_signal(stream->space_event);
+
+		success = write_packet(stream, &item);
+		obs_encoder_packet_release(&item.packet);
+
+		if (!success)
+			break;
 	}
 
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
-	if (ret != packet->size) {
-		warn("os_process_pipe_write for packet data failed");
-		signal_failure(stream);
+	/* stop accepting packets and wake up anything waiting for space */
+	pthread_mutex_lock(&stream->write_mutex);
+	os_atomic_set_bool(&stream->active, false);
+	free_packets(stream);
+	pthread_mutex_unlock(&stream->write_mutex);
+	os_event_signal(stream->space_event);
+
+	ret = deactivate(stream);
+
+	if (!success)
+		signal_failure(stream, ret);
+	else if (stream->buffer_overflow)
+		signal_failure(stream, -1);
+
+	return NULL;
+}
+
+static inline bool buffer_full(struct ffmpeg_muxer *stream, size_t size)
+{
+	return stream->packets.size &&
+		stream->queued_bytes + size > stream->max_buffer_bytes;
+}
+
+/* called with write_mutex held; returns false if the packet should not be
+ * queued */
+static bool apply_buffer_policy(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	bool is_video = packet->type == OBS_ENCODER_VIDEO;
+	uint64_t start_time;
+
+	switch (stream->policy) {
+	case BUFFER_FULL_BLOCK:
+		if (!buffer_full(stream, packet->size))
+			return true;
+
+		start_time = os_gettime_ns();
+		while (active(stream) && buffer_full(stream, packet->size)) {
+			pthread_mutex_unlock(&stream->write_mutex);
+			os_event_wait(stream->space_event);
+			pthread_mutex_lock(&stream->write_mutex);
+		}
+		stream->blocked_ns += os_gettime_ns() - start_time;
+		return active(stream);
+
+	case BUFFER_FULL_STOP:
+		if (!buffer_full(stream, packet->size))
+			return true;
+
+		warn("Write buffer is full, stopping output");
+		stream->buffer_overflow = true;
+		stream->end_of_stream = true;
+		os_atomic_set_bool(&stream->active, false);
+		os_sem_post(stream->write_sem);
 		return false;
+
+	case BUFFER_FULL_DROP:
+		break;
 	}
 
-	return true;
+	/* audio is small and dropping it would leave gaps in the file, so it
+	 * is always kept, as are keyframes.  like rtmp-stream, only the video
+	 * frames that depend on a keyframe are dropped, and once one has been
+	 * dropped, the rest up to the next keyframe have to be dropped too */
+	if (!is_video)
+		return true;
+
+	if (stream->drop_until_keyframe) {
+		if (packet->keyframe && !buffer_full(stream, packet->size)) {
+			info("Write buffer has drained, no longer dropping "
+			     "frames");
+			stream->drop_until_keyframe = false;
+			return true;
+		}
+
+	} else if (buffer_full(stream, packet->size)) {
+		warn("Write buffer is full, dropping video frames until the "
+		     "next keyframe");
+		stream->drop_until_keyframe = true;
+
+	} else {
+		return true;
+	}
+
+	if (packet->keyframe)
+		return true;
+
+	stream->dropped_frames++;
+	return false;
+}
+
+static bool queue_packet(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet, bool is_header)
+{
+	struct queued_packet item;
+	bool queued;
+
+	/* headers point to encoder extra data, everything else is already
+	 * shared by the output */
+	if (is_header)
+		obs_encoder_packet_create_instance(&item.packet, packet);
+	else
+		obs_encoder_packet_ref(&item.packet, packet);
+	item.queued_ns = os_gettime_ns();
+
+	pthread_mutex_lock(&stream->write_mutex);
+
+	queued = active(stream) &&
+		(is_header || apply_buffer_policy(stream, packet));
+
+	if (queued) {
+		circlebuf_push_back(&stream->packets, &item, sizeof(item));
+		stream->queued_bytes += packet->size;
+
+		if (stream->packets.size / sizeof(item) > stream->peak_packets)
+			stream->peak_packets =
+				stream->packets.size / sizeof(item);
+		if (stream->queued_bytes > stream->peak_bytes)
+			stream->peak_bytes = stream->queued_bytes;
+	}
+
+	pthread_mutex_unlock(&stream->write_mutex);
+
+	if (queued)
+		os_sem_post(stream->write_sem);
+	else
+		obs_encoder_packet_release(&item.packet);
+
+	return queued;
 }
 
 static bool send_audio_headers(struct ffmpeg_muxer *stream,
@@ -338,7 +924,7 @@ static bool send_audio_headers(struct ffmpeg_muxer *stream,
 	};
 
 	obs_encoder_get_extra_data(aencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return queue_packet(stream, &packet, true);
 }
 
 static bool send_video_headers(struct ffmpeg_muxer *stream)
@@ -351,7 +937,7 @@ static bool send_video_headers(struct ffmpeg_muxer *stream)
 	};
 
 	obs_encoder_get_extra_data(vencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return queue_packet(stream, &packet, true);
 }
 
 static bool send_headers(struct ffmpeg_muxer *stream)
@@ -391,12 +977,19 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 
 	if (stopping(stream)) {
 		if (packet->sys_dts_usec >= stream->stop_ts) {
-			deactivate(stream);
+			end_write_thread(stream);
 			return;
 		}
 	}
 
-	write_packet(stream, packet);
+	queue_packet(stream, packet, false);
+}
+
+static void ffmpeg_mux_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_MAX_BUFFER_SIZE, 128);
+	obs_data_set_default_string(defaults, OPT_BUFFER_FULL, "drop");
+	obs_data_set_default_bool(defaults, OPT_SHARED_MEMORY, false);
 }
 
 static obs_properties_t *ffmpeg_mux_properties(void *unused)
@@ -405,22 +998,71 @@ static obs_properties_t *ffmpeg_mux_properties(void *unused)
 
 	obs_properties_t *props = obs_properties_create();
 
+	obs_property_t *p;
+
 	obs_properties_add_text(props, "path",
 			obs_module_text("FilePath"),
 			OBS_TEXT_DEFAULT);
+
+	obs_properties_add_int(props, OPT_MAX_BUFFER_SIZE,
+			obs_module_text("MaxBufferSize"), 1, 4096, 1);
+
+	p = obs_properties_add_list(props, OPT_BUFFER_FULL,
+			obs_module_text("BufferFullPolicy"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(p,
+			obs_module_text("BufferFullPolicy.Drop"), "drop");
+	obs_property_list_add_string(p,
+			obs_module_text("BufferFullPolicy.Block"), "block");
+	obs_property_list_add_string(p,
+			obs_module_text("BufferFullPolicy.Stop"), "stop");
+
+#ifdef __linux__
+	obs_properties_add_bool(props, OPT_SHARED_MEMORY,
+			obs_module_text("SharedMemoryTransport"));
+#endif
 	return props;
 }
 
+static int ffmpeg_mux_dropped_frames(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	return stream->dropped_frames;
+}
+
+static void ffmpeg_mux_get_stats(void *data, struct obs_output_stats *stats)
+{
+	struct ffmpeg_muxer *stream = data;
+	size_t queued_bytes;
+
+	pthread_mutex_lock(&stream->write_mutex);
+	queued_bytes = stream->queued_bytes;
+	pthread_mutex_unlock(&stream->write_mutex);
+
+	if (stream->max_buffer_bytes) {
+		float congestion = (float)queued_bytes /
+			(float)stream->max_buffer_bytes;
+		stats->congestion = congestion < 1.0f ? congestion : 1.0f;
+	}
+
+	stats->send_latency_ms = (double)os_atomic_load_long(
+			&stream->write_latency_usec) / 1000.0;
+}
+
 struct obs_output_info ffmpeg_muxer = {
-	.id             = "ffmpeg_muxer",
-	.flags          = OBS_OUTPUT_AV |
-	                  OBS_OUTPUT_ENCODED |
-	                  OBS_OUTPUT_MULTI_TRACK,
-	.get_name       = ffmpeg_mux_getname,
-	.create         = ffmpeg_mux_create,
-	.destroy        = ffmpeg_mux_destroy,
-	.start          = ffmpeg_mux_start,
-	.stop           = ffmpeg_mux_stop,
-	.encoded_packet = ffmpeg_mux_data,
-	.get_properties = ffmpeg_mux_properties
+	.id                 = "ffmpeg_muxer",
+	.flags              = OBS_OUTPUT_AV |
+	                      OBS_OUTPUT_ENCODED |
+	                      OBS_OUTPUT_MULTI_TRACK |
+	                      OBS_OUTPUT_SHARED_PACKETS,
+	.get_name           = ffmpeg_mux_getname,
+	.create             = ffmpeg_mux_create,
+	.destroy            = ffmpeg_mux_destroy,
+	.start              = ffmpeg_mux_start,
+	.stop               = ffmpeg_mux_stop,
+	.encoded_packet     = ffmpeg_mux_data,
+	.get_defaults       = ffmpeg_mux_defaults,
+	.get_properties     = ffmpeg_mux_properties,
+	.get_dropped_frames = ffmpeg_mux_dropped_frames,
+	.get_stats          = ffmpeg_mux_get_stats
 };
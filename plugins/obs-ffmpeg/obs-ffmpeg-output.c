@@ -17,12 +17,14 @@
 
 #include <obs-module.h>
 #include <util/circlebuf.h>
+#include <util/spsc-ring.h>
 #include <util/threading.h>
 #include <util/dstr.h>
-#include <util/darray.h>
 #include <util/platform.h>
+#include <util/profiler.h>
 
 #include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
 #include <libavformat/avformat.h>
 #include <libswscale/swscale.h>
 
@@ -81,6 +83,24 @@ struct ffmpeg_data {
 	bool               initialized;
 };
 
+#define OPT_DROP_THRESHOLD "drop_threshold_ms"
+
+struct queued_packet {
+	AVPacket           packet;
+	uint64_t           sys_dts;
+	uint64_t           queued_ns;
+	uint64_t           seq;
+};
+
+/* raw frames waiting for the encode thread; if they are all in use, new
+ * frames are skipped rather than stalling the video thread */
+#define MAX_QUEUED_FRAMES 3
+
+struct queued_frame {
+	AVPicture          picture;
+	int64_t            pts;
+};
+
 struct ffmpeg_output {
 	obs_output_t       *output;
 	volatile bool      active;
@@ -100,7 +120,32 @@ struct ffmpeg_output {
 	os_sem_t           *write_sem;
 	os_event_t         *stop_event;
 
-	DARRAY(AVPacket)   packets;
+	struct circlebuf   packets;
+	uint64_t           next_seq;
+	uint64_t           last_sys_dts;
+
+	/* conversion and encoding of raw video */
+	bool               encode_thread_active;
+	pthread_t          encode_thread;
+	os_sem_t           *encode_sem;
+	volatile bool      encode_stopping;
+	struct queued_frame frames[MAX_QUEUED_FRAMES];
+	struct spsc_ring   ready_frames;
+	struct spsc_ring   free_frames;
+	volatile long      lagged_frames;
+	volatile long      encode_latency_usec;
+
+	/* frame dropping, only used when writing to a network url */
+	uint64_t           drop_threshold_ns;
+	uint64_t           min_drop_sys_dts;
+	uint64_t           drop_before_seq;
+	bool               drop_until_keyframe;
+	int                dropped_frames;
+
+	/* write queue statistics */
+	size_t             peak_packets;
+	uint64_t           peak_backlog_ns;
+	volatile long      write_latency_usec;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -214,6 +259,20 @@ static bool init_swscale(struct ffmpeg_data *data, AVCodecContext *context)
 	return true;
 }
 
+/* lets libavcodec spread the encode over multiple threads (thread_count 0
+ * picks one per core) for codecs that support it */
+static inline int get_thread_type(const AVCodec *codec)
+{
+	int type = 0;
+
+	if (codec->capabilities & CODEC_CAP_FRAME_THREADS)
+		type |= FF_THREAD_FRAME;
+	if (codec->capabilities & CODEC_CAP_SLICE_THREADS)
+		type |= FF_THREAD_SLICE;
+
+	return type;
+}
+
 static bool create_video_stream(struct ffmpeg_data *data)
 {
 	enum AVPixelFormat closest_format;
@@ -243,6 +302,7 @@ static bool create_video_stream(struct ffmpeg_data *data)
 	context->colorspace     = data->config.color_space;
 	context->color_range    = data->config.color_range;
 	context->thread_count   = 0;
+	context->thread_type    = get_thread_type(data->vcodec);
 
 	data->video->time_base = context->time_base;
 
@@ -252,6 +312,13 @@ static bool create_video_stream(struct ffmpeg_data *data)
 	if (!open_video_codec(data))
 		return false;
 
+	blog(LOG_INFO, "ffmpeg_output: Video encoder '%s' using %d %s",
+			data->vcodec->name, context->thread_count,
+			(context->active_thread_type & FF_THREAD_FRAME) ?
+				"frame threads" :
+			(context->active_thread_type & FF_THREAD_SLICE) ?
+				"slice threads" : "thread(s)");
+
 	if (context->pix_fmt    != data->config.format ||
 	    data->config.width  != data->config.scale_width ||
 	    data->config.height != data->config.scale_height) {
@@ -586,6 +653,8 @@ static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 		goto fail;
 	if (os_sem_init(&data->write_sem, 0) != 0)
 		goto fail;
+	if (os_sem_init(&data->encode_sem, 0) != 0)
+		goto fail;
 
 	av_log_set_callback(ffmpeg_log_callback);
 
@@ -594,6 +663,7 @@ static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 
 fail:
 	pthread_mutex_destroy(&data->write_mutex);
+	os_sem_destroy(data->write_sem);
 	os_event_destroy(data->stop_event);
 	bfree(data);
 	return NULL;
@@ -614,108 +684,275 @@ static void ffmpeg_output_destroy(void *data)
 
 		pthread_mutex_destroy(&output->write_mutex);
 		os_sem_destroy(output->write_sem);
+		os_sem_destroy(output->encode_sem);
 		os_event_destroy(output->stop_event);
 		bfree(data);
 	}
 }
 
-static inline void copy_data(AVPicture *pic, const struct video_data *frame,
-		int height)
+static void push_packet(struct ffmpeg_output *output, AVPacket *packet);
+
+/* raw frame time to encoded packet, in the same way as the encoder latency
+ * that libobs tracks for regular encoders */
+static inline void update_encode_latency(struct ffmpeg_output *output,
+		const AVPacket *packet)
 {
-	for (int plane = 0; plane < MAX_AV_PLANES; plane++) {
-		if (!frame->data[plane])
-			continue;
+	struct ffmpeg_data *data = &output->ff_data;
+	int64_t frame_usec = (int64_t)(output->video_start_ts / 1000) +
+		av_rescale_q(packet->pts, data->video->time_base,
+				(AVRational){1, 1000000});
+	int64_t latency = (int64_t)(os_gettime_ns() / 1000) - frame_usec;
+	long    avg     = os_atomic_load_long(&output->encode_latency_usec);
+
+	os_atomic_set_long(&output->encode_latency_usec, avg ?
+			avg + (long)((latency - avg) / 8) : (long)latency);
+}
 
-		int frame_rowsize = (int)frame->linesize[plane];
-		int pic_rowsize   = pic->linesize[plane];
-		int bytes = frame_rowsize < pic_rowsize ?
-			frame_rowsize : pic_rowsize;
-		int plane_height = plane == 0 ? height : height/2;
+static void push_video_packet(struct ffmpeg_output *output, AVPacket *packet)
+{
+	struct ffmpeg_data *data    = &output->ff_data;
+	AVCodecContext     *context = data->video->codec;
 
-		for (int y = 0; y < plane_height; y++) {
-			int pos_frame = y * frame_rowsize;
-			int pos_pic   = y * pic_rowsize;
+	packet->pts = rescale_ts(packet->pts, context, data->video->time_base);
+	packet->dts = rescale_ts(packet->dts, context, data->video->time_base);
+	packet->duration = (int)av_rescale_q(packet->duration,
+			context->time_base, data->video->time_base);
 
-			memcpy(pic->data[plane] + pos_pic,
-			       frame->data[plane] + pos_frame,
-			       bytes);
-		}
-	}
+	update_encode_latency(output, packet);
+	push_packet(output, packet);
 }
 
-static void receive_video(void *param, struct video_data *frame)
+/* called from the encode thread */
+static void encode_video(struct ffmpeg_output *output,
+		struct queued_frame *frame)
 {
-	struct ffmpeg_output *output = param;
-	struct ffmpeg_data   *data   = &output->ff_data;
-
-	// codec doesn't support video or none configured
-	if (!data->video)
-		return;
-
-	AVCodecContext *context = data->video->codec;
+	struct ffmpeg_data *data    = &output->ff_data;
+	AVCodecContext     *context = data->video->codec;
+	AVPicture          *picture = &frame->picture;
 	AVPacket packet = {0};
+	uint64_t start_time = os_gettime_ns();
 	int ret = 0, got_packet;
 
 	av_init_packet(&packet);
 
-	if (!output->video_start_ts)
-		output->video_start_ts = frame->timestamp;
-	if (!data->start_timestamp)
-		data->start_timestamp = frame->timestamp;
-
-	if (!!data->swscale)
-		sws_scale(data->swscale, (const uint8_t *const *)frame->data,
-				(const int*)frame->linesize,
+	if (!!data->swscale) {
+		sws_scale(data->swscale,
+				(const uint8_t *const *)frame->picture.data,
+				frame->picture.linesize,
 				0, data->config.height, data->dst_picture.data,
 				data->dst_picture.linesize);
-	else
-		copy_data(&data->dst_picture, frame, context->height);
+		picture = &data->dst_picture;
+	}
 
 	if (data->output->flags & AVFMT_RAWPICTURE) {
+		if (picture != &data->dst_picture)
+			av_picture_copy(&data->dst_picture, picture,
+					context->pix_fmt,
+					context->width, context->height);
+
 		packet.flags        |= AV_PKT_FLAG_KEY;
 		packet.stream_index  = data->video->index;
 		packet.data          = data->dst_picture.data[0];
 		packet.size          = sizeof(AVPicture);
 
-		pthread_mutex_lock(&output->write_mutex);
-		da_push_back(output->packets, &packet);
-		pthread_mutex_unlock(&output->write_mutex);
-		os_sem_post(output->write_sem);
+		push_packet(output, &packet);
 
 	} else {
-		data->vframe->pts = data->total_frames;
+		*((AVPicture*)data->vframe) = *picture;
+		data->vframe->pts = frame->pts;
+
 		ret = avcodec_encode_video2(context, &packet, data->vframe,
 				&got_packet);
 		if (ret < 0) {
-			blog(LOG_WARNING, "receive_video: Error encoding "
+			blog(LOG_WARNING, "encode_video: Error encoding "
 			                  "video: %s", av_err2str(ret));
 			return;
 		}
 
 		if (!ret && got_packet && packet.size) {
-			packet.pts = rescale_ts(packet.pts, context,
-					data->video->time_base);
-			packet.dts = rescale_ts(packet.dts, context,
-					data->video->time_base);
-			packet.duration = (int)av_rescale_q(packet.duration,
-					context->time_base,
-					data->video->time_base);
-
-			pthread_mutex_lock(&output->write_mutex);
-			da_push_back(output->packets, &packet);
-			pthread_mutex_unlock(&output->write_mutex);
-			os_sem_post(output->write_sem);
+			push_video_packet(output, &packet);
 		} else {
 			ret = 0;
 		}
 	}
 
 	if (ret != 0) {
-		blog(LOG_WARNING, "receive_video: Error writing video: %s",
+		blog(LOG_WARNING, "encode_video: Error writing video: %s",
 				av_err2str(ret));
 	}
 
-	data->total_frames++;
+	profile_record("ffmpeg_output: encode_video", start_time,
+			os_gettime_ns());
+}
+
+/* codecs with delay (frame threading, b-frames) still hold the last few
+ * frames, and only give them back once they're sent NULL frames */
+static void flush_video(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data    = &output->ff_data;
+	AVCodecContext     *context = data->video->codec;
+
+	if ((data->output->flags & AVFMT_RAWPICTURE) != 0 ||
+	    (data->vcodec->capabilities & CODEC_CAP_DELAY) == 0)
+		return;
+
+	for (;;) {
+		AVPacket packet = {0};
+		int got_packet = 0;
+		int ret;
+
+		av_init_packet(&packet);
+
+		ret = avcodec_encode_video2(context, &packet, NULL,
+				&got_packet);
+		if (ret < 0) {
+			blog(LOG_WARNING, "flush_video: Error encoding "
+			                  "video: %s", av_err2str(ret));
+			break;
+		}
+		if (!got_packet)
+			break;
+
+		if (packet.size)
+			push_video_packet(output, &packet);
+		else
+			av_free_packet(&packet);
+	}
+}
+
+/* frames that were captured before the stop still belong in the file */
+static void drain_frames(struct ffmpeg_output *output)
+{
+	struct queued_frame *frame;
+
+	while ((frame = spsc_ring_pop(&output->ready_frames)) != NULL) {
+		encode_video(output, frame);
+		spsc_ring_push(&output->free_frames, frame);
+	}
+
+	flush_video(output);
+}
+
+static void *encode_thread(void *data)
+{
+	struct ffmpeg_output *output = data;
+
+	os_set_thread_name("ffmpeg-output: encode_thread");
+
+	while (os_sem_wait(output->encode_sem) == 0) {
+		struct queued_frame *frame;
+
+		if (os_atomic_load_bool(&output->encode_stopping)) {
+			drain_frames(output);
+			break;
+		}
+
+		frame = spsc_ring_pop(&output->ready_frames);
+		if (!frame)
+			continue;
+
+		encode_video(output, frame);
+		spsc_ring_push(&output->free_frames, frame);
+	}
+
+	return NULL;
+}
+
+/* only copies the frame, the conversion and encoding are done on the
+ * encode thread so that a slow codec doesn't hold up the video thread */
+static void receive_video(void *param, struct video_data *frame)
+{
+	struct ffmpeg_output *output = param;
+	struct ffmpeg_data   *data   = &output->ff_data;
+	struct queued_frame  *queued;
+
+	// codec doesn't support video or none configured
+	if (!data->video || !output->encode_thread_active)
+		return;
+
+	if (!output->video_start_ts)
+		output->video_start_ts = frame->timestamp;
+	if (!data->start_timestamp)
+		data->start_timestamp = frame->timestamp;
+
+	queued = spsc_ring_pop(&output->free_frames);
+	if (!queued) {
+		os_atomic_inc_long(&output->lagged_frames);
+		data->total_frames++;
+		return;
+	}
+
+	av_image_copy(queued->picture.data, queued->picture.linesize,
+			(const uint8_t **)frame->data,
+			(const int*)frame->linesize,
+			data->config.format,
+			data->config.width, data->config.height);
+	queued->pts = data->total_frames++;
+
+	spsc_ring_push(&output->ready_frames, queued);
+	os_sem_post(output->encode_sem);
+}
+
+/* frames are allocated in the source format and size, swscale (if needed)
+ * converts from them on the encode thread */
+static bool start_encode_thread(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+
+	if (!data->video)
+		return true;
+
+	spsc_ring_init(&output->ready_frames, MAX_QUEUED_FRAMES);
+	spsc_ring_init(&output->free_frames, MAX_QUEUED_FRAMES);
+
+	for (size_t i = 0; i < MAX_QUEUED_FRAMES; i++) {
+		struct queued_frame *frame = &output->frames[i];
+		int ret = avpicture_alloc(&frame->picture, data->config.format,
+				data->config.width, data->config.height);
+		if (ret < 0) {
+			blog(LOG_WARNING, "start_encode_thread: Failed to "
+			                  "allocate frame: %s",
+			                  av_err2str(ret));
+			return false;
+		}
+
+		spsc_ring_push(&output->free_frames, frame);
+	}
+
+	os_atomic_set_bool(&output->encode_stopping, false);
+	output->lagged_frames = 0;
+	output->encode_latency_usec = 0;
+
+	if (pthread_create(&output->encode_thread, NULL, encode_thread,
+				output) != 0) {
+		blog(LOG_WARNING, "start_encode_thread: Failed to create "
+		                  "encode thread");
+		return false;
+	}
+
+	output->encode_thread_active = true;
+	return true;
+}
+
+static void stop_encode_thread(struct ffmpeg_output *output)
+{
+	if (output->encode_thread_active) {
+		os_atomic_set_bool(&output->encode_stopping, true);
+		os_sem_post(output->encode_sem);
+		pthread_join(output->encode_thread, NULL);
+		output->encode_thread_active = false;
+	}
+
+	for (size_t i = 0; i < MAX_QUEUED_FRAMES; i++) {
+		struct queued_frame *frame = &output->frames[i];
+
+		if (frame->picture.data[0])
+			avpicture_free(&frame->picture);
+		memset(frame, 0, sizeof(*frame));
+	}
+
+	spsc_ring_free(&output->ready_frames);
+	spsc_ring_free(&output->free_frames);
 }
 
 static void encode_audio(struct ffmpeg_output *output,
@@ -760,10 +997,7 @@ static void encode_audio(struct ffmpeg_output *output,
 			data->audio->time_base);
 	packet.stream_index = data->audio->index;
 
-	pthread_mutex_lock(&output->write_mutex);
-	da_push_back(output->packets, &packet);
-	pthread_mutex_unlock(&output->write_mutex);
-	os_sem_post(output->write_sem);
+	push_packet(output, &packet);
 }
 
 static bool prepare_audio(struct ffmpeg_data *data,
@@ -850,55 +1084,243 @@ static uint64_t get_packet_sys_dts(struct ffmpeg_output *output,
 			time_base, (AVRational){1, 1000000000});
 }
 
+static inline bool is_video_packet(struct ffmpeg_output *output,
+		const AVPacket *packet)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+	return data->video && data->video->index == packet->stream_index;
+}
+
+/* duration of the packets waiting to be written, in nanoseconds */
+static inline uint64_t get_backlog_ns(struct ffmpeg_output *output)
+{
+	struct queued_packet *first;
+
+	if (!output->packets.size)
+		return 0;
+
+	first = circlebuf_data(&output->packets, 0);
+	return output->last_sys_dts > first->sys_dts ?
+		output->last_sys_dts - first->sys_dts : 0;
+}
+
+/* drops every queued video packet that is not a keyframe; audio is always
+ * kept.  the packets are only marked here and discarded by the write thread
+ * as it reaches them, so that the encoder thread never walks the queue */
+static inline void drop_frames(struct ffmpeg_output *output)
+{
+	struct queued_packet *first = circlebuf_data(&output->packets, 0);
+
+	/* the backlog that is being dropped, the cost is paid by the write
+	 * thread as it reaches the packets */
+	profile_record("ffmpeg_output: drop_frames", first->sys_dts,
+			output->last_sys_dts);
+
+	output->drop_before_seq = output->next_seq;
+
+	/* don't drop again until everything queued now has been written */
+	output->min_drop_sys_dts = output->last_sys_dts;
+}
+
+/* called with write_mutex held */
+static inline bool packet_dropped(struct ffmpeg_output *output,
+		const struct queued_packet *item)
+{
+	return item->seq < output->drop_before_seq &&
+		is_video_packet(output, &item->packet) &&
+		(item->packet.flags & AV_PKT_FLAG_KEY) == 0;
+}
+
+/* called with write_mutex held; returns true if the new video packet
+ * should be dropped */
+static bool check_to_drop_frames(struct ffmpeg_output *output,
+		const AVPacket *packet)
+{
+	bool keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+	struct queued_packet *first;
+
+	if (output->drop_until_keyframe) {
+		if (!keyframe) {
+			output->dropped_frames++;
+			return true;
+		}
+
+		output->drop_until_keyframe = false;
+	}
+
+	if (!output->drop_threshold_ns || !output->packets.size)
+		return false;
+
+	first = circlebuf_data(&output->packets, 0);
+	if (first->sys_dts < output->min_drop_sys_dts)
+		return false;
+	if (get_backlog_ns(output) <= output->drop_threshold_ns)
+		return false;
+
+	drop_frames(output);
+
+	/* everything up to the next keyframe depends on what was dropped */
+	if (!keyframe) {
+		output->drop_until_keyframe = true;
+		output->dropped_frames++;
+		return true;
+	}
+
+	return false;
+}
+
+static void record_backlog(struct ffmpeg_output *output)
+{
+	struct queued_packet *first = circlebuf_data(&output->packets, 0);
+	uint64_t backlog_ns = get_backlog_ns(output);
+	size_t num_packets = output->packets.size / sizeof(*first);
+
+	if (num_packets > output->peak_packets)
+		output->peak_packets = num_packets;
+	if (backlog_ns > output->peak_backlog_ns)
+		output->peak_backlog_ns = backlog_ns;
+
+	profile_record("ffmpeg_output: write queue duration",
+			first->sys_dts, output->last_sys_dts);
+}
+
+static void push_packet(struct ffmpeg_output *output, AVPacket *packet)
+{
+	struct queued_packet item = {
+		.packet    = *packet,
+		.sys_dts   = get_packet_sys_dts(output, packet),
+		.queued_ns = os_gettime_ns()
+	};
+	bool dropped = false;
+
+	pthread_mutex_lock(&output->write_mutex);
+
+	item.seq = output->next_seq++;
+
+	if (item.sys_dts > output->last_sys_dts)
+		output->last_sys_dts = item.sys_dts;
+
+	if (is_video_packet(output, packet))
+		dropped = check_to_drop_frames(output, packet);
+
+	if (!dropped) {
+		circlebuf_push_back(&output->packets, &item, sizeof(item));
+		record_backlog(output);
+	}
+
+	pthread_mutex_unlock(&output->write_mutex);
+
+	if (dropped)
+		av_free_packet(packet);
+	else
+		os_sem_post(output->write_sem);
+}
+
+static inline void update_write_latency(struct ffmpeg_output *output,
+		uint64_t queued_ns)
+{
+	long usec = (long)((os_gettime_ns() - queued_ns) / 1000);
+	long prev = os_atomic_load_long(&output->write_latency_usec);
+
+	os_atomic_set_long(&output->write_latency_usec,
+			prev ? prev + (usec - prev) / 8 : usec);
+}
+
 static int process_packet(struct ffmpeg_output *output)
 {
-	AVPacket packet;
+	struct queued_packet item;
 	bool new_packet = false;
+	bool dropped = false;
 	int ret;
 
 	pthread_mutex_lock(&output->write_mutex);
-	if (output->packets.num) {
-		packet = output->packets.array[0];
-		da_erase(output->packets, 0);
+	if (output->packets.size) {
+		circlebuf_pop_front(&output->packets, &item, sizeof(item));
 		new_packet = true;
+
+		dropped = packet_dropped(output, &item);
+		if (dropped)
+			output->dropped_frames++;
 	}
 	pthread_mutex_unlock(&output->write_mutex);
 
 	if (!new_packet)
 		return 0;
 
-	/*blog(LOG_DEBUG, "size = %d, flags = %lX, stream = %d, "
-			"packets queued: %lu",
-			packet.size, packet.flags,
-			packet.stream_index, output->packets.num);*/
-
 	if (stopping(output)) {
-		uint64_t sys_ts = get_packet_sys_dts(output, &packet);
-		if (sys_ts >= output->stop_ts) {
+		if (item.sys_dts >= output->stop_ts) {
+			av_free_packet(&item.packet);
 			ffmpeg_output_full_stop(output);
 			return 0;
 		}
 	}
 
-	ret = av_interleaved_write_frame(output->ff_data.output, &packet);
+	if (dropped) {
+		av_free_packet(&item.packet);
+		return 0;
+	}
+
+	ret = av_interleaved_write_frame(output->ff_data.output, &item.packet);
 	if (ret < 0) {
-		av_free_packet(&packet);
+		av_free_packet(&item.packet);
 		blog(LOG_WARNING, "receive_audio: Error writing packet: %s",
 				av_err2str(ret));
 		return ret;
 	}
 
+	update_write_latency(output, item.queued_ns);
 	return 0;
 }
 
+/* called on the write thread once the encode thread has been stopped, so
+ * nothing else is queued after this */
+static void write_remaining_packets(struct ffmpeg_output *output)
+{
+	struct queued_packet item;
+	bool stop = stopping(output);
+	int ret;
+
+	for (;;) {
+		bool dropped;
+
+		pthread_mutex_lock(&output->write_mutex);
+		if (!output->packets.size) {
+			pthread_mutex_unlock(&output->write_mutex);
+			break;
+		}
+
+		circlebuf_pop_front(&output->packets, &item, sizeof(item));
+		dropped = packet_dropped(output, &item);
+		if (dropped)
+			output->dropped_frames++;
+		pthread_mutex_unlock(&output->write_mutex);
+
+		if (dropped || (stop && item.sys_dts >= output->stop_ts)) {
+			av_free_packet(&item.packet);
+			continue;
+		}
+
+		ret = av_interleaved_write_frame(output->ff_data.output,
+				&item.packet);
+		if (ret < 0) {
+			av_free_packet(&item.packet);
+			blog(LOG_WARNING, "write_remaining_packets: Error "
+			                  "writing packet: %s", av_err2str(ret));
+			break;
+		}
+	}
+}
+
 static void *write_thread(void *data)
 {
 	struct ffmpeg_output *output = data;
 
 	while (os_sem_wait(output->write_sem) == 0) {
 		/* check to see if shutting down */
-		if (os_event_try(output->stop_event) == 0)
+		if (os_event_try(output->stop_event) == 0) {
+			write_remaining_packets(output);
 			break;
+		}
 
 		int ret = process_packet(output);
 		if (ret != 0) {
@@ -929,6 +1351,33 @@ static inline const char *get_string_or_null(obs_data_t *settings,
 	return value;
 }
 
+static inline bool is_network_url(const char *url)
+{
+	return url && strstr(url, "://") != NULL &&
+		astrcmpi_n(url, "file:", 5) != 0;
+}
+
+static void reset_write_queue(struct ffmpeg_output *output,
+		obs_data_t *settings, const char *url)
+{
+	int drop_ms = (int)obs_data_get_int(settings, OPT_DROP_THRESHOLD);
+
+	/* dropping frames is only useful to keep latency down when streaming,
+	 * files are always written in full */
+	output->drop_threshold_ns = is_network_url(url) && drop_ms > 0 ?
+		(uint64_t)drop_ms * 1000000ULL : 0;
+
+	output->last_sys_dts        = 0;
+	output->min_drop_sys_dts    = 0;
+	output->next_seq            = 0;
+	output->drop_before_seq     = 0;
+	output->drop_until_keyframe = false;
+	output->dropped_frames      = 0;
+	output->peak_packets        = 0;
+	output->peak_backlog_ns     = 0;
+	os_atomic_set_long(&output->write_latency_usec, 0);
+}
+
 static bool try_connect(struct ffmpeg_output *output)
 {
 	video_t *video = obs_output_video(output->output);
@@ -981,6 +1430,8 @@ static bool try_connect(struct ffmpeg_output *output)
 	if (!config.scale_height)
 		config.scale_height = config.height;
 
+	reset_write_queue(output, settings, config.url);
+
 	success = ffmpeg_data_init(&output->ff_data, &config);
 	obs_data_release(settings);
 
@@ -1004,10 +1455,16 @@ static bool try_connect(struct ffmpeg_output *output)
 		return false;
 	}
 
+	output->write_thread_active = true;
+
+	if (!start_encode_thread(output)) {
+		ffmpeg_output_full_stop(output);
+		return false;
+	}
+
 	obs_output_set_video_conversion(output->output, NULL);
 	obs_output_set_audio_conversion(output->output, &aci);
 	obs_output_begin_data_capture(output->output, 0);
-	output->write_thread_active = true;
 	return true;
 }
 
@@ -1065,32 +1522,102 @@ static void ffmpeg_output_stop(void *data, uint64_t ts)
 
 static void ffmpeg_deactivate(struct ffmpeg_output *output)
 {
+	stop_encode_thread(output);
+
 	if (output->write_thread_active) {
+		bool self = pthread_equal(pthread_self(), output->write_thread);
+
+		/* reaching the stop timestamp stops the output from the write
+		 * thread itself, which then exits once this returns */
+		if (self) {
+			write_remaining_packets(output);
+			pthread_detach(output->write_thread);
+		}
+
 		os_event_signal(output->stop_event);
 		os_sem_post(output->write_sem);
-		pthread_join(output->write_thread, NULL);
+
+		if (!self)
+			pthread_join(output->write_thread, NULL);
+
 		output->write_thread_active = false;
 	}
 
 	pthread_mutex_lock(&output->write_mutex);
 
-	for (size_t i = 0; i < output->packets.num; i++)
-		av_free_packet(output->packets.array+i);
-	da_free(output->packets);
+	while (output->packets.size) {
+		struct queued_packet item;
+		circlebuf_pop_front(&output->packets, &item, sizeof(item));
+		av_free_packet(&item.packet);
+	}
+	circlebuf_free(&output->packets);
 
 	pthread_mutex_unlock(&output->write_mutex);
 
+	if (output->ff_data.initialized)
+		blog(LOG_INFO, "ffmpeg_output: Write queue: peak of %d packets "
+		               "(%d ms), %d frames dropped",
+				(int)output->peak_packets,
+				(int)(output->peak_backlog_ns / 1000000),
+				output->dropped_frames);
+
+	if (output->ff_data.initialized && output->ff_data.video)
+		blog(LOG_INFO, "ffmpeg_output: Video encode: %ld frames "
+		               "skipped due to encoder lag, average latency "
+		               "%ld ms",
+				os_atomic_load_long(&output->lagged_frames),
+				os_atomic_load_long(
+					&output->encode_latency_usec) / 1000);
+
 	ffmpeg_data_free(&output->ff_data);
 }
 
+static void ffmpeg_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 700);
+}
+
+static int ffmpeg_output_dropped_frames(void *data)
+{
+	struct ffmpeg_output *output = data;
+	return output->dropped_frames +
+		(int)os_atomic_load_long(&output->lagged_frames);
+}
+
+static void ffmpeg_output_get_stats(void *data,
+		struct obs_output_stats *stats)
+{
+	struct ffmpeg_output *output = data;
+	uint64_t backlog_ns;
+
+	pthread_mutex_lock(&output->write_mutex);
+	backlog_ns = get_backlog_ns(output);
+	pthread_mutex_unlock(&output->write_mutex);
+
+	/* 1.0 is the point where frames start getting dropped */
+	if (output->drop_threshold_ns) {
+		float congestion = (float)backlog_ns /
+			(float)output->drop_threshold_ns;
+		stats->congestion = congestion < 1.0f ? congestion : 1.0f;
+	}
+
+	stats->send_latency_ms = (double)os_atomic_load_long(
+			&output->write_latency_usec) / 1000.0;
+	stats->encoder_latency_ms = (double)os_atomic_load_long(
+			&output->encode_latency_usec) / 1000.0;
+}
+
 struct obs_output_info ffmpeg_output = {
-	.id        = "ffmpeg_output",
-	.flags     = OBS_OUTPUT_AUDIO | OBS_OUTPUT_VIDEO,
-	.get_name  = ffmpeg_output_getname,
-	.create    = ffmpeg_output_create,
-	.destroy   = ffmpeg_output_destroy,
-	.start     = ffmpeg_output_start,
-	.stop      = ffmpeg_output_stop,
-	.raw_video = receive_video,
-	.raw_audio = receive_audio,
+	.id                 = "ffmpeg_output",
+	.flags              = OBS_OUTPUT_AUDIO | OBS_OUTPUT_VIDEO,
+	.get_name           = ffmpeg_output_getname,
+	.create             = ffmpeg_output_create,
+	.destroy            = ffmpeg_output_destroy,
+	.start              = ffmpeg_output_start,
+	.stop               = ffmpeg_output_stop,
+	.raw_video          = receive_video,
+	.raw_audio          = receive_audio,
+	.get_defaults       = ffmpeg_output_defaults,
+	.get_dropped_frames = ffmpeg_output_dropped_frames,
+	.get_stats          = ffmpeg_output_get_stats,
 };
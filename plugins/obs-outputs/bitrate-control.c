@@ -0,0 +1,147 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+#include "bitrate-control.h"
+
+/* throughput is measured over intervals of this length */
+#define MEASURE_INTERVAL_NS   250000000ULL
+
+/* the encoder needs time before a change shows up in the send queue */
+#define DECREASE_HOLD_NS      1000000000ULL
+#define INCREASE_HOLD_NS      2000000000ULL
+
+/* how long the queue has to stay drained before the bitrate is raised */
+#define DRAINED_HOLD_NS       3000000000ULL
+
+/* never go below this fraction of the configured bitrate */
+#define MIN_BITRATE_DIV       5
+
+/* the bitrate is raised by this fraction of the configured bitrate */
+#define INCREASE_STEP_DIV     10
+
+/* leave headroom below the estimated throughput */
+#define TARGET_HEADROOM       0.85
+#define DECREASE_FACTOR       0.7
+#define ESTIMATE_SMOOTHING    0.3
+
+void bitrate_control_init(struct bitrate_control *bc, int video_kbps,
+		int other_kbps, int64_t congested_usec)
+{
+	memset(bc, 0, sizeof(struct bitrate_control));
+	bc->orig_kbps      = video_kbps;
+	bc->cur_kbps       = video_kbps;
+	bc->min_kbps       = video_kbps / MIN_BITRATE_DIV;
+	bc->other_kbps     = other_kbps;
+	bc->congested_usec = congested_usec;
+	bc->drained_usec   = congested_usec / 4;
+
+	if (bc->min_kbps < 1)
+		bc->min_kbps = 1;
+}
+
+static inline int clamp_kbps(struct bitrate_control *bc, double kbps)
+{
+	if (kbps < (double)bc->min_kbps)
+		return bc->min_kbps;
+	if (kbps > (double)bc->orig_kbps)
+		return bc->orig_kbps;
+	return (int)kbps;
+}
+
+static int lower_bitrate(struct bitrate_control *bc)
+{
+	double target = bc->cur_kbps * DECREASE_FACTOR;
+
+	/* while the queue is backed up the connection is the bottleneck, so
+	 * the estimate is what the connection can actually take */
+	if (bc->est_kbps > 0.0) {
+		double fit = bc->est_kbps * TARGET_HEADROOM -
+			(double)bc->other_kbps;
+		if (fit < (double)bc->cur_kbps)
+			target = fit;
+	}
+
+	return clamp_kbps(bc, target);
+}
+
+static inline int raise_bitrate(struct bitrate_control *bc)
+{
+	return clamp_kbps(bc, (double)bc->cur_kbps +
+			(double)bc->orig_kbps / INCREASE_STEP_DIV);
+}
+
+int bitrate_control_update(struct bitrate_control *bc, uint64_t ts_ns,
+		uint64_t total_bytes, int64_t queue_usec)
+{
+	uint64_t elapsed;
+	int64_t  growth;
+	int      new_kbps = 0;
+
+	if (!bc->interval_start_ns) {
+		bc->interval_start_ns         = ts_ns;
+		bc->interval_start_bytes      = total_bytes;
+		bc->interval_start_queue_usec = queue_usec;
+		bc->last_change_ns            = ts_ns;
+		bc->drained_since_ns          = ts_ns;
+		return 0;
+	}
+
+	elapsed = ts_ns - bc->interval_start_ns;
+	if (elapsed < MEASURE_INTERVAL_NS)
+		return 0;
+
+	growth = queue_usec - bc->interval_start_queue_usec;
+
+	/* a send rate only says something about the connection if there was
+	 * data waiting to be sent the whole time */
+	if (queue_usec > 0 && bc->interval_start_queue_usec > 0) {
+		double kbps = (double)(total_bytes - bc->interval_start_bytes) *
+			8000000.0 / (double)elapsed;
+
+		bc->est_kbps = bc->est_kbps > 0.0 ?
+			bc->est_kbps + (kbps - bc->est_kbps) *
+				ESTIMATE_SMOOTHING :
+			kbps;
+	}
+
+	bc->interval_start_ns         = ts_ns;
+	bc->interval_start_bytes      = total_bytes;
+	bc->interval_start_queue_usec = queue_usec;
+
+	if (queue_usec > bc->drained_usec)
+		bc->drained_since_ns = ts_ns;
+
+	if (queue_usec >= bc->congested_usec &&
+	    (growth > 0 || queue_usec >= bc->congested_usec * 2)) {
+		if (ts_ns - bc->last_change_ns >= DECREASE_HOLD_NS &&
+		    bc->cur_kbps > bc->min_kbps)
+			new_kbps = lower_bitrate(bc);
+
+	} else if (bc->cur_kbps < bc->orig_kbps &&
+	           ts_ns - bc->drained_since_ns >= DRAINED_HOLD_NS &&
+	           ts_ns - bc->last_change_ns >= INCREASE_HOLD_NS) {
+		new_kbps = raise_bitrate(bc);
+	}
+
+	if (!new_kbps || new_kbps == bc->cur_kbps)
+		return 0;
+
+	bc->cur_kbps       = new_kbps;
+	bc->last_change_ns = ts_ns;
+	return new_kbps;
+}
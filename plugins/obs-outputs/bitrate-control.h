@@ -0,0 +1,65 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+/*
+ * Closed-loop control of a stream's video bitrate.  The controller is fed the
+ * total number of bytes sent and the duration of the send queue, estimates
+ * the throughput of the connection while the queue is backed up, and lowers
+ * the bitrate to fit it before the queue reaches the frame drop threshold.
+ * Once the queue has stayed drained for a while, the bitrate is raised back
+ * towards the original in steps.
+ *
+ * It does not touch the output or encoder itself, so it can just as well be
+ * driven by recorded bandwidth traces.
+ */
+
+struct bitrate_control {
+	int      orig_kbps;
+	int      min_kbps;
+	int      cur_kbps;
+	int      other_kbps;
+	int64_t  congested_usec;
+	int64_t  drained_usec;
+
+	uint64_t interval_start_ns;
+	uint64_t interval_start_bytes;
+	int64_t  interval_start_queue_usec;
+
+	double   est_kbps;
+	uint64_t last_change_ns;
+	uint64_t drained_since_ns;
+};
+
+/**
+ * video_kbps is the configured video bitrate, which is never exceeded.
+ * other_kbps is the bitrate of everything else in the stream (audio), which
+ * is taken out of the estimated throughput.  congested_usec is the send
+ * queue duration at which the video bitrate starts being lowered.
+ */
+extern void bitrate_control_init(struct bitrate_control *bc, int video_kbps,
+		int other_kbps, int64_t congested_usec);
+
+/**
+ * Call whenever data has been sent.  Returns the new video bitrate in kbps,
+ * or 0 if the bitrate should stay as it is.
+ */
+extern int bitrate_control_update(struct bitrate_control *bc, uint64_t ts_ns,
+		uint64_t total_bytes, int64_t queue_usec);
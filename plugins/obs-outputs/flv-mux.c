@@ -177,10 +177,30 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
+size_t flv_packet_body_header(struct encoder_packet *packet,
+		uint8_t *header, bool is_header)
+{
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		int64_t offset = packet->pts - packet->dts;
+		int32_t cts    = get_ms_time(packet, offset);
+
+		header[0] = packet->keyframe ? 0x17 : 0x27;
+		header[1] = is_header ? 0 : 1;
+		header[2] = (uint8_t)(cts >> 16);
+		header[3] = (uint8_t)(cts >> 8);
+		header[4] = (uint8_t)cts;
+		return 5;
+	}
+
+	header[0] = 0xaf;
+	header[1] = is_header ? 0 : 1;
+	return 2;
+}
+
 static void flv_video(struct serializer *s, struct encoder_packet *packet,
 		bool is_header)
 {
-	int64_t offset  = packet->pts - packet->dts;
+	uint8_t header[FLV_MAX_BODY_HEADER_SIZE];
 	int32_t time_ms = get_ms_time(packet, packet->dts);
 
 	if (!packet->data || !packet->size)
@@ -203,9 +223,7 @@ static void flv_video(struct serializer *s, struct encoder_packet *packet,
 	s_wb24(s, 0);
 
 	/* these are the 5 extra bytes mentioned above */
-	s_w8(s, packet->keyframe ? 0x17 : 0x27);
-	s_w8(s, is_header ? 0 : 1);
-	s_wb24(s, get_ms_time(packet, offset));
+	s_write(s, header, flv_packet_body_header(packet, header, is_header));
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesnt count) */
@@ -215,6 +233,7 @@ static void flv_video(struct serializer *s, struct encoder_packet *packet,
 static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 		bool is_header)
 {
+	uint8_t header[FLV_MAX_BODY_HEADER_SIZE];
 	int32_t time_ms = get_ms_time(packet, packet->dts);
 
 	if (!packet->data || !packet->size)
@@ -237,8 +256,7 @@ static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 	s_wb24(s, 0);
 
 	/* these are the two extra bytes mentioned above */
-	s_w8(s, 0xaf);
-	s_w8(s, is_header ? 0 : 1);
+	s_write(s, header, flv_packet_body_header(packet, header, is_header));
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesnt count) */
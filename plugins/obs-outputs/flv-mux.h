@@ -21,6 +21,12 @@
 
 #define MILLISECOND_DEN   1000
 
+/* audio/video tag bodies start with up to this many bytes of codec info */
+#define FLV_MAX_BODY_HEADER_SIZE 5
+
+/* tag header + trailing tag size */
+#define FLV_TAG_OVERHEAD  (11 + 4)
+
 static uint32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 {
 	return (uint32_t)(val * MILLISECOND_DEN / packet->timebase_den);
@@ -32,3 +38,9 @@ extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 		bool write_header, size_t audio_idx);
 extern void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header);
+
+/* writes the codec info that precedes the packet data in an audio/video tag
+ * body to 'header' and returns its size, so the packet data itself can be
+ * sent without being copied into a muxed buffer */
+extern size_t flv_packet_body_header(struct encoder_packet *packet,
+		uint8_t *header, bool is_header);
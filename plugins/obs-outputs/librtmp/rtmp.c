@@ -1426,6 +1426,11 @@ WriteN(RTMP *r, const char *buffer, int n)
         if (nBytes < 0)
         {
             int sockerr = GetSockError();
+
+            if (sockerr == EAGAIN && r->m_waitWritableFunc &&
+                    r->m_waitWritableFunc(&r->m_sb, r->m_waitWritableParam))
+                continue;
+
             RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d (%d bytes)", __FUNCTION__,
                      sockerr, n);
 
@@ -3925,22 +3930,12 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+static int
+EnsureChannelsOut(RTMP *r, int channel)
 {
-    const RTMPPacket *prevPacket;
-    uint32_t last = 0;
-    int nSize;
-    int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
-    uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
-
-    if (packet->m_nChannel >= r->m_channelsAllocatedOut)
+    if (channel >= r->m_channelsAllocatedOut)
     {
-        int n = packet->m_nChannel + 10;
+        int n = channel + 10;
         RTMPPacket **packets = realloc(r->m_vecChannelsOut, sizeof(RTMPPacket*) * n);
         if (!packets)
         {
@@ -3953,6 +3948,24 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
         memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
         r->m_channelsAllocatedOut = n;
     }
+    return TRUE;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    const RTMPPacket *prevPacket;
+    uint32_t last = 0;
+    int nSize;
+    int hSize, cSize;
+    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    uint32_t t;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    if (!EnsureChannelsOut(r, packet->m_nChannel))
+        return FALSE;
 
     prevPacket = r->m_vecChannelsOut[packet->m_nChannel];
     if (prevPacket && packet->m_headerType != RTMP_PACKET_SIZE_LARGE)
@@ -5242,3 +5255,263 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+/* RTMP_WriteTag sends an audio/video message whose body is 'header' followed
+ * by 'data' without assembling it first.  The chunk headers are generated
+ * into a small stack buffer and sent along with slices of the caller's
+ * buffers in one vectored write per batch of chunks.  Connections that
+ * transform the outgoing bytes (TLS, RTMPE, RTMPT, custom send functions)
+ * take the copying path instead. */
+
+#define WRITETAG_BATCH_CHUNKS 64
+#define WRITETAG_CHANNEL      0x04
+
+#ifdef _WIN32
+typedef WSABUF RTMPIOVec;
+#define IOVEC_BASE(v)      ((v)->buf)
+#define IOVEC_LEN(v)       ((v)->len)
+#else
+typedef struct iovec RTMPIOVec;
+#define IOVEC_BASE(v)      ((char *)(v)->iov_base)
+#define IOVEC_LEN(v)       ((v)->iov_len)
+#endif
+
+static inline void
+SetIOVec(RTMPIOVec *v, const char *buf, int64_t len)
+{
+#ifdef _WIN32
+    v->buf = (CHAR *)buf;
+    v->len = (ULONG)len;
+#else
+    v->iov_base = (void *)buf;
+    v->iov_len = (size_t)len;
+#endif
+}
+
+static int
+CanWriteV(RTMP *r)
+{
+#if defined(RTMP_NETSTACK_DUMP)
+    return FALSE;
+#else
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+        return FALSE;
+    if (r->m_bCustomSend && r->m_customSendFunc)
+        return FALSE;
+    if (r->m_sb.sb_ssl)
+        return FALSE;
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut)
+        return FALSE;
+#endif
+    return TRUE;
+#endif
+}
+
+static int
+WriteV(RTMP *r, RTMPIOVec *iov, int cnt)
+{
+    while (cnt > 0)
+    {
+        int64_t nBytes;
+
+#ifdef _WIN32
+        DWORD sent = 0;
+        if (WSASend(r->m_sb.sb_socket, iov, (DWORD)cnt, &sent, 0, NULL, NULL) != 0)
+            nBytes = -1;
+        else
+            nBytes = (int64_t)sent;
+#else
+        nBytes = (int64_t)writev(r->m_sb.sb_socket, iov, cnt);
+#endif
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+
+            if (sockerr == EAGAIN && r->m_waitWritableFunc &&
+                    r->m_waitWritableFunc(&r->m_sb, r->m_waitWritableParam))
+                continue;
+
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* skip whatever was fully sent, then trim a partially sent buffer */
+        while (cnt > 0 && nBytes >= (int64_t)IOVEC_LEN(iov))
+        {
+            nBytes -= IOVEC_LEN(iov);
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0 && nBytes > 0)
+            SetIOVec(iov, IOVEC_BASE(iov) + nBytes,
+                     (int64_t)IOVEC_LEN(iov) - nBytes);
+    }
+
+    return TRUE;
+}
+
+/* adds the part of the body in [offset, offset + len) */
+static int
+AddBodyIOVecs(RTMPIOVec *iov, int cnt, const char *header, int headerSize,
+              const char *data, int offset, int len)
+{
+    if (offset < headerSize)
+    {
+        int n = headerSize - offset;
+        if (n > len)
+            n = len;
+
+        SetIOVec(&iov[cnt++], header + offset, n);
+        offset += n;
+        len -= n;
+    }
+
+    if (len > 0)
+        SetIOVec(&iov[cnt++], data + (offset - headerSize), len);
+
+    return cnt;
+}
+
+static int
+WriteTagCopy(RTMP *r, RTMPPacket *packet, const char *header, int headerSize,
+             const char *data, int dataSize)
+{
+    int ret;
+
+    if (!RTMPPacket_Alloc(packet, packet->m_nBodySize))
+        return FALSE;
+
+    memcpy(packet->m_body, header, headerSize);
+    memcpy(packet->m_body + headerSize, data, dataSize);
+
+    ret = RTMP_SendPacket(r, packet, FALSE);
+    RTMPPacket_Free(packet);
+    return ret;
+}
+
+int
+RTMP_WriteTag(RTMP *r, uint8_t packetType, uint32_t timestamp,
+              const char *header, int headerSize,
+              const char *data, int dataSize, int streamIdx)
+{
+    RTMPPacket packet;
+    const RTMPPacket *prevPacket;
+    RTMPIOVec iov[WRITETAG_BATCH_CHUNKS * 3 + 1];
+    char hbuf[RTMP_MAX_HEADER_SIZE + WRITETAG_BATCH_CHUNKS];
+    char *hptr, *hend = hbuf + sizeof(hbuf);
+    uint32_t last = 0, t;
+    int nSize, hSize, bodySize, chunkSize, offset = 0;
+    int first = TRUE;
+    char c;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.m_nChannel = WRITETAG_CHANNEL;
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_packetType = packetType;
+    packet.m_nTimeStamp = timestamp;
+    packet.m_nBodySize = headerSize + dataSize;
+    packet.m_headerType = timestamp ?
+            RTMP_PACKET_SIZE_MEDIUM : RTMP_PACKET_SIZE_LARGE;
+
+    if (!CanWriteV(r))
+        return WriteTagCopy(r, &packet, header, headerSize, data, dataSize);
+
+    if (!EnsureChannelsOut(r, packet.m_nChannel))
+        return FALSE;
+
+    /* same header compression as RTMP_SendPacket */
+    prevPacket = r->m_vecChannelsOut[packet.m_nChannel];
+    if (prevPacket && packet.m_headerType != RTMP_PACKET_SIZE_LARGE)
+    {
+        if (prevPacket->m_nBodySize == packet.m_nBodySize
+                && prevPacket->m_packetType == packet.m_packetType)
+            packet.m_headerType = RTMP_PACKET_SIZE_SMALL;
+
+        if (prevPacket->m_nTimeStamp == packet.m_nTimeStamp
+                && packet.m_headerType == RTMP_PACKET_SIZE_SMALL)
+            packet.m_headerType = RTMP_PACKET_SIZE_MINIMUM;
+        last = prevPacket->m_nTimeStamp;
+    }
+
+    nSize = packetSize[packet.m_headerType];
+    t = packet.m_nTimeStamp - last;
+
+    /* the channel always fits in a one byte basic header */
+    c = (char)((packet.m_headerType << 6) | packet.m_nChannel);
+
+    hptr = hbuf;
+    *hptr++ = c;
+
+    if (nSize > 1)
+        hptr = AMF_EncodeInt24(hptr, hend, t > 0xffffff ? 0xffffff : t);
+
+    if (nSize > 4)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, packet.m_nBodySize);
+        *hptr++ = packet.m_packetType;
+    }
+
+    if (nSize > 8)
+        hptr += EncodeInt32LE(hptr, packet.m_nInfoField2);
+
+    if (nSize > 1 && t >= 0xffffff)
+        hptr = AMF_EncodeInt32(hptr, hend, t);
+
+    hSize = (int)(hptr - hbuf);
+    bodySize = (int)packet.m_nBodySize;
+    chunkSize = r->m_outChunkSize;
+
+    do
+    {
+        int cnt = 0;
+        int chunks = 0;
+
+        /* continuation headers of later batches can reuse the whole buffer */
+        if (first)
+            SetIOVec(&iov[cnt++], hbuf, hSize);
+        else
+            hptr = hbuf;
+
+        while (chunks < WRITETAG_BATCH_CHUNKS && offset < bodySize)
+        {
+            int len = bodySize - offset;
+            if (len > chunkSize)
+                len = chunkSize;
+
+            if (!first || chunks > 0)
+            {
+                *hptr = (char)(0xc0 | c);
+                SetIOVec(&iov[cnt++], hptr, 1);
+                hptr++;
+            }
+
+            cnt = AddBodyIOVecs(iov, cnt, header, headerSize, data,
+                                offset, len);
+            offset += len;
+            chunks++;
+        }
+
+        first = FALSE;
+
+        if (!WriteV(r, iov, cnt))
+            return FALSE;
+    } while (offset < bodySize);
+
+    if (!r->m_vecChannelsOut[packet.m_nChannel])
+        r->m_vecChannelsOut[packet.m_nChannel] = malloc(sizeof(RTMPPacket));
+    if (!r->m_vecChannelsOut[packet.m_nChannel])
+        return FALSE;
+    memcpy(r->m_vecChannelsOut[packet.m_nChannel], &packet, sizeof(RTMPPacket));
+    return TRUE;
+}
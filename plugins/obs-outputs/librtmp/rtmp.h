@@ -269,6 +269,10 @@ extern "C"
 
     typedef int (*CUSTOMSEND)(RTMPSockBuf*, const char *, int, void*);
 
+    /* called when a send on a non-blocking socket would block; returns
+     * FALSE to give up on the send */
+    typedef int (*WAITWRITABLE)(RTMPSockBuf*, void*);
+
     typedef struct RTMP
     {
         int m_inChunkSize;
@@ -294,6 +298,9 @@ extern "C"
         void*   m_customSendParam;
         CUSTOMSEND m_customSendFunc;
 
+        void*   m_waitWritableParam;
+        WAITWRITABLE m_waitWritableFunc;
+
         RTMP_BINDINFO m_bindIP;
 
         uint8_t m_bSendChunkSizeInfo;
@@ -411,6 +418,9 @@ extern "C"
     void RTMP_DropRequest(RTMP *r, int i, int freeit);
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
+    int RTMP_WriteTag(RTMP *r, uint8_t packetType, uint32_t timestamp,
+                      const char *header, int headerSize,
+                      const char *data, int dataSize, int streamIdx);
 
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
@@ -18,6 +18,7 @@
 #include <obs-module.h>
 #include <obs-avc.h>
 #include <util/platform.h>
+#include <util/profiler.h>
 #include <util/circlebuf.h>
 #include <util/dstr.h>
 #include <util/threading.h>
@@ -26,6 +27,7 @@
 #include "librtmp/log.h"
 #include "flv-mux.h"
 #include "net-if.h"
+#include "bitrate-control.h"
 
 #ifdef _WIN32
 #include <Iphlpapi.h>
@@ -33,6 +35,13 @@
 #include <sys/ioctl.h>
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #define do_log(level, format, ...) \
 	blog(level, "[rtmp stream: '%s'] " format, \
 			obs_output_get_name(stream->output), ##__VA_ARGS__)
@@ -45,6 +54,8 @@
 #define OPT_PFRAME_DROP_THRESHOLD "pframe_drop_threshold_ms"
 #define OPT_MAX_SHUTDOWN_TIME_SEC "max_shutdown_time_sec"
 #define OPT_BIND_IP "bind_ip"
+#define OPT_DYN_BITRATE "dyn_bitrate"
+#define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
 
 //#define TEST_FRAMEDROPS
 
@@ -59,11 +70,24 @@ struct droptest_info {
 };
 #endif
 
+/* audio packets, then one queue of video packets per drop priority, so that
+ * dropping frames never has to look at the packets that are kept */
+#define NUM_PACKET_QUEUES (OBS_NAL_PRIORITY_HIGHEST + 2)
+#define AUDIO_QUEUE       0
+
+struct queued_packet {
+	struct encoder_packet packet;
+	uint64_t              seq;
+	uint64_t              queued_ns;
+};
+
 struct rtmp_stream {
 	obs_output_t     *output;
 
 	pthread_mutex_t  packets_mutex;
-	struct circlebuf packets;
+	struct circlebuf packets[NUM_PACKET_QUEUES];
+	size_t           num_packets;
+	uint64_t         next_seq;
 	bool             sent_headers;
 
 	volatile bool    connecting;
@@ -95,6 +119,24 @@ struct rtmp_stream {
 
 	uint64_t         total_bytes_sent;
 	int              dropped_frames;
+	volatile long    send_latency_usec;
+
+	uint64_t         next_recv_check_ns;
+
+	/* dynamic bitrate */
+	bool             dbr_enabled;
+	bool             dbr_paused;
+	int              dbr_orig_kbps;
+	struct bitrate_control dbr;
+
+	/* low latency mode: non-blocking socket that only lets the kernel
+	 * buffer a little unsent data, so the backlog stays in the send
+	 * queue where frames can be dropped */
+	bool             low_latency_mode;
+#ifdef __linux__
+	int              epoll_fd;
+	int              stop_fd;
+#endif
 
 #ifdef TEST_FRAMEDROPS
 	struct circlebuf droptest_info;
@@ -118,7 +160,48 @@ static void log_rtmp(int level, const char *format, va_list args)
 	blogva(LOG_INFO, format, args);
 }
 
-static inline size_t num_buffered_packets(struct rtmp_stream *stream);
+static inline size_t num_buffered_packets(struct rtmp_stream *stream)
+{
+	return stream->num_packets;
+}
+
+static inline size_t packet_queue_idx(struct encoder_packet *packet)
+{
+	int priority = packet->drop_priority;
+
+	if (packet->type == OBS_ENCODER_AUDIO)
+		return AUDIO_QUEUE;
+
+	if (priority < OBS_NAL_PRIORITY_DISPOSABLE)
+		priority = OBS_NAL_PRIORITY_DISPOSABLE;
+	else if (priority > OBS_NAL_PRIORITY_HIGHEST)
+		priority = OBS_NAL_PRIORITY_HIGHEST;
+
+	return AUDIO_QUEUE + 1 + (size_t)priority;
+}
+
+/* the queue holding the oldest packet, or NULL if there are no packets */
+static struct circlebuf *front_queue(struct rtmp_stream *stream)
+{
+	struct circlebuf *front = NULL;
+	uint64_t front_seq = 0;
+
+	for (size_t i = 0; i < NUM_PACKET_QUEUES; i++) {
+		struct circlebuf *queue = &stream->packets[i];
+		struct queued_packet *item;
+
+		if (!queue->size)
+			continue;
+
+		item = circlebuf_data(queue, 0);
+		if (!front || item->seq < front_seq) {
+			front     = queue;
+			front_seq = item->seq;
+		}
+	}
+
+	return front;
+}
 
 static inline void free_packets(struct rtmp_stream *stream)
 {
@@ -130,11 +213,17 @@ static inline void free_packets(struct rtmp_stream *stream)
 	if (num_packets)
 		info("Freeing %d remaining packets", (int)num_packets);
 
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-		obs_free_encoder_packet(&packet);
+	for (size_t i = 0; i < NUM_PACKET_QUEUES; i++) {
+		struct circlebuf *queue = &stream->packets[i];
+
+		while (queue->size) {
+			struct queued_packet item;
+			circlebuf_pop_front(queue, &item, sizeof(item));
+			obs_free_encoder_packet(&item.packet);
+		}
 	}
+
+	stream->num_packets = 0;
 	pthread_mutex_unlock(&stream->packets_mutex);
 }
 
@@ -158,6 +247,32 @@ static inline bool disconnected(struct rtmp_stream *stream)
 	return os_atomic_load_bool(&stream->disconnected);
 }
 
+/* wakes the send thread if it is waiting on the socket, only used for
+ * immediate stops since it makes anything still being sent be abandoned */
+static inline void signal_stop_fd(struct rtmp_stream *stream)
+{
+#ifdef __linux__
+	uint64_t val = 1;
+	if (stream->stop_fd != -1 &&
+	    write(stream->stop_fd, &val, sizeof(val)) != sizeof(val))
+		warn("Failed to signal stop to the send thread");
+#else
+	UNUSED_PARAMETER(stream);
+#endif
+}
+
+static inline void reset_stop_fd(struct rtmp_stream *stream)
+{
+#ifdef __linux__
+	uint64_t val;
+	if (stream->stop_fd != -1 &&
+	    read(stream->stop_fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+		warn("Failed to reset send thread stop signal");
+#else
+	UNUSED_PARAMETER(stream);
+#endif
+}
+
 static void rtmp_stream_destroy(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -171,6 +286,7 @@ static void rtmp_stream_destroy(void *data)
 
 		stream->stop_ts = 0;
 		os_event_signal(stream->stop_event);
+		signal_stop_fd(stream);
 
 		if (active(stream)) {
 			os_sem_post(stream->send_sem);
@@ -189,8 +305,15 @@ static void rtmp_stream_destroy(void *data)
 		dstr_free(&stream->bind_ip);
 		os_event_destroy(stream->stop_event);
 		os_sem_destroy(stream->send_sem);
+#ifdef __linux__
+		if (stream->epoll_fd != -1)
+			close(stream->epoll_fd);
+		if (stream->stop_fd != -1)
+			close(stream->stop_fd);
+#endif
 		pthread_mutex_destroy(&stream->packets_mutex);
-		circlebuf_free(&stream->packets);
+		for (size_t i = 0; i < NUM_PACKET_QUEUES; i++)
+			circlebuf_free(&stream->packets[i]);
 #ifdef TEST_FRAMEDROPS
 		circlebuf_free(&stream->droptest_info);
 #endif
@@ -203,6 +326,10 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
 	pthread_mutex_init_value(&stream->packets_mutex);
+#ifdef __linux__
+	stream->epoll_fd = -1;
+	stream->stop_fd  = -1;
+#endif
 
 	RTMP_Init(&stream->rtmp);
 	RTMP_LogSetCallback(log_rtmp);
@@ -213,6 +340,18 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 
+#ifdef __linux__
+	stream->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	stream->stop_fd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (stream->epoll_fd == -1 || stream->stop_fd == -1)
+		goto fail;
+
+	struct epoll_event ev = {.events = EPOLLIN};
+	ev.data.fd = stream->stop_fd;
+	if (epoll_ctl(stream->epoll_fd, EPOLL_CTL_ADD, stream->stop_fd, &ev))
+		goto fail;
+#endif
+
 	UNUSED_PARAMETER(settings);
 	return stream;
 
@@ -235,8 +374,10 @@ static void rtmp_stream_stop(void *data, uint64_t ts)
 	os_event_signal(stream->stop_event);
 
 	if (active(stream)) {
-		if (stream->stop_ts == 0)
+		if (stream->stop_ts == 0) {
+			signal_stop_fd(stream);
 			os_sem_post(stream->send_sem);
+		}
 	}
 }
 
@@ -255,14 +396,19 @@ static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
 }
 
 static inline bool get_next_packet(struct rtmp_stream *stream,
-		struct encoder_packet *packet)
+		struct encoder_packet *packet, uint64_t *queued_ns)
 {
+	struct circlebuf *queue;
 	bool new_packet = false;
 
 	pthread_mutex_lock(&stream->packets_mutex);
-	if (stream->packets.size) {
-		circlebuf_pop_front(&stream->packets, packet,
-				sizeof(struct encoder_packet));
+	queue = front_queue(stream);
+	if (queue) {
+		struct queued_packet item;
+		circlebuf_pop_front(queue, &item, sizeof(item));
+		*packet = item.packet;
+		*queued_ns = item.queued_ns;
+		stream->num_packets--;
 		new_packet = true;
 	}
 	pthread_mutex_unlock(&stream->packets_mutex);
@@ -295,6 +441,10 @@ static bool discard_recv_data(struct rtmp_stream *stream, size_t size)
 			int error = WSAGetLastError();
 #else
 			int error = errno;
+
+			/* nothing left to read on a non-blocking socket */
+			if (ret < 0 && (error == EAGAIN || error == EWOULDBLOCK))
+				return true;
 #endif
 			if (ret < 0) {
 				do_log(LOG_ERROR, "recv error: %d (%d bytes)",
@@ -341,13 +491,20 @@ static void droptest_cap_data_rate(struct rtmp_stream *stream, size_t size)
 }
 #endif
 
-static int send_packet(struct rtmp_stream *stream,
-		struct encoder_packet *packet, bool is_header, size_t idx)
+/* the server only sends the occasional acknowledgement while publishing, so
+ * there is no need to spend a syscall on checking for it with every packet */
+#define RECV_CHECK_INTERVAL_NS 100000000ULL
+
+static bool check_recv_data(struct rtmp_stream *stream)
 {
-	uint8_t *data;
-	size_t  size;
-	int     recv_size = 0;
-	int     ret = 0;
+	uint64_t ts = os_gettime_ns();
+	int      recv_size = 0;
+	int      ret;
+
+	if (ts < stream->next_recv_check_ns)
+		return true;
+
+	stream->next_recv_check_ns = ts + RECV_CHECK_INTERVAL_NS;
 
 #ifdef _WIN32
 	ret = ioctlsocket(stream->rtmp.m_sb.sb_socket, FIONREAD,
@@ -356,19 +513,44 @@ static int send_packet(struct rtmp_stream *stream,
 	ret = ioctl(stream->rtmp.m_sb.sb_socket, FIONREAD, &recv_size);
 #endif
 
-	if (ret >= 0 && recv_size > 0) {
-		if (!discard_recv_data(stream, (size_t)recv_size))
-			return -1;
-	}
+	if (ret >= 0 && recv_size > 0)
+		return discard_recv_data(stream, (size_t)recv_size);
 
-	flv_packet_mux(packet, &data, &size, is_header);
+	return true;
+}
+
+static int send_packet(struct rtmp_stream *stream,
+		struct encoder_packet *packet, bool is_header, size_t idx)
+{
+	uint8_t  header[FLV_MAX_BODY_HEADER_SIZE];
+	size_t   header_size;
+	size_t   size = 0;
+	uint8_t  type;
+	uint32_t time_ms;
+	int      ret = 0;
+
+	if (!check_recv_data(stream))
+		return -1;
+
+	/* the packet data is sent as-is, only the few bytes of codec info
+	 * that precede it in the tag body are generated here */
+	if (packet->data && packet->size) {
+		header_size = flv_packet_body_header(packet, header, is_header);
+		size = FLV_TAG_OVERHEAD + header_size + packet->size;
+
+		type = packet->type == OBS_ENCODER_VIDEO ?
+			RTMP_PACKET_TYPE_VIDEO : RTMP_PACKET_TYPE_AUDIO;
+		time_ms = get_ms_time(packet, packet->dts) & 0x7FFFFFFF;
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char*)data, (int)size, (int)idx);
-	bfree(data);
+		ret = RTMP_WriteTag(&stream->rtmp, type, time_ms,
+				(const char*)header, (int)header_size,
+				(const char*)packet->data, (int)packet->size,
+				(int)idx) ? (int)size : -1;
+	}
 
 	obs_free_encoder_packet(packet);
 
@@ -378,6 +560,113 @@ static int send_packet(struct rtmp_stream *stream,
 
 static inline bool send_headers(struct rtmp_stream *stream);
 
+static inline int get_encoder_bitrate(obs_encoder_t *encoder)
+{
+	obs_data_t *settings = obs_encoder_get_settings(encoder);
+	int bitrate = (int)obs_data_get_int(settings, "bitrate");
+
+	obs_data_release(settings);
+	return bitrate;
+}
+
+static void dbr_init(struct rtmp_stream *stream)
+{
+	obs_output_t  *context  = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
+	obs_encoder_t *aencoder;
+	int           audio_kbps = 0;
+
+	stream->dbr_paused    = false;
+	stream->dbr_orig_kbps = vencoder ? get_encoder_bitrate(vencoder) : 0;
+	if (stream->dbr_orig_kbps <= 0) {
+		warn("Dynamic bitrate disabled, the video encoder has no "
+		     "bitrate setting");
+		stream->dbr_enabled = false;
+		return;
+	}
+
+	for (size_t idx = 0;
+	     (aencoder = obs_output_get_audio_encoder(context, idx)) != NULL;
+	     idx++)
+		audio_kbps += get_encoder_bitrate(aencoder);
+
+	/* start lowering the bitrate well before frames would be dropped */
+	bitrate_control_init(&stream->dbr, stream->dbr_orig_kbps, audio_kbps,
+			stream->drop_threshold_usec / 2);
+}
+
+static void dbr_set_bitrate(struct rtmp_stream *stream, int kbps)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t    *settings;
+
+	if (get_encoder_bitrate(vencoder) == kbps)
+		return;
+
+	settings = obs_data_create();
+	obs_data_set_int(settings, "bitrate", kbps);
+	obs_encoder_update(vencoder, settings);
+	obs_data_release(settings);
+}
+
+/* a recording can share the video encoder with the stream, and it should not
+ * get the stream's bitrate changes */
+static bool dbr_encoder_shared(struct rtmp_stream *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	bool          shared = obs_encoder_get_active_output_count(vencoder) > 1;
+
+	if (shared && !stream->dbr_paused) {
+		warn("Dynamic bitrate paused, the video encoder is shared with "
+		     "another output");
+		dbr_set_bitrate(stream, stream->dbr_orig_kbps);
+		stream->dbr_paused = true;
+
+	} else if (!shared && stream->dbr_paused) {
+		info("Dynamic bitrate resumed");
+		dbr_init(stream);
+	}
+
+	return shared;
+}
+
+static void dbr_update(struct rtmp_stream *stream)
+{
+	struct circlebuf *queue;
+	int64_t queue_usec = 0;
+	int kbps;
+
+	if (dbr_encoder_shared(stream))
+		return;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	queue = front_queue(stream);
+	if (queue) {
+		struct queued_packet *first = circlebuf_data(queue, 0);
+		queue_usec = stream->last_dts_usec - first->packet.dts_usec;
+	}
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	kbps = bitrate_control_update(&stream->dbr, os_gettime_ns(),
+			stream->total_bytes_sent, queue_usec);
+	if (!kbps)
+		return;
+
+	info("Send queue at %d ms, changing video bitrate to %d kbps",
+			(int)(queue_usec / 1000), kbps);
+	dbr_set_bitrate(stream, kbps);
+}
+
+static inline void update_send_latency(struct rtmp_stream *stream,
+		uint64_t queued_ns)
+{
+	long usec = (long)((os_gettime_ns() - queued_ns) / 1000);
+	long prev = os_atomic_load_long(&stream->send_latency_usec);
+
+	os_atomic_set_long(&stream->send_latency_usec,
+			prev ? prev + (usec - prev) / 8 : usec);
+}
+
 static void *send_thread(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -386,12 +675,13 @@ static void *send_thread(void *data)
 
 	while (os_sem_wait(stream->send_sem) == 0) {
 		struct encoder_packet packet;
+		uint64_t queued_ns;
 
 		if (stopping(stream) && stream->stop_ts == 0) {
 			break;
 		}
 
-		if (!get_next_packet(stream, &packet))
+		if (!get_next_packet(stream, &packet, &queued_ns))
 			continue;
 
 		if (stopping(stream)) {
@@ -412,8 +702,16 @@ static void *send_thread(void *data)
 			os_atomic_set_bool(&stream->disconnected, true);
 			break;
 		}
+
+		update_send_latency(stream, queued_ns);
+
+		if (stream->dbr_enabled)
+			dbr_update(stream);
 	}
 
+	if (stream->dbr_enabled)
+		dbr_set_bitrate(stream, stream->dbr_orig_kbps);
+
 	if (disconnected(stream)) {
 		info("Disconnected from %s", stream->path.array);
 	} else {
@@ -430,6 +728,7 @@ static void *send_thread(void *data)
 	}
 
 	free_packets(stream);
+	os_atomic_set_long(&stream->send_latency_usec, 0);
 	os_event_reset(stream->stop_event);
 	os_atomic_set_bool(&stream->active, false);
 	stream->sent_headers = false;
@@ -540,6 +839,89 @@ static void adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
 	}
 }
 
+#ifdef __linux__
+#ifndef TCP_NOTSENT_LOWAT
+#define TCP_NOTSENT_LOWAT 25
+#endif
+
+/* let the kernel hold about this much unsent data */
+#define NOTSENT_LOWAT_MSEC 50
+#define MIN_NOTSENT_LOWAT  16384
+
+static int wait_writable(RTMPSockBuf *sb, void *param)
+{
+	struct rtmp_stream *stream = param;
+	struct epoll_event events[2];
+	int                n;
+
+	UNUSED_PARAMETER(sb);
+
+	do {
+		n = epoll_wait(stream->epoll_fd, events, 2, -1);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0)
+		return false;
+
+	for (int i = 0; i < n; i++) {
+		if (events[i].data.fd == stream->stop_fd)
+			return false;
+	}
+
+	/* writable, or an error that the next send will report */
+	return true;
+}
+
+static void enable_low_latency_mode(struct rtmp_stream *stream)
+{
+	RTMP          *rtmp     = &stream->rtmp;
+	obs_output_t  *context  = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
+	obs_encoder_t *aencoder;
+	struct epoll_event ev   = {.events = EPOLLOUT};
+	int           kbps      = vencoder ? get_encoder_bitrate(vencoder) : 0;
+	int           lowat;
+	int           flags;
+
+	if (rtmp->m_sb.sb_ssl || (rtmp->Link.protocol & RTMP_FEATURE_HTTP)) {
+		warn("Low latency mode is not supported for this connection");
+		return;
+	}
+
+	for (size_t idx = 0;
+	     (aencoder = obs_output_get_audio_encoder(context, idx)) != NULL;
+	     idx++)
+		kbps += get_encoder_bitrate(aencoder);
+
+	lowat = kbps * 1000 / 8 * NOTSENT_LOWAT_MSEC / 1000;
+	if (lowat < MIN_NOTSENT_LOWAT)
+		lowat = MIN_NOTSENT_LOWAT;
+
+	if (setsockopt(rtmp->m_sb.sb_socket, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+				&lowat, sizeof(lowat)) != 0) {
+		warn("Low latency mode: failed to set TCP_NOTSENT_LOWAT: %d",
+				errno);
+		return;
+	}
+
+	ev.data.fd = rtmp->m_sb.sb_socket;
+	flags = fcntl(rtmp->m_sb.sb_socket, F_GETFL, 0);
+
+	if (flags == -1 ||
+	    epoll_ctl(stream->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) ||
+	    fcntl(rtmp->m_sb.sb_socket, F_SETFL, flags | O_NONBLOCK)) {
+		warn("Low latency mode: failed to set up the socket: %d",
+				errno);
+		return;
+	}
+
+	rtmp->m_waitWritableFunc  = wait_writable;
+	rtmp->m_waitWritableParam = stream;
+
+	info("Low latency mode enabled, TCP_NOTSENT_LOWAT: %d bytes", lowat);
+}
+#endif
+
 static int init_send(struct rtmp_stream *stream)
 {
 	int ret;
@@ -552,6 +934,17 @@ static int init_send(struct rtmp_stream *stream)
 
 	reset_semaphore(stream);
 
+	stream->rtmp.m_waitWritableFunc  = NULL;
+	stream->rtmp.m_waitWritableParam = NULL;
+
+#ifdef __linux__
+	if (stream->low_latency_mode)
+		enable_low_latency_mode(stream);
+#endif
+
+	if (stream->dbr_enabled)
+		dbr_init(stream);
+
 	ret = pthread_create(&stream->send_thread, NULL, send_thread, stream);
 	if (ret != 0) {
 		RTMP_Close(&stream->rtmp);
@@ -714,6 +1107,7 @@ static bool init_connect(struct rtmp_stream *stream)
 	os_atomic_set_bool(&stream->disconnected, false);
 	stream->total_bytes_sent = 0;
 	stream->dropped_frames   = 0;
+	stream->next_recv_check_ns = 0;
 	stream->min_drop_dts_usec= 0;
 	stream->min_priority     = 0;
 
@@ -738,6 +1132,10 @@ static bool init_connect(struct rtmp_stream *stream)
 	bind_ip = obs_data_get_string(settings, OPT_BIND_IP);
 	dstr_copy(&stream->bind_ip, bind_ip);
 
+	stream->dbr_enabled = obs_data_get_bool(settings, OPT_DYN_BITRATE);
+	stream->low_latency_mode =
+		obs_data_get_bool(settings, OPT_LOWLATENCY_ENABLED);
+
 	obs_data_release(settings);
 	return true;
 }
@@ -754,7 +1152,16 @@ static void *connect_thread(void *data)
 		return NULL;
 	}
 
-	ret = try_connect(stream);
+	/* clear the stop signal of the last session before connecting, so a
+	 * stop signalled from here on is never lost */
+	reset_stop_fd(stream);
+
+	if (stopping(stream)) {
+		info("Stopped before connecting");
+		ret = OBS_OUTPUT_SUCCESS;
+	} else {
+		ret = try_connect(stream);
+	}
 
 	if (ret != OBS_OUTPUT_SUCCESS) {
 		obs_output_signal_stop(stream->output, ret);
@@ -785,22 +1192,20 @@ static bool rtmp_stream_start(void *data)
 static inline bool add_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet)
 {
-	circlebuf_push_back(&stream->packets, packet,
-			sizeof(struct encoder_packet));
+	struct queued_packet item = {*packet, stream->next_seq++,
+		os_gettime_ns()};
+
+	circlebuf_push_back(&stream->packets[packet_queue_idx(packet)], &item,
+			sizeof(item));
+	stream->num_packets++;
 	stream->last_dts_usec = packet->dts_usec;
 	return true;
 }
 
-static inline size_t num_buffered_packets(struct rtmp_stream *stream)
-{
-	return stream->packets.size / sizeof(struct encoder_packet);
-}
-
 static void drop_frames(struct rtmp_stream *stream, const char *name,
 		int highest_priority, int64_t *p_min_dts_usec)
 {
-	struct circlebuf new_buf            = {0};
-	uint64_t         last_drop_dts_usec = 0;
+	uint64_t         start_time         = os_gettime_ns();
 	int              num_frames_dropped = 0;
 
 #ifdef _DEBUG
@@ -809,34 +1214,34 @@ static void drop_frames(struct rtmp_stream *stream, const char *name,
 	UNUSED_PARAMETER(name);
 #endif
 
-	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
-
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-
-		last_drop_dts_usec = packet.dts_usec;
-
-		/* do not drop audio data or video keyframes */
-		if (packet.type          == OBS_ENCODER_AUDIO ||
-		    packet.drop_priority >= highest_priority) {
-			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
-
-		} else {
+	/* do not drop audio data or video keyframes; only the queues below
+	 * the priority are touched, so this costs nothing for the packets
+	 * that are kept */
+	for (int priority = OBS_NAL_PRIORITY_DISPOSABLE;
+	     priority < highest_priority && priority <= OBS_NAL_PRIORITY_HIGHEST;
+	     priority++) {
+		struct circlebuf *queue =
+			&stream->packets[AUDIO_QUEUE + 1 + priority];
+
+		while (queue->size) {
+			struct queued_packet item;
+			circlebuf_pop_front(queue, &item, sizeof(item));
+			obs_free_encoder_packet(&item.packet);
 			num_frames_dropped++;
-			obs_free_encoder_packet(&packet);
 		}
 	}
 
-	circlebuf_free(&stream->packets);
-	stream->packets = new_buf;
+	stream->num_packets -= num_frames_dropped;
 
 	if (stream->min_priority < highest_priority)
 		stream->min_priority = highest_priority;
 
-	*p_min_dts_usec = last_drop_dts_usec;
+	/* the last buffered packet is always the last one added */
+	*p_min_dts_usec = stream->last_dts_usec;
 
 	stream->dropped_frames += num_frames_dropped;
+	profile_record("rtmp_stream: drop_frames", start_time,
+			os_gettime_ns());
 #ifdef _DEBUG
 	debug("Dropped %s, prev packet count: %d, new packet count: %d",
 			name,
@@ -847,7 +1252,7 @@ static void drop_frames(struct rtmp_stream *stream, const char *name,
 
 static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 {
-	struct encoder_packet first;
+	struct queued_packet *first;
 	int64_t buffer_duration_usec;
 	size_t num_packets = num_buffered_packets(stream);
 	const char *name = pframes ? "p-frames" : "b-frames";
@@ -863,15 +1268,15 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 	if (num_packets < 5)
 		return;
 
-	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
+	first = circlebuf_data(front_queue(stream), 0);
 
 	/* do not drop frames if frames were just dropped within this time */
-	if (first.dts_usec < *p_min_dts_usec)
+	if (first->packet.dts_usec < *p_min_dts_usec)
 		return;
 
 	/* if the amount of time stored in the buffered packets waiting to be
 	 * sent is higher than threshold, drop frames */
-	buffer_duration_usec = stream->last_dts_usec - first.dts_usec;
+	buffer_duration_usec = stream->last_dts_usec - first->packet.dts_usec;
 
 	if (buffer_duration_usec > drop_threshold) {
 		debug("buffer_duration_usec: %lld", buffer_duration_usec);
@@ -879,11 +1284,28 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 	}
 }
 
+static void record_buffer_duration(struct rtmp_stream *stream)
+{
+	struct circlebuf *queue = front_queue(stream);
+	struct queued_packet *first;
+
+	if (!queue)
+		return;
+
+	/* recorded as a duration so the profiler reports the send queue
+	 * depth in the same terms the drop thresholds use */
+	first = circlebuf_data(queue, 0);
+	profile_record("rtmp_stream: send queue duration",
+			(uint64_t)first->packet.dts_usec * 1000,
+			(uint64_t)stream->last_dts_usec * 1000);
+}
+
 static bool add_video_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet)
 {
 	check_to_drop_frames(stream, false);
 	check_to_drop_frames(stream, true);
+	record_buffer_duration(stream);
 
 	/* if currently dropping frames, drop packets until it reaches the
 	 * desired priority */
@@ -933,6 +1355,8 @@ static void rtmp_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_int(defaults, OPT_PFRAME_DROP_THRESHOLD, 800);
 	obs_data_set_default_int(defaults, OPT_MAX_SHUTDOWN_TIME_SEC, 5);
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
+	obs_data_set_default_bool(defaults, OPT_DYN_BITRATE, false);
+	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
 }
 
 static obs_properties_t *rtmp_stream_properties(void *unused)
@@ -947,6 +1371,13 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 			obs_module_text("RTMPStream.DropThreshold"),
 			200, 10000, 100);
 
+	obs_properties_add_bool(props, OPT_DYN_BITRATE,
+			obs_module_text("RTMPStream.DynamicBitrate"));
+#ifdef __linux__
+	obs_properties_add_bool(props, OPT_LOWLATENCY_ENABLED,
+			obs_module_text("RTMPStream.LowLatencyMode"));
+#endif
+
 	p = obs_properties_add_list(props, OPT_BIND_IP,
 			obs_module_text("RTMPStream.BindIP"),
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
@@ -975,12 +1406,38 @@ static int rtmp_stream_dropped_frames(void *data)
 	return stream->dropped_frames;
 }
 
+static void rtmp_stream_get_stats(void *data, struct obs_output_stats *stats)
+{
+	struct rtmp_stream *stream = data;
+	struct circlebuf *queue;
+	int64_t queue_usec = 0;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	queue = front_queue(stream);
+	if (queue) {
+		struct queued_packet *first = circlebuf_data(queue, 0);
+		queue_usec = stream->last_dts_usec - first->packet.dts_usec;
+	}
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	/* 1.0 is the point where b-frames start getting dropped */
+	if (stream->drop_threshold_usec > 0 && queue_usec > 0) {
+		float congestion = (float)queue_usec /
+			(float)stream->drop_threshold_usec;
+		stats->congestion = congestion < 1.0f ? congestion : 1.0f;
+	}
+
+	stats->send_latency_ms = (double)os_atomic_load_long(
+			&stream->send_latency_usec) / 1000.0;
+}
+
 struct obs_output_info rtmp_output_info = {
 	.id                 = "rtmp_output",
 	.flags              = OBS_OUTPUT_AV |
 	                      OBS_OUTPUT_ENCODED |
 	                      OBS_OUTPUT_SERVICE |
-	                      OBS_OUTPUT_MULTI_TRACK,
+	                      OBS_OUTPUT_MULTI_TRACK |
+	                      OBS_OUTPUT_SHARED_PACKETS,
 	.get_name           = rtmp_stream_getname,
 	.create             = rtmp_stream_create,
 	.destroy            = rtmp_stream_destroy,
@@ -990,5 +1447,6 @@ struct obs_output_info rtmp_output_info = {
 	.get_defaults       = rtmp_stream_defaults,
 	.get_properties     = rtmp_stream_properties,
 	.get_total_bytes    = rtmp_stream_total_bytes_sent,
-	.get_dropped_frames = rtmp_stream_dropped_frames
+	.get_dropped_frames = rtmp_stream_dropped_frames,
+	.get_stats          = rtmp_stream_get_stats
 };
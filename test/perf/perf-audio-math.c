@@ -0,0 +1,189 @@
+/*
+ * Throughput of the audio math kernels against the scalar loops they
+ * replaced, over one second of 48 kHz audio (in 1024 frame ticks) for
+ * 8 channels and 6 mixes, with each available instruction set.
+ *
+ * usage: perf-audio-math [runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/platform.h>
+#include <media-io/audio-math.h>
+
+#define FRAMES   1024
+#define CHANNELS 8
+#define MIXES    6
+#define TICKS    ((48000 + FRAMES - 1) / FRAMES)
+
+enum op {
+	OP_ADD,
+	OP_ADD_MUL,
+	OP_MUL,
+	OP_MUL_SCALAR,
+	OP_CLAMP,
+	OP_SUM_SQUARES_MAX,
+	OP_COUNT
+};
+
+static const char *op_names[] = {
+	"audio_add",
+	"audio_add_mul",
+	"audio_mul",
+	"audio_mul_scalar",
+	"audio_clamp",
+	"audio_sum_squares_max"
+};
+
+static const char *isa_names[] = {"SSE2", "AVX"};
+
+static float mix_planes[MIXES][CHANNELS][FRAMES];
+static float src_planes[MIXES][CHANNELS][FRAMES];
+static float vol[FRAMES];
+static volatile float sink;
+
+/* the loops in obs-audio.c, obs-source.c, obs-scene.c and audio-io.c before
+ * they used audio-math */
+
+static void add_scalar(float *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i];
+}
+
+static void add_mul_scalar(float *dst, const float *src,
+		const float *mul, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i] * mul[i];
+}
+
+static void mul_scalar(float *dst, const float *mul, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] *= mul[i];
+}
+
+static void mul_scalar_scalar(float *dst, float mul, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] *= mul;
+}
+
+static void clamp_scalar(float *dst, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = dst[i];
+		if (val > 1.0f)       val = 1.0f;
+		else if (val < -1.0f) val = -1.0f;
+		dst[i] = val;
+	}
+}
+
+static void sum_squares_max_scalar(const float *src, size_t count,
+		float *sum, float *max)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = src[i] * src[i];
+		*sum += val;
+		if (val > *max)
+			*max = val;
+	}
+}
+
+static void run_plane(enum op op, bool simd, float *dst, const float *src)
+{
+	float sum = 0.0f, max = 0.0f;
+
+	switch (op) {
+	case OP_ADD:
+		if (simd) audio_add(dst, src, FRAMES);
+		else      add_scalar(dst, src, FRAMES);
+		break;
+	case OP_ADD_MUL:
+		if (simd) audio_add_mul(dst, src, vol, FRAMES);
+		else      add_mul_scalar(dst, src, vol, FRAMES);
+		break;
+	case OP_MUL:
+		if (simd) audio_mul(dst, vol, FRAMES);
+		else      mul_scalar(dst, vol, FRAMES);
+		break;
+	case OP_MUL_SCALAR:
+		if (simd) audio_mul_scalar(dst, 0.999f, FRAMES);
+		else      mul_scalar_scalar(dst, 0.999f, FRAMES);
+		break;
+	case OP_CLAMP:
+		if (simd) audio_clamp(dst, FRAMES);
+		else      clamp_scalar(dst, FRAMES);
+		break;
+	case OP_SUM_SQUARES_MAX:
+		if (simd) audio_sum_squares_max(src, FRAMES, &sum, &max);
+		else      sum_squares_max_scalar(src, FRAMES, &sum, &max);
+		sink = sum + max;
+		break;
+	case OP_COUNT:
+		break;
+	}
+}
+
+/* returns the best time in microseconds for one second of audio */
+static double time_op(enum op op, bool simd, int runs)
+{
+	uint64_t best = 0;
+
+	for (int run = 0; run < runs; run++) {
+		uint64_t start = os_gettime_ns();
+		uint64_t elapsed;
+
+		for (int tick = 0; tick < TICKS; tick++)
+			for (int mix = 0; mix < MIXES; mix++)
+				for (int ch = 0; ch < CHANNELS; ch++)
+					run_plane(op, simd,
+						mix_planes[mix][ch],
+						src_planes[mix][ch]);
+
+		elapsed = os_gettime_ns() - start;
+		if (!best || elapsed < best)
+			best = elapsed;
+	}
+
+	return (double)best / 1000.0;
+}
+
+int main(int argc, char *argv[])
+{
+	int runs = argc > 1 ? atoi(argv[1]) : 50;
+
+	if (runs < 1)
+		runs = 1;
+
+	srand(1);
+	for (size_t i = 0; i < FRAMES; i++)
+		vol[i] = 0.9995f + (float)rand() / RAND_MAX * 0.001f;
+	for (size_t mix = 0; mix < MIXES; mix++)
+		for (size_t ch = 0; ch < CHANNELS; ch++)
+			for (size_t i = 0; i < FRAMES; i++)
+				src_planes[mix][ch][i] = mix_planes[mix][ch][i]
+					= (float)rand() / RAND_MAX * 2.5f - 1.25f;
+
+	printf("48 kHz x %d channels x %d mixes, %d ticks, best of %d, "
+	       "usec per second of audio\n", CHANNELS, MIXES, TICKS, runs);
+	printf("%-22s %8s %8s %8s\n", "", "scalar",
+			isa_names[0], isa_names[1]);
+
+	for (int op = 0; op < OP_COUNT; op++) {
+		printf("%-22s %8.1f", op_names[op], time_op(op, false, runs));
+
+		for (size_t i = 0; i < sizeof(isa_names)/sizeof(isa_names[0]);
+				i++) {
+			if (audio_math_set_isa(isa_names[i]))
+				printf(" %8.1f", time_op(op, true, runs));
+			else
+				printf(" %8s", "n/a");
+		}
+
+		printf("\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,274 @@
+/*
+ * Load, lookup, apply and save times for a synthetic scene collection of
+ * image sources (5000 by default) spread over scenes of 100 items each,
+ * with the keys and nesting that obs_save_source/obs_scene save.  Pass a
+ * path to also write the generated collection there.
+ *
+ * usage: perf-data-load [sources] [output.json]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <obs-data.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define ITEMS_PER_SCENE 100
+#define RUNS 7
+
+static const char *source_keys[] = {
+	"balance", "deinterlace_field_order", "deinterlace_mode", "enabled",
+	"flags", "id", "mixers", "monitoring_type", "muted", "name",
+	"prev_ver", "push-to-mute", "push-to-mute-delay", "push-to-talk",
+	"push-to-talk-delay", "sync", "volume"
+};
+
+static void set_vec2(obs_data_t *data, const char *name, double x, double y)
+{
+	obs_data_t *vec = obs_data_create();
+	obs_data_set_double(vec, "x", x);
+	obs_data_set_double(vec, "y", y);
+	obs_data_set_obj(data, name, vec);
+	obs_data_release(vec);
+}
+
+static obs_data_t *generate_source(size_t idx)
+{
+	obs_data_t *source = obs_data_create();
+	obs_data_t *settings = obs_data_create();
+	obs_data_t *hotkeys = obs_data_create();
+	obs_data_t *private_settings = obs_data_create();
+	obs_data_array_t *filters = obs_data_array_create();
+	static const char *hotkey_names[] = {
+		"libobs.mute", "libobs.unmute",
+		"libobs.push-to-mute", "libobs.push-to-talk"
+	};
+	struct dstr str = {0};
+
+	dstr_printf(&str, "/tmp/image%d.png", (int)idx);
+	obs_data_set_string(settings, "file", str.array);
+	obs_data_set_bool(settings, "unload", false);
+	obs_data_set_int(settings, "width", 1920);
+	obs_data_set_int(settings, "height", 1080);
+	obs_data_set_int(settings, "color", 0xFFFFFFFF);
+	obs_data_set_int(settings, "opacity", 100);
+
+	for (size_t i = 0; i < 4; i++) {
+		obs_data_array_t *bindings = obs_data_array_create();
+		obs_data_set_array(hotkeys, hotkey_names[i], bindings);
+		obs_data_array_release(bindings);
+	}
+
+	dstr_printf(&str, "Source %d", (int)idx);
+	obs_data_set_string(source, "name", str.array);
+	obs_data_set_string(source, "id", "image_source");
+	obs_data_set_double(source, "balance", 0.5);
+	obs_data_set_int(source, "deinterlace_field_order", 0);
+	obs_data_set_int(source, "deinterlace_mode", 0);
+	obs_data_set_bool(source, "enabled", true);
+	obs_data_set_int(source, "flags", 0);
+	obs_data_set_int(source, "mixers", 0xFF);
+	obs_data_set_int(source, "monitoring_type", 0);
+	obs_data_set_bool(source, "muted", false);
+	obs_data_set_int(source, "prev_ver", 352321538);
+	obs_data_set_bool(source, "push-to-mute", false);
+	obs_data_set_int(source, "push-to-mute-delay", 0);
+	obs_data_set_bool(source, "push-to-talk", false);
+	obs_data_set_int(source, "push-to-talk-delay", 0);
+	obs_data_set_int(source, "sync", 0);
+	obs_data_set_double(source, "volume", 1.0);
+	obs_data_set_obj(source, "settings", settings);
+	obs_data_set_obj(source, "hotkeys", hotkeys);
+	obs_data_set_obj(source, "private_settings", private_settings);
+	obs_data_set_array(source, "filters", filters);
+
+	obs_data_array_release(filters);
+	obs_data_release(private_settings);
+	obs_data_release(hotkeys);
+	obs_data_release(settings);
+	dstr_free(&str);
+	return source;
+}
+
+static obs_data_t *generate_scene(size_t idx, size_t first, size_t count)
+{
+	obs_data_t *scene = obs_data_create();
+	obs_data_t *settings = obs_data_create();
+	obs_data_array_t *items = obs_data_array_create();
+	struct dstr str = {0};
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_create();
+
+		dstr_printf(&str, "Source %d", (int)(first + i));
+		obs_data_set_string(item, "name", str.array);
+		obs_data_set_int(item, "id", (long long)i + 1);
+		obs_data_set_bool(item, "visible", true);
+		obs_data_set_bool(item, "locked", false);
+		obs_data_set_double(item, "rot", 0.0);
+		set_vec2(item, "pos", 0.0, 0.0);
+		set_vec2(item, "scale", 1.0, 1.0);
+		obs_data_set_int(item, "align", 5);
+		obs_data_set_int(item, "bounds_type", 0);
+		obs_data_set_int(item, "bounds_align", 0);
+		set_vec2(item, "bounds", 0.0, 0.0);
+		obs_data_set_int(item, "crop_left", 0);
+		obs_data_set_int(item, "crop_top", 0);
+		obs_data_set_int(item, "crop_right", 0);
+		obs_data_set_int(item, "crop_bottom", 0);
+		obs_data_set_string(item, "scale_filter", "disable");
+
+		obs_data_array_push_back(items, item);
+		obs_data_release(item);
+	}
+
+	obs_data_set_array(settings, "items", items);
+	obs_data_set_int(settings, "id_counter", (long long)count);
+
+	dstr_printf(&str, "Scene %d", (int)idx);
+	obs_data_set_string(scene, "name", str.array);
+	obs_data_set_string(scene, "id", "scene");
+	obs_data_set_obj(scene, "settings", settings);
+
+	obs_data_array_release(items);
+	obs_data_release(settings);
+	dstr_free(&str);
+	return scene;
+}
+
+static obs_data_t *generate_collection(size_t num_sources)
+{
+	obs_data_t *collection = obs_data_create();
+	obs_data_array_t *sources = obs_data_array_create();
+	obs_data_array_t *scene_order = obs_data_array_create();
+	size_t num_scenes = 0;
+
+	for (size_t i = 0; i < num_sources; i++) {
+		obs_data_t *source = generate_source(i);
+		obs_data_array_push_back(sources, source);
+		obs_data_release(source);
+	}
+
+	for (size_t i = 0; i < num_sources; i += ITEMS_PER_SCENE) {
+		size_t count = num_sources - i < ITEMS_PER_SCENE ?
+			num_sources - i : ITEMS_PER_SCENE;
+		obs_data_t *scene = generate_scene(num_scenes, i, count);
+		obs_data_t *order = obs_data_create();
+
+		obs_data_set_string(order, "name",
+				obs_data_get_string(scene, "name"));
+		obs_data_array_push_back(scene_order, order);
+		obs_data_array_push_back(sources, scene);
+
+		obs_data_release(order);
+		obs_data_release(scene);
+		num_scenes++;
+	}
+
+	obs_data_set_string(collection, "name", "Benchmark");
+	obs_data_set_string(collection, "current_scene", "Scene 0");
+	obs_data_set_array(collection, "sources", sources);
+	obs_data_set_array(collection, "scene_order", scene_order);
+
+	obs_data_array_release(scene_order);
+	obs_data_array_release(sources);
+	return collection;
+}
+
+struct times {
+	uint64_t load;
+	uint64_t get;
+	uint64_t apply;
+	uint64_t save;
+};
+
+static inline void keep_best(uint64_t *best, uint64_t val)
+{
+	if (!*best || val < *best)
+		*best = val;
+}
+
+static void run(const char *json, struct times *best, long long *sink)
+{
+	uint64_t t0 = os_gettime_ns();
+	obs_data_t *data = obs_data_create_from_json(json);
+	uint64_t t1 = os_gettime_ns();
+	obs_data_array_t *sources = obs_data_get_array(data, "sources");
+	size_t count = obs_data_array_count(sources);
+	uint64_t t2, t3, t4;
+
+	/* each source's keys are read several times while loading */
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *source = obs_data_array_item(sources, i);
+
+		for (size_t pass = 0; pass < 4; pass++)
+			for (size_t k = 0; k < sizeof(source_keys) /
+					sizeof(source_keys[0]); k++)
+				*sink += obs_data_get_int(source,
+						source_keys[k]);
+
+		obs_data_release(source);
+	}
+	t2 = os_gettime_ns();
+
+	/* settings are applied on creation and again on update */
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *source = obs_data_array_item(sources, i);
+		obs_data_t *copy = obs_data_create();
+
+		obs_data_apply(copy, source);
+		obs_data_apply(copy, source);
+
+		obs_data_release(copy);
+		obs_data_release(source);
+	}
+	t3 = os_gettime_ns();
+
+	*sink += (long long)strlen(obs_data_get_json(data));
+	t4 = os_gettime_ns();
+
+	obs_data_array_release(sources);
+	obs_data_release(data);
+
+	keep_best(&best->load,  t1 - t0);
+	keep_best(&best->get,   t2 - t1);
+	keep_best(&best->apply, t3 - t2);
+	keep_best(&best->save,  t4 - t3);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t num_sources = argc > 1 ?
+		(size_t)strtoul(argv[1], NULL, 10) : 5000;
+	const char *output = argc > 2 ? argv[2] : NULL;
+	struct times best = {0};
+	long long sink = 0;
+	obs_data_t *collection;
+	char *json;
+
+	collection = generate_collection(num_sources);
+	json = bstrdup(obs_data_get_json(collection));
+	obs_data_release(collection);
+
+	if (output && !os_quick_write_utf8_file(output, json, strlen(json),
+				false)) {
+		fprintf(stderr, "Could not write '%s'\n", output);
+		bfree(json);
+		return 1;
+	}
+
+	printf("%d sources, %.1f MB json, best of %d runs\n",
+			(int)num_sources,
+			(double)strlen(json) / (1024.0 * 1024.0), RUNS);
+
+	for (int i = 0; i < RUNS; i++)
+		run(json, &best, &sink);
+
+	printf("load json  %8.2f ms\n", (double)best.load  / 1000000.0);
+	printf("get        %8.2f ms\n", (double)best.get   / 1000000.0);
+	printf("apply      %8.2f ms\n", (double)best.apply / 1000000.0);
+	printf("save json  %8.2f ms\n", (double)best.save  / 1000000.0);
+
+	bfree(json);
+	return sink == 1 ? 1 : 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * Load time, peak memory and video tick times of animated gifs played
+ * through gs_image_file_*, the way the image source does at 60 fps.  Each
+ * case generates a looping gif (a full first frame, then a 256x256 block
+ * that moves every frame, 20 ms per frame) and plays it in its own process
+ * so that peak memory is per case.  There's no graphics context, so texture
+ * uploads are skipped.
+ *
+ * The default cases cover a gif that is cached in full, and two that are
+ * too large for that and are decoded ahead on a thread instead.
+ *
+ * usage: perf-gif-playback [seconds] [width height frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <graphics/image-file.h>
+#include <util/platform.h>
+#include <util/base.h>
+
+#define GIF_PATH      "perf-gif-playback.gif"
+#define TICK_NS       16666667ULL
+#define BLOCK_SIZE    256
+
+struct test_case {
+	int width;
+	int height;
+	int frames;
+};
+
+static const struct test_case default_cases[] = {
+	{640,  360,  100},
+	{1280, 720,  300},
+	{1920, 1080, 500}
+};
+
+/* ------------------------------------------------------------------------- */
+/* gif writer: 8 bit codes with a clear code every 254, so no lzw needed */
+
+struct gif_writer {
+	FILE     *file;
+	uint8_t  block[255];
+	int      block_len;
+	uint32_t bits;
+	int      bit_count;
+};
+
+static void put16(struct gif_writer *gw, int val)
+{
+	fputc(val & 0xFF, gw->file);
+	fputc(val >> 8, gw->file);
+}
+
+static void flush_block(struct gif_writer *gw)
+{
+	if (!gw->block_len)
+		return;
+
+	fputc(gw->block_len, gw->file);
+	fwrite(gw->block, 1, gw->block_len, gw->file);
+	gw->block_len = 0;
+}
+
+static void put_byte(struct gif_writer *gw, uint8_t val)
+{
+	gw->block[gw->block_len++] = val;
+	if (gw->block_len == sizeof(gw->block))
+		flush_block(gw);
+}
+
+static void put_code(struct gif_writer *gw, uint32_t code)
+{
+	gw->bits |= code << gw->bit_count;
+	gw->bit_count += 9;
+
+	while (gw->bit_count >= 8) {
+		put_byte(gw, (uint8_t)gw->bits);
+		gw->bits >>= 8;
+		gw->bit_count -= 8;
+	}
+}
+
+static void write_image(struct gif_writer *gw, int x, int y, int cx, int cy,
+		int seed)
+{
+	int codes = 0;
+
+	/* graphic control: 20 ms, keep the previous frame */
+	fputc(0x21, gw->file);
+	fputc(0xF9, gw->file);
+	fputc(4, gw->file);
+	fputc(1 << 2, gw->file);
+	put16(gw, 2);
+	fputc(0, gw->file);
+	fputc(0, gw->file);
+
+	fputc(0x2C, gw->file);
+	put16(gw, x);
+	put16(gw, y);
+	put16(gw, cx);
+	put16(gw, cy);
+	fputc(0, gw->file);
+	fputc(8, gw->file);
+
+	gw->bits = 0;
+	gw->bit_count = 0;
+	gw->block_len = 0;
+
+	put_code(gw, 256);
+	for (int j = 0; j < cy; j++) {
+		for (int i = 0; i < cx; i++) {
+			put_code(gw, (uint8_t)((i + j) / 8 + seed));
+			if (++codes == 254) {
+				put_code(gw, 256);
+				codes = 0;
+			}
+		}
+	}
+	put_code(gw, 257);
+
+	if (gw->bit_count)
+		put_byte(gw, (uint8_t)gw->bits);
+	flush_block(gw);
+	fputc(0, gw->file);
+}
+
+static bool write_gif(const char *path, const struct test_case *tc)
+{
+	struct gif_writer gw = {0};
+
+	gw.file = fopen(path, "wb");
+	if (!gw.file)
+		return false;
+
+	fwrite("GIF89a", 1, 6, gw.file);
+	put16(&gw, tc->width);
+	put16(&gw, tc->height);
+	fputc(0xF7, gw.file);
+	fputc(0, gw.file);
+	fputc(0, gw.file);
+
+	for (int i = 0; i < 256; i++) {
+		fputc(i, gw.file);
+		fputc(255 - i, gw.file);
+		fputc(i * 7, gw.file);
+	}
+
+	/* loop forever */
+	fputc(0x21, gw.file);
+	fputc(0xFF, gw.file);
+	fputc(11, gw.file);
+	fwrite("NETSCAPE2.0", 1, 11, gw.file);
+	fputc(3, gw.file);
+	fputc(1, gw.file);
+	put16(&gw, 0);
+	fputc(0, gw.file);
+
+	write_image(&gw, 0, 0, tc->width, tc->height, 0);
+	for (int i = 1; i < tc->frames; i++)
+		write_image(&gw, (i * 37) % (tc->width - BLOCK_SIZE),
+				(i * 23) % (tc->height - BLOCK_SIZE),
+				BLOCK_SIZE, BLOCK_SIZE, i);
+
+	fputc(0x3B, gw.file);
+	fclose(gw.file);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* every texture call logs at debug level without a graphics context */
+static void log_handler(int lvl, const char *msg, va_list args, void *p)
+{
+	if (lvl < LOG_DEBUG) {
+		vprintf(msg, args);
+		printf("\n");
+	}
+
+	UNUSED_PARAMETER(p);
+}
+
+/* runs in the child, exits with 1 if the gif couldn't be loaded */
+static void play(int seconds)
+{
+	gs_image_file_t image;
+	uint64_t start, load_ns, worst = 0, total = 0;
+	int ticks = seconds * 60;
+	int changes = 0, waiting = 0;
+
+	start = os_gettime_ns();
+	gs_image_file_init(&image, GIF_PATH);
+	gs_image_file_init_texture(&image);
+	load_ns = os_gettime_ns() - start;
+
+	if (!image.loaded)
+		_exit(1);
+
+	start = os_gettime_ns();
+
+	for (int i = 0; i < ticks; i++) {
+		int prev_frame = image.cur_frame;
+		uint64_t tick_start = os_gettime_ns();
+		uint64_t tick_ns;
+
+		if (gs_image_file_tick(&image, TICK_NS)) {
+			gs_image_file_update_texture(&image);
+
+			/* when the decode thread is behind, the tick keeps
+			 * reporting the same frame until it's shown */
+			if (image.cur_frame != prev_frame)
+				changes++;
+			else
+				waiting++;
+		}
+
+		tick_ns = os_gettime_ns() - tick_start;
+		total += tick_ns;
+		if (tick_ns > worst)
+			worst = tick_ns;
+
+		os_sleepto_ns(start + (uint64_t)(i + 1) * TICK_NS);
+	}
+
+	printf("  load %.0f ms, video tick avg %.3f ms, worst %.2f ms\n"
+	       "  %d frame changes in %d s, %d ticks waiting on the "
+	       "decoder\n",
+			(double)load_ns / 1000000.0,
+			(double)total / 1000000.0 / ticks,
+			(double)worst / 1000000.0,
+			changes, seconds, waiting);
+	fflush(stdout);
+
+	gs_image_file_free(&image);
+	_exit(0);
+}
+
+static bool run(const struct test_case *tc, int seconds)
+{
+	uint64_t decoded = (uint64_t)tc->width * tc->height * 4 * tc->frames;
+	struct rusage usage;
+	int status;
+	pid_t pid;
+
+	if (!write_gif(GIF_PATH, tc)) {
+		fprintf(stderr, "failed to write %s\n", GIF_PATH);
+		return false;
+	}
+
+	printf("%dx%d, %d frames (%llu MB decoded):\n",
+			tc->width, tc->height, tc->frames,
+			(unsigned long long)(decoded / (1024 * 1024)));
+	fflush(stdout);
+
+	pid = fork();
+	if (pid == 0)
+		play(seconds);
+	else if (pid < 0)
+		return false;
+
+	if (wait4(pid, &status, 0, &usage) != pid)
+		return false;
+
+	os_unlink(GIF_PATH);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		printf("  failed to load\n");
+		return false;
+	}
+
+	/* ru_maxrss is in KB on linux */
+	printf("  peak rss %ld MB\n", usage.ru_maxrss / 1024);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	int  seconds = argc > 1 ? atoi(argv[1]) : 10;
+	bool success = true;
+
+	base_set_log_handler(log_handler, NULL);
+
+	if (seconds <= 0) {
+		fprintf(stderr, "seconds must be at least 1\n");
+		return 1;
+	}
+
+	if (argc > 4) {
+		struct test_case tc = {atoi(argv[2]), atoi(argv[3]),
+			atoi(argv[4])};
+
+		if (tc.width <= BLOCK_SIZE || tc.height <= BLOCK_SIZE ||
+		    tc.width > 4096 || tc.height > 4096 || tc.frames < 2) {
+			fprintf(stderr, "size must be %d to 4096, with at "
+					"least 2 frames\n", BLOCK_SIZE + 1);
+			return 1;
+		}
+
+		return run(&tc, seconds) ? 0 : 1;
+	}
+
+	for (size_t i = 0; i < sizeof(default_cases) /
+			sizeof(default_cases[0]); i++)
+		success = run(&default_cases[i], seconds) && success;
+
+	return success ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+ * Cost per packet of interleaving encoded packets with one to MAX_AUDIO_MIXES
+ * audio tracks at several backlog depths: the single sorted array that
+ * obs-output.c used to keep (linear insertion, erase from the front) against
+ * the per-track queues it keeps now (append, take the earliest front).
+ *
+ * usage: perf-interleave [packets]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <obs.h>
+#include <util/darray.h>
+#include <util/circlebuf.h>
+#include <util/platform.h>
+
+#define VIDEO_USEC 16667 /* 60 fps */
+#define AUDIO_USEC 21333 /* 1024 samples at 48 kHz */
+
+struct packet_source {
+	size_t  tracks;
+	int64_t video_ts;
+	int64_t audio_ts[MAX_AUDIO_MIXES];
+	int64_t audio_delay;
+};
+
+/* produces packets in the order the encoders would deliver them, with the
+ * audio running late by a fixed delay so that a backlog builds up */
+static void next_packet(struct packet_source *src,
+		struct encoder_packet *packet)
+{
+	int64_t best_ts = src->video_ts;
+	size_t  best = DARRAY_INVALID;
+
+	for (size_t i = 0; i < src->tracks; i++) {
+		int64_t ts = src->audio_ts[i] + src->audio_delay;
+		if (ts < best_ts) {
+			best_ts = ts;
+			best = i;
+		}
+	}
+
+	memset(packet, 0, sizeof(*packet));
+
+	if (best == DARRAY_INVALID) {
+		packet->type = OBS_ENCODER_VIDEO;
+		packet->dts_usec = src->video_ts;
+		src->video_ts += VIDEO_USEC;
+	} else {
+		packet->type = OBS_ENCODER_AUDIO;
+		packet->track_idx = best;
+		packet->dts_usec = src->audio_ts[best];
+		src->audio_ts[best] += AUDIO_USEC;
+	}
+}
+
+static inline size_t queue_idx(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : packet->track_idx + 1;
+}
+
+static double time_sorted_array(size_t tracks, int64_t delay,
+		size_t backlog, size_t count, int64_t *sink)
+{
+	struct packet_source src = {tracks, 0, {0}, delay};
+	DARRAY(struct encoder_packet) packets;
+	uint64_t start = os_gettime_ns();
+
+	da_init(packets);
+
+	for (size_t n = 0; n < count; n++) {
+		struct encoder_packet packet;
+		size_t idx;
+
+		next_packet(&src, &packet);
+
+		for (idx = 0; idx < packets.num; idx++) {
+			if (packet.dts_usec < packets.array[idx].dts_usec)
+				break;
+		}
+		da_insert(packets, idx, &packet);
+
+		if (packets.num > backlog) {
+			*sink += packets.array[0].dts_usec;
+			da_erase(packets, 0);
+		}
+	}
+
+	da_free(packets);
+	return (double)(os_gettime_ns() - start) / (double)count;
+}
+
+static double time_track_queues(size_t tracks, int64_t delay,
+		size_t backlog, size_t count, int64_t *sink)
+{
+	struct packet_source src = {tracks, 0, {0}, delay};
+	struct circlebuf queues[MAX_AUDIO_MIXES + 1] = {{0}};
+	size_t queued = 0;
+	uint64_t start = os_gettime_ns();
+
+	for (size_t n = 0; n < count; n++) {
+		struct encoder_packet packet;
+		struct encoder_packet *first = NULL;
+		size_t first_queue = 0;
+
+		next_packet(&src, &packet);
+		circlebuf_push_back(&queues[queue_idx(&packet)], &packet,
+				sizeof(packet));
+
+		if (++queued <= backlog)
+			continue;
+
+		for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++) {
+			struct encoder_packet *cur =
+				circlebuf_data(&queues[i], 0);
+
+			if (cur && (!first || cur->dts_usec < first->dts_usec)) {
+				first = cur;
+				first_queue = i;
+			}
+		}
+
+		*sink += first->dts_usec;
+		circlebuf_pop_front(&queues[first_queue], NULL,
+				sizeof(packet));
+		queued--;
+	}
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES + 1; i++)
+		circlebuf_free(&queues[i]);
+	return (double)(os_gettime_ns() - start) / (double)count;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t count = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 1000000;
+	int64_t sink = 0;
+
+	if (!count)
+		count = 1;
+
+	printf("%-7s %-8s %14s %14s\n", "tracks", "backlog",
+			"sorted ns/pkt", "queues ns/pkt");
+
+	for (size_t tracks = 1; tracks <= MAX_AUDIO_MIXES; tracks++) {
+		for (int64_t frames = 8; frames <= 512; frames *= 8) {
+			int64_t delay = frames * VIDEO_USEC;
+			size_t backlog = (size_t)frames * (tracks + 1);
+
+			double sorted = time_sorted_array(tracks, delay,
+					backlog, count, &sink);
+			double queues = time_track_queues(tracks, delay,
+					backlog, count, &sink);
+
+			printf("%-7d %-8d %14.1f %14.1f\n", (int)tracks,
+					(int)backlog, sorted, queues);
+		}
+	}
+
+	/* keeps the compiler from discarding the loops */
+	return sink == 1 ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * Throughput of the two ways obs can hand packets to the ffmpeg-mux process:
+ * writing ffm_packet_info + payload to the child's stdin, and the shared
+ * memory ring from ffmpeg-mux-shm.h.  The child reads every packet and sums
+ * its payload in place of muxing it, which also checks that nothing was lost.
+ *
+ * usage: perf-mux-transport [packet size in KB] [total MB]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <util/platform.h>
+#include <ffmpeg-mux.h>
+#include <ffmpeg-mux-shm.h>
+
+#define SHM_SIZE    (64 * 1024 * 1024)
+#define SHM_WAIT_MS 100
+
+struct transport {
+	const char *name;
+	void (*produce)(void *param, const uint8_t *payload, size_t size,
+			int packets);
+	bool (*consume)(void *param, uint64_t *sum);
+	void *param;
+};
+
+static uint64_t payload_sum(const uint8_t *data, size_t size)
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i < size; i++)
+		sum += data[i];
+	return sum;
+}
+
+/* ------------------------------------------------------------------------- */
+/* pipe */
+
+static bool write_all(int fd, const void *vdata, size_t size)
+{
+	const uint8_t *data = vdata;
+
+	while (size) {
+		ssize_t n = write(fd, data, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		data += n;
+		size -= (size_t)n;
+	}
+
+	return true;
+}
+
+static size_t read_all(int fd, void *vdata, size_t size)
+{
+	uint8_t *data = vdata;
+	size_t  total = 0;
+
+	while (total < size) {
+		ssize_t n = read(fd, data + total, size - total);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		total += (size_t)n;
+	}
+
+	return total;
+}
+
+static void pipe_produce(void *param, const uint8_t *payload, size_t size,
+		int packets)
+{
+	int *fds = param;
+
+	for (int i = 0; i < packets; i++) {
+		struct ffm_packet_info info = {
+			.pts = i, .dts = i, .size = (uint32_t)size,
+			.type = FFM_PACKET_VIDEO
+		};
+
+		if (!write_all(fds[1], &info, sizeof(info)) ||
+		    !write_all(fds[1], payload, size))
+			break;
+	}
+
+	close(fds[1]);
+}
+
+static bool pipe_consume(void *param, uint64_t *sum)
+{
+	int                    *fds = param;
+	struct ffm_packet_info info;
+	uint8_t                *buf = NULL;
+	size_t                 buf_size = 0;
+
+	close(fds[1]);
+
+	while (read_all(fds[0], &info, sizeof(info)) == sizeof(info)) {
+		if (info.size > buf_size) {
+			buf_size = info.size;
+			buf = realloc(buf, buf_size);
+		}
+
+		if (read_all(fds[0], buf, info.size) != info.size) {
+			free(buf);
+			return false;
+		}
+
+		*sum += payload_sum(buf, info.size);
+	}
+
+	free(buf);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* shared memory, the same way obs-ffmpeg-mux.c and ffmpeg-mux.c use it */
+
+static bool shm_wait_space(struct ffm_shm *shm, uint64_t size)
+{
+	struct ffm_shm_header *header = shm->header;
+
+	for (;;) {
+		uint32_t seq = ffm_load32(&header->space_seq);
+
+		if (ffm_shm_free_space(shm) >= size)
+			return true;
+		if (ffm_load32(&header->reader_closed))
+			return false;
+
+		ffm_shm_wait(&header->space_seq, &header->writer_waiting, seq,
+				SHM_WAIT_MS);
+	}
+}
+
+static bool shm_wait_data(struct ffm_shm *shm, uint64_t size)
+{
+	struct ffm_shm_header *header = shm->header;
+
+	for (;;) {
+		uint32_t seq = ffm_load32(&header->data_seq);
+
+		if (ffm_shm_available(shm) >= size)
+			return true;
+		if (ffm_load32(&header->writer_closed))
+			return ffm_shm_available(shm) >= size;
+
+		ffm_shm_wait(&header->data_seq, &header->reader_waiting, seq,
+				SHM_WAIT_MS);
+	}
+}
+
+static void shm_produce(void *param, const uint8_t *payload, size_t size,
+		int packets)
+{
+	struct ffm_shm        *shm = param;
+	struct ffm_shm_header *header = shm->header;
+	size_t                total = sizeof(struct ffm_packet_info) + size;
+
+	for (int i = 0; i < packets; i++) {
+		struct ffm_packet_info info = {
+			.pts = i, .dts = i, .size = (uint32_t)size,
+			.type = FFM_PACKET_VIDEO
+		};
+		uint8_t *ptr;
+
+		if (!shm_wait_space(shm, total))
+			break;
+
+		ptr = ffm_shm_write_ptr(shm);
+		memcpy(ptr, &info, sizeof(info));
+		memcpy(ptr + sizeof(info), payload, size);
+		ffm_shm_commit_write(shm, total);
+	}
+
+	__atomic_store_n(&header->writer_closed, 1, __ATOMIC_SEQ_CST);
+	ffm_shm_signal(&header->data_seq, &header->reader_waiting);
+}
+
+static bool shm_consume(void *param, uint64_t *sum)
+{
+	struct ffm_shm         *shm = param;
+	struct ffm_packet_info info;
+
+	/* the header is never split, since packets always fit the ring */
+	while (shm_wait_data(shm, sizeof(info))) {
+		memcpy(&info, ffm_shm_read_ptr(shm), sizeof(info));
+		ffm_shm_commit_read(shm, sizeof(info));
+
+		if (!shm_wait_data(shm, info.size))
+			return false;
+
+		/* used in place, like ffmpeg-mux does */
+		*sum += payload_sum(ffm_shm_read_ptr(shm), info.size);
+		ffm_shm_commit_read(shm, info.size);
+	}
+
+	__atomic_store_n(&shm->header->reader_closed, 1, __ATOMIC_SEQ_CST);
+	return true;
+}
+
+static bool create_shm(struct ffm_shm *shm)
+{
+	char name[64];
+	int  fd;
+
+	snprintf(name, sizeof(name), "/obs-perf-mux-transport-%d",
+			(int)getpid());
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1)
+		return false;
+
+	shm_unlink(name);
+
+	if (ftruncate(fd, FFM_SHM_HEADER_SIZE + SHM_SIZE) != 0 ||
+	    !ffm_shm_map(shm, fd, SHM_SIZE)) {
+		close(fd);
+		return false;
+	}
+
+	/* the mapping is inherited by the child */
+	close(fd);
+	shm->header->magic    = FFM_SHM_MAGIC;
+	shm->header->capacity = SHM_SIZE;
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static double cpu_sec(const struct rusage *usage)
+{
+	return (double)usage->ru_utime.tv_sec +
+		(double)usage->ru_utime.tv_usec / 1000000.0 +
+		(double)usage->ru_stime.tv_sec +
+		(double)usage->ru_stime.tv_usec / 1000000.0;
+}
+
+static bool run(struct transport *transport, const uint8_t *payload,
+		size_t size, int packets)
+{
+	struct rusage self_start, self_end, child;
+	uint64_t      start, elapsed;
+	int           status;
+	pid_t         pid;
+	double        mb = (double)size * packets / (1024.0 * 1024.0);
+
+	getrusage(RUSAGE_SELF, &self_start);
+	start = os_gettime_ns();
+
+	pid = fork();
+	if (pid == 0) {
+		uint64_t sum = 0;
+		bool success = transport->consume(transport->param, &sum);
+
+		_exit(success && sum == payload_sum(payload, size) * packets ?
+				0 : 1);
+	} else if (pid < 0) {
+		return false;
+	}
+
+	transport->produce(transport->param, payload, size, packets);
+
+	/* each run forks exactly one child */
+	if (wait4(pid, &status, 0, &child) != pid)
+		return false;
+
+	elapsed = os_gettime_ns() - start;
+	getrusage(RUSAGE_SELF, &self_end);
+
+	printf("%-4s %6d KB packets: %6.0f MB/s, "
+	       "cpu %.2f s obs + %.2f s mux%s\n",
+			transport->name, (int)(size / 1024),
+			mb / ((double)elapsed / 1000000000.0),
+			cpu_sec(&self_end) - cpu_sec(&self_start),
+			cpu_sec(&child),
+			WIFEXITED(status) && WEXITSTATUS(status) == 0 ?
+				"" : " (data mismatch)");
+
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t         size = (argc > 1 ? (size_t)atoi(argv[1]) : 256) * 1024;
+	size_t         total = (argc > 2 ? (size_t)atoi(argv[2]) : 2048) *
+		1024 * 1024;
+	int            packets;
+	uint8_t        *payload;
+	int            fds[2];
+	struct ffm_shm shm = {0};
+	bool           success = true;
+
+	struct transport transports[] = {
+		{"pipe", pipe_produce, pipe_consume, fds},
+		{"shm",  shm_produce,  shm_consume,  &shm}
+	};
+
+	if (!size || size + sizeof(struct ffm_packet_info) > SHM_SIZE) {
+		fprintf(stderr, "packet size must be 1 to %d KB\n",
+				SHM_SIZE / 1024 - 1);
+		return 1;
+	}
+
+	packets = (int)(total / size);
+	payload = malloc(size);
+	for (size_t i = 0; i < size; i++)
+		payload[i] = (uint8_t)(i * 7);
+
+	if (pipe(fds) != 0 || !create_shm(&shm)) {
+		fprintf(stderr, "failed to create the transports\n");
+		return 1;
+	}
+
+	for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+		success = run(&transports[i], payload, size, packets) &&
+			success;
+
+	close(fds[0]);
+	ffm_shm_unmap(&shm);
+	free(payload);
+	return success ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+/*
+ * Cost of emitting a signal with 0, 1 and 10 connected callbacks, on a
+ * handler holding the same signals as a source, and with one to four
+ * threads emitting at once.
+ *
+ * usage: perf-signal [emits]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <callback/signal.h>
+#include <util/threading.h>
+#include <util/platform.h>
+
+#define MAX_SUBSCRIBERS 10
+#define MAX_THREADS 4
+
+static const char *source_signals[] = {
+	"void destroy(ptr source)",
+	"void remove(ptr source)",
+	"void save(ptr source)",
+	"void load(ptr source)",
+	"void activate(ptr source)",
+	"void deactivate(ptr source)",
+	"void show(ptr source)",
+	"void hide(ptr source)",
+	"void mute(ptr source, bool muted)",
+	"void enable(ptr source, bool enabled)",
+	"void rename(ptr source, string new_name, string prev_name)",
+	"void volume(ptr source, in out float volume)",
+	"void update_properties(ptr source)",
+	"void update_flags(ptr source, int flags)",
+	"void audio_sync(ptr source, int out int offset)",
+	"void audio_mixers(ptr source, in out int mixers)",
+	"void filter_add(ptr source, ptr filter)",
+	"void filter_remove(ptr source, ptr filter)",
+	"void reorder_filters(ptr source)",
+	"void transition_start(ptr source)",
+	"void transition_video_stop(ptr source)",
+	"void transition_stop(ptr source)",
+	NULL
+};
+
+struct emit_job {
+	signal_handler_t *handler;
+	size_t           count;
+};
+
+static void counter_callback(void *data, calldata_t *params)
+{
+	(*(volatile long*)data)++;
+	UNUSED_PARAMETER(params);
+}
+
+static void *emit_thread(void *param)
+{
+	struct emit_job *job = param;
+	uint8_t stack[128];
+	calldata_t params;
+
+	calldata_init_fixed(&params, stack, sizeof(stack));
+	calldata_set_ptr(&params, "source", NULL);
+
+	for (size_t i = 0; i < job->count; i++)
+		signal_handler_signal(job->handler, "transition_stop", &params);
+
+	return NULL;
+}
+
+/* returns the wall time per emit, across all threads */
+static double time_emits(signal_handler_t *handler, size_t threads,
+		size_t count)
+{
+	pthread_t thread_ids[MAX_THREADS];
+	struct emit_job job = {handler, count / threads};
+	uint64_t start = os_gettime_ns();
+
+	for (size_t i = 0; i < threads; i++)
+		pthread_create(&thread_ids[i], NULL, emit_thread, &job);
+	for (size_t i = 0; i < threads; i++)
+		pthread_join(thread_ids[i], NULL);
+
+	return (double)(os_gettime_ns() - start) /
+		(double)(job.count * threads);
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t subscribers[] = {0, 1, MAX_SUBSCRIBERS};
+	size_t count = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 1000000;
+	volatile long counters[MAX_SUBSCRIBERS] = {0};
+	signal_handler_t *handler = signal_handler_create();
+
+	if (count < MAX_THREADS)
+		count = MAX_THREADS;
+
+	signal_handler_add_array(handler, source_signals);
+
+	printf("%zu emits, %d logical cores\n", count,
+			os_get_logical_cores());
+	printf("%-12s %-8s %10s\n", "subscribers", "threads", "ns/emit");
+
+	for (size_t i = 0; i < sizeof(subscribers)/sizeof(subscribers[0]);
+			i++) {
+		for (size_t j = 0; j < subscribers[i]; j++)
+			signal_handler_connect(handler, "transition_stop",
+					counter_callback, (void*)&counters[j]);
+
+		for (size_t threads = 1; threads <= MAX_THREADS; threads *= 2)
+			printf("%-12d %-8d %10.1f\n", (int)subscribers[i],
+					(int)threads,
+					time_emits(handler, threads, count));
+
+		for (size_t j = 0; j < subscribers[i]; j++)
+			signal_handler_disconnect(handler, "transition_stop",
+					counter_callback, (void*)&counters[j]);
+	}
+
+	signal_handler_destroy(handler);
+	return 0;
+}
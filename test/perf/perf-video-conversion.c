@@ -0,0 +1,146 @@
+/*
+ * Per-frame CPU colorspace conversion time (UYVX to I420/NV12/I444) at
+ * 1, 2, 4 and 8 slice pool threads, the same way obs-video.c splits the
+ * conversion when GPU conversion is disabled.
+ *
+ * usage: perf-video-conversion [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/format-conversion.h>
+#include <media-io/slice-pool.h>
+
+/* same as CONVERT_SLICE_ROWS in obs-video.c */
+#define SLICE_ROWS 64
+
+enum format {
+	FORMAT_I420,
+	FORMAT_NV12,
+	FORMAT_I444
+};
+
+static const char *format_names[] = {"I420", "NV12", "I444"};
+
+struct frame {
+	uint32_t width;
+	uint32_t height;
+	uint8_t  *input;
+	uint32_t in_linesize;
+	uint8_t  *output[3];
+	uint32_t out_linesize[3];
+	enum format format;
+};
+
+static void convert_slice(void *param, uint32_t start_y, uint32_t end_y)
+{
+	struct frame *frame = param;
+
+	if (frame->format == FORMAT_I420)
+		compress_uyvx_to_i420(frame->input, frame->in_linesize,
+				start_y, end_y,
+				frame->output, frame->out_linesize);
+	else if (frame->format == FORMAT_NV12)
+		compress_uyvx_to_nv12(frame->input, frame->in_linesize,
+				start_y, end_y,
+				frame->output, frame->out_linesize);
+	else
+		convert_uyvx_to_i444(frame->input, frame->in_linesize,
+				start_y, end_y,
+				frame->output, frame->out_linesize);
+}
+
+static void frame_init(struct frame *frame, uint32_t width, uint32_t height)
+{
+	size_t size = (size_t)width * height;
+
+	frame->width       = width;
+	frame->height      = height;
+	frame->in_linesize = width * 4;
+	frame->input       = bmalloc(size * 4);
+
+	for (size_t i = 0; i < size * 4; i++)
+		frame->input[i] = (uint8_t)(i * 7 + (i >> 12));
+
+	/* large enough for I444, which the 4:2:0 formats also fit in */
+	for (size_t i = 0; i < 3; i++) {
+		frame->output[i]       = bmalloc(size);
+		frame->out_linesize[i] = width;
+	}
+}
+
+static void frame_free(struct frame *frame)
+{
+	bfree(frame->input);
+	for (size_t i = 0; i < 3; i++)
+		bfree(frame->output[i]);
+}
+
+static double time_conversion(slice_pool_t *pool, struct frame *frame,
+		int frames)
+{
+	uint64_t start;
+
+	/* warm up the threads and caches */
+	slice_pool_run(pool, convert_slice, frame, frame->height, SLICE_ROWS);
+
+	start = os_gettime_ns();
+	for (int i = 0; i < frames; i++)
+		slice_pool_run(pool, convert_slice, frame, frame->height,
+				SLICE_ROWS);
+
+	return (double)(os_gettime_ns() - start) / 1000000.0 / frames;
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t sizes[][2] = {
+		{1920, 1080},
+		{2560, 1440},
+		{3840, 2160}
+	};
+	static const size_t thread_counts[] = {1, 2, 4, 8};
+	int frames = argc > 1 ? atoi(argv[1]) : 100;
+
+	if (frames <= 0)
+		frames = 100;
+
+	printf("%s, %d logical cores, %d frames per run\n",
+			format_conversion_get_isa(), os_get_logical_cores(),
+			frames);
+	printf("%-10s %-6s %10s %10s %10s %10s  (ms per frame)\n",
+			"size", "format", "1 thread", "2 threads",
+			"4 threads", "8 threads");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		struct frame frame;
+		frame_init(&frame, sizes[s][0], sizes[s][1]);
+
+		for (int f = FORMAT_I420; f <= FORMAT_I444; f++) {
+			char size_str[32];
+
+			frame.format = (enum format)f;
+			snprintf(size_str, sizeof(size_str), "%ux%u",
+					frame.width, frame.height);
+			printf("%-10s %-6s", size_str, format_names[f]);
+
+			for (size_t t = 0; t < 4; t++) {
+				slice_pool_t *pool = slice_pool_create(
+						thread_counts[t], "perf");
+
+				printf(" %10.3f", time_conversion(pool, &frame,
+							frames));
+				fflush(stdout);
+				slice_pool_destroy(pool);
+			}
+
+			printf("\n");
+		}
+
+		frame_free(&frame);
+	}
+
+	return 0;
+}
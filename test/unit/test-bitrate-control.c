@@ -0,0 +1,588 @@
+/*
+ * Replays bandwidth traces through the rtmp-stream dynamic bitrate controller
+ * against a simulated encoder and send queue that drops non-keyframe video the
+ * way rtmp-stream does, and checks that no frames are dropped once the
+ * controller has had time to react, that the bitrate fits the link while it
+ * is constrained, and that the original bitrate is restored after the link
+ * recovers.
+ *
+ * Outside of Windows the same queue is then sent in real time over a loopback
+ * TCP connection to a sink that only reads at a throttled rate, so the
+ * controller also sees the effect of socket buffers and blocking sends.
+ *
+ * A trace file can be given instead, one "<duration ms> <link kbps>" pair per
+ * line; it is replayed and summarized without checks.
+ *
+ * usage: test-bitrate-control [trace file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <bitrate-control.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#endif
+
+#define VIDEO_KBPS        6000
+#define AUDIO_KBPS        160
+#define FPS               30
+#define KEYINT            (FPS * 2)
+#define DROP_THRESHOLD_MS 500
+#define MAX_PACKETS       4096
+#define MAX_SEGMENTS      256
+
+struct segment {
+	int duration_ms;
+	int kbps;
+};
+
+struct trace {
+	const char     *name;
+	struct segment segments[8];
+	size_t         num;
+	int            check_from_ms;   /* time allowed for the first reaction */
+	int            recovered_by_ms; /* 0 if it doesn't end recovered */
+};
+
+static const struct trace traces[] = {
+	{"step down and back", {{10000, 10000}, {20000, 3000}, {40000, 10000}},
+		3, 12000, 70000},
+	{"deep drop",          {{5000, 10000}, {20000, 1500}, {40000, 10000}},
+		3, 7000, 65000},
+	{"slow decline",       {{5000, 8000}, {5000, 6000}, {5000, 5000},
+	                        {5000, 4000}, {10000, 3000}, {40000, 8000}},
+		6, 0, 70000},
+	{"short dips",         {{5000, 8000}, {300, 2000}, {5000, 8000},
+	                        {300, 2000}, {5000, 8000}, {20000, 8000}},
+		6, 0, 35600},
+};
+
+struct packet {
+	int64_t  dts_usec;
+	uint32_t size;
+	bool     droppable;
+};
+
+struct sim {
+	struct bitrate_control bc;
+	int            kbps;
+
+	struct packet  packets[MAX_PACKETS];
+	size_t         first;
+	size_t         num;
+	int64_t        last_dts_usec;
+	int64_t        min_drop_dts_usec;
+
+	uint32_t       sending_left;
+	uint64_t       total_bytes;
+	double         link_bytes;
+
+	int            min_kbps;
+	int64_t        peak_queue_usec;
+	int            dropped;
+	int            dropped_late;
+	int            over_link_ms;
+	int            changes;
+};
+
+static inline struct packet *packet_at(struct sim *sim, size_t idx)
+{
+	return &sim->packets[(sim->first + idx) % MAX_PACKETS];
+}
+
+static inline int64_t queue_usec(const struct sim *sim)
+{
+	return sim->num ? sim->last_dts_usec -
+		sim->packets[sim->first].dts_usec : 0;
+}
+
+/* like drop_frames: drop all queued non-keyframe video, then hold off until
+ * everything queued at this point has been sent */
+static int drop_frames(struct sim *sim)
+{
+	size_t kept = 0;
+	int    dropped = 0;
+
+	for (size_t i = 0; i < sim->num; i++) {
+		struct packet *packet = packet_at(sim, i);
+
+		if (packet->droppable)
+			dropped++;
+		else
+			*packet_at(sim, kept++) = *packet;
+	}
+
+	sim->num = kept;
+	sim->min_drop_dts_usec = sim->last_dts_usec;
+	return dropped;
+}
+
+/* returns the number of frames dropped */
+static int push_packet(struct sim *sim, int64_t dts_usec, uint32_t size,
+		bool droppable)
+{
+	if (sim->num == MAX_PACKETS) {
+		fprintf(stderr, "simulated send queue overflowed\n");
+		exit(1);
+	}
+
+	*packet_at(sim, sim->num++) =
+		(struct packet){dts_usec, size, droppable};
+	sim->last_dts_usec = dts_usec;
+
+	if (sim->num < 5 ||
+	    packet_at(sim, 0)->dts_usec < sim->min_drop_dts_usec ||
+	    queue_usec(sim) <= DROP_THRESHOLD_MS * 1000)
+		return 0;
+
+	return drop_frames(sim);
+}
+
+/* like the send thread: take a packet, send it, then update the controller */
+static void send_data(struct sim *sim, uint64_t ts_ns)
+{
+	while (sim->link_bytes >= 1.0) {
+		uint32_t sent;
+
+		if (!sim->sending_left) {
+			if (!sim->num)
+				break;
+			sim->sending_left = packet_at(sim, 0)->size;
+			sim->first = (sim->first + 1) % MAX_PACKETS;
+			sim->num--;
+		}
+
+		sent = sim->link_bytes < sim->sending_left ?
+			(uint32_t)sim->link_bytes : sim->sending_left;
+
+		sim->link_bytes   -= sent;
+		sim->sending_left -= sent;
+		sim->total_bytes  += sent;
+
+		if (!sim->sending_left) {
+			int kbps = bitrate_control_update(&sim->bc, ts_ns,
+					sim->total_bytes, queue_usec(sim));
+			if (kbps) {
+				sim->kbps = kbps;
+				sim->changes++;
+			}
+		}
+	}
+
+	/* an idle link can't save up bandwidth */
+	if (!sim->num && !sim->sending_left)
+		sim->link_bytes = 0.0;
+}
+
+static int replay(const char *name, const struct segment *segments, size_t num,
+		const struct trace *checks)
+{
+	struct sim *sim = calloc(1, sizeof(struct sim));
+	int        failures = 0;
+	int        ms = 0;
+	int        last_kbps = 0;
+	int        recovered_ms = -1;
+	int        frame = 0;
+
+	bitrate_control_init(&sim->bc, VIDEO_KBPS, AUDIO_KBPS,
+			DROP_THRESHOLD_MS * 1000 / 2);
+	sim->kbps     = VIDEO_KBPS;
+	sim->min_kbps = VIDEO_KBPS;
+
+	for (size_t i = 0; i < num; i++) {
+		int end = ms + segments[i].duration_ms;
+
+		for (; ms < end; ms++) {
+			int64_t  usec  = (int64_t)ms * 1000;
+			uint64_t ts_ns = (uint64_t)usec * 1000 + 1;
+			bool     check = checks && ms >= checks->check_from_ms;
+			int64_t  queued;
+			int      dropped = 0;
+
+			if (ms % (1000 / FPS) == 0)
+				dropped += push_packet(sim, usec,
+						sim->kbps * 1000 / 8 / FPS,
+						frame++ % KEYINT != 0);
+			if (ms % 20 == 0)
+				dropped += push_packet(sim, usec,
+						AUDIO_KBPS * 1000 / 8 / 50,
+						false);
+
+			sim->dropped += dropped;
+			if (check)
+				sim->dropped_late += dropped;
+
+			sim->link_bytes += segments[i].kbps / 8.0;
+			send_data(sim, ts_ns);
+
+			if (sim->kbps < sim->min_kbps)
+				sim->min_kbps = sim->kbps;
+
+			queued = queue_usec(sim);
+			if (queued > sim->peak_queue_usec)
+				sim->peak_queue_usec = queued;
+
+			if (!check)
+				continue;
+
+			/* only judge the fit once the queue has built up;
+			 * short dips are meant to be absorbed by it */
+			if (queued >= DROP_THRESHOLD_MS * 1000 / 2 &&
+			    sim->kbps + AUDIO_KBPS > segments[i].kbps)
+				sim->over_link_ms++;
+
+			if (sim->kbps == VIDEO_KBPS && recovered_ms < 0)
+				recovered_ms = ms;
+			else if (sim->kbps != VIDEO_KBPS)
+				recovered_ms = -1;
+		}
+	}
+
+	last_kbps = sim->kbps;
+
+	printf("%-20s min %5d kbps, end %5d kbps, %3d changes, "
+	       "peak queue %4d ms, %4d frames dropped\n",
+	       name, sim->min_kbps, last_kbps, sim->changes,
+	       (int)(sim->peak_queue_usec / 1000), sim->dropped);
+
+	if (checks) {
+		if (sim->dropped_late) {
+			printf("    %d frames dropped after the controller "
+			       "should have reacted\n", sim->dropped_late);
+			failures++;
+		}
+		if (sim->over_link_ms > 3000) {
+			printf("    bitrate stayed above the link for %d ms\n",
+					sim->over_link_ms);
+			failures++;
+		}
+		if (checks->recovered_by_ms &&
+		    (recovered_ms < 0 || recovered_ms > checks->recovered_by_ms)) {
+			printf("    bitrate was not restored in time\n");
+			failures++;
+		}
+	}
+
+	free(sim);
+	return failures;
+}
+
+static int replay_file(const char *path)
+{
+	struct segment segments[MAX_SEGMENTS];
+	size_t         num = 0;
+	FILE           *file = fopen(path, "r");
+
+	if (!file) {
+		fprintf(stderr, "failed to open '%s'\n", path);
+		return 1;
+	}
+
+	while (num < MAX_SEGMENTS && fscanf(file, "%d %d",
+				&segments[num].duration_ms,
+				&segments[num].kbps) == 2)
+		num++;
+
+	fclose(file);
+
+	if (!num) {
+		fprintf(stderr, "no segments in '%s'\n", path);
+		return 1;
+	}
+
+	replay(path, segments, num, NULL);
+	return 0;
+}
+
+#ifndef _WIN32
+/* ------------------------------------------------------------------------- */
+
+#define TCP_HIGH_KBPS   8000
+#define TCP_LOW_KBPS    2000
+#define TCP_HIGH_MS     2000
+#define TCP_LOW_MS      8000
+#define TCP_REACT_MS    2000
+#define SOCKET_BUF_SIZE 8192
+
+struct tcp_test {
+	struct sim      *sim;
+	pthread_mutex_t mutex;
+	os_sem_t        *send_sem;
+	volatile bool   stop;
+	int             listen_fd;
+	int             fd;
+	uint64_t        start_ns;
+};
+
+static inline int link_kbps(struct tcp_test *test, uint64_t ts_ns)
+{
+	return (ts_ns - test->start_ns) / 1000000 < TCP_HIGH_MS ?
+		TCP_HIGH_KBPS : TCP_LOW_KBPS;
+}
+
+static void *sink_thread(void *data)
+{
+	struct tcp_test *test = data;
+	static uint8_t  buf[65536];
+	double          budget = 0.0;
+	uint64_t        last_ns;
+	int             fd = accept(test->listen_fd, NULL, NULL);
+
+	if (fd < 0)
+		return NULL;
+
+	last_ns = os_gettime_ns();
+
+	for (;;) {
+		uint64_t now_ns;
+
+		os_sleep_ms(5);
+		now_ns = os_gettime_ns();
+		budget += link_kbps(test, now_ns) / 8.0 *
+			(double)(now_ns - last_ns) / 1000000.0;
+		last_ns = now_ns;
+
+		while (budget >= 1.0) {
+			size_t  want = budget < sizeof(buf) ?
+				(size_t)budget : sizeof(buf);
+			ssize_t n = recv(fd, buf, want, MSG_DONTWAIT);
+
+			if (n == 0)
+				goto closed;
+			if (n < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+					goto closed;
+
+				/* an idle link can't save up bandwidth */
+				budget = 0.0;
+				break;
+			}
+
+			budget -= (double)n;
+		}
+	}
+
+closed:
+	close(fd);
+	return NULL;
+}
+
+static bool send_all(int fd, size_t size)
+{
+	static const uint8_t buf[65536];
+
+	while (size) {
+		ssize_t n = send(fd, buf, size < sizeof(buf) ?
+				size : sizeof(buf), 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		size -= (size_t)n;
+	}
+
+	return true;
+}
+
+static void *send_thread(void *data)
+{
+	struct tcp_test *test = data;
+	struct sim      *sim = test->sim;
+
+	while (os_sem_wait(test->send_sem) == 0) {
+		struct packet packet;
+		int64_t       queued;
+		int           kbps;
+
+		pthread_mutex_lock(&test->mutex);
+		if (!sim->num) {
+			pthread_mutex_unlock(&test->mutex);
+			if (test->stop)
+				break;
+			/* the packet was dropped */
+			continue;
+		}
+
+		packet = *packet_at(sim, 0);
+		sim->first = (sim->first + 1) % MAX_PACKETS;
+		sim->num--;
+		pthread_mutex_unlock(&test->mutex);
+
+		if (!send_all(test->fd, packet.size))
+			break;
+		sim->total_bytes += packet.size;
+
+		pthread_mutex_lock(&test->mutex);
+		queued = queue_usec(sim);
+		pthread_mutex_unlock(&test->mutex);
+
+		kbps = bitrate_control_update(&sim->bc, os_gettime_ns(),
+				sim->total_bytes, queued);
+		if (kbps) {
+			pthread_mutex_lock(&test->mutex);
+			sim->kbps = kbps;
+			sim->changes++;
+			pthread_mutex_unlock(&test->mutex);
+		}
+	}
+
+	return NULL;
+}
+
+static bool connect_sink(struct tcp_test *test)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t          addr_len = sizeof(addr);
+	int                buf_size = SOCKET_BUF_SIZE;
+
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	test->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	test->fd        = socket(AF_INET, SOCK_STREAM, 0);
+	if (test->listen_fd < 0 || test->fd < 0)
+		return false;
+
+	/* keep the kernel from hiding the backlog in large socket buffers */
+	setsockopt(test->listen_fd, SOL_SOCKET, SO_RCVBUF,
+			&buf_size, sizeof(buf_size));
+	setsockopt(test->fd, SOL_SOCKET, SO_SNDBUF,
+			&buf_size, sizeof(buf_size));
+
+	return bind(test->listen_fd, (struct sockaddr*)&addr,
+			sizeof(addr)) == 0 &&
+		listen(test->listen_fd, 1) == 0 &&
+		getsockname(test->listen_fd, (struct sockaddr*)&addr,
+			&addr_len) == 0 &&
+		connect(test->fd, (struct sockaddr*)&addr,
+			sizeof(addr)) == 0;
+}
+
+static int tcp_sink_test(void)
+{
+	struct tcp_test test = {0};
+	struct sim      *sim = calloc(1, sizeof(struct sim));
+	pthread_t       sink, sender;
+	int64_t         next_video_usec = 0;
+	int64_t         next_audio_usec = 0;
+	int             frame = 0;
+	int             failures = 0;
+
+	/* sends fail instead once the connection is shut down */
+	signal(SIGPIPE, SIG_IGN);
+
+	test.sim = sim;
+	bitrate_control_init(&sim->bc, VIDEO_KBPS, AUDIO_KBPS,
+			DROP_THRESHOLD_MS * 1000 / 2);
+	sim->kbps     = VIDEO_KBPS;
+	sim->min_kbps = VIDEO_KBPS;
+
+	pthread_mutex_init(&test.mutex, NULL);
+	os_sem_init(&test.send_sem, 0);
+
+	test.start_ns = os_gettime_ns();
+
+	if (!connect_sink(&test) ||
+	    pthread_create(&sink, NULL, sink_thread, &test) != 0) {
+		fprintf(stderr, "failed to set up the loopback sink: %d\n",
+				errno);
+		exit(1);
+	}
+
+	pthread_create(&sender, NULL, send_thread, &test);
+
+	/* the encoder: queue packets in real time */
+	for (;;) {
+		int64_t usec = (int64_t)(os_gettime_ns() - test.start_ns) /
+			1000;
+		int     dropped = 0;
+
+		if (usec >= (TCP_HIGH_MS + TCP_LOW_MS) * 1000)
+			break;
+
+		pthread_mutex_lock(&test.mutex);
+		for (; next_video_usec <= usec; next_video_usec += 1000000 / FPS) {
+			dropped += push_packet(sim, next_video_usec,
+					sim->kbps * 1000 / 8 / FPS,
+					frame++ % KEYINT != 0);
+			os_sem_post(test.send_sem);
+		}
+		for (; next_audio_usec <= usec; next_audio_usec += 20000) {
+			dropped += push_packet(sim, next_audio_usec,
+					AUDIO_KBPS * 1000 / 8 / 50, false);
+			os_sem_post(test.send_sem);
+		}
+
+		if (sim->kbps < sim->min_kbps)
+			sim->min_kbps = sim->kbps;
+		if (queue_usec(sim) > sim->peak_queue_usec)
+			sim->peak_queue_usec = queue_usec(sim);
+		pthread_mutex_unlock(&test.mutex);
+
+		sim->dropped += dropped;
+		if (usec >= (TCP_HIGH_MS + TCP_REACT_MS) * 1000)
+			sim->dropped_late += dropped;
+
+		os_sleep_ms(1);
+	}
+
+	test.stop = true;
+	pthread_mutex_lock(&test.mutex);
+	sim->num = 0;
+	pthread_mutex_unlock(&test.mutex);
+	os_sem_post(test.send_sem);
+
+	shutdown(test.fd, SHUT_RDWR);
+	pthread_join(sender, NULL);
+	pthread_join(sink, NULL);
+	close(test.fd);
+	close(test.listen_fd);
+
+	printf("%-20s min %5d kbps, end %5d kbps, %3d changes, "
+	       "peak queue %4d ms, %4d frames dropped\n",
+	       "loopback tcp sink", sim->min_kbps, sim->kbps, sim->changes,
+	       (int)(sim->peak_queue_usec / 1000), sim->dropped);
+
+	if (sim->dropped_late) {
+		printf("    %d frames dropped after the controller "
+		       "should have reacted\n", sim->dropped_late);
+		failures++;
+	}
+	if (sim->kbps + AUDIO_KBPS > TCP_LOW_KBPS) {
+		printf("    bitrate did not come down to the link\n");
+		failures++;
+	}
+
+	os_sem_destroy(test.send_sem);
+	pthread_mutex_destroy(&test.mutex);
+	free(sim);
+	return failures;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	int failures = 0;
+
+	if (argc > 1)
+		return replay_file(argv[1]);
+
+	for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++)
+		failures += replay(traces[i].name, traces[i].segments,
+				traces[i].num, &traces[i]);
+
+#ifndef _WIN32
+	failures += tcp_sink_test();
+#endif
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Looks up sources by name through the name index while it grows and while
+ * sources are renamed.  With duplicate names the lookup has to return the
+ * newest source, the same one walking the source list would find.
+ *
+ * usage: test-context-index
+ */
+
+#include <stdio.h>
+#include <obs.h>
+#include <util/dstr.h>
+
+#define FILLER_SOURCES 300
+
+static int failures = 0;
+
+static const char *index_test_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return "Index test";
+}
+
+static void *index_test_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void index_test_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static struct obs_source_info index_test_source = {
+	.id           = "index_test_source",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.get_name     = index_test_get_name,
+	.create       = index_test_create,
+	.destroy      = index_test_destroy
+};
+
+static void check_lookup(const char *step, const char *name,
+		obs_source_t *expected)
+{
+	obs_source_t *source = obs_get_source_by_name(name);
+
+	if (source != expected) {
+		printf("%s: '%s' found the wrong source\n", step, name);
+		failures++;
+	}
+
+	obs_source_release(source);
+}
+
+static obs_source_t *create_source(const char *name)
+{
+	return obs_source_create("index_test_source", name, NULL, NULL);
+}
+
+int main(void)
+{
+	obs_source_t *fillers[FILLER_SOURCES];
+	obs_source_t *older, *newer;
+	struct dstr name = {0};
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		printf("obs_startup failed\n");
+		return 1;
+	}
+
+	obs_register_source(&index_test_source);
+
+	older = create_source("duplicate");
+	newer = create_source("duplicate");
+	check_lookup("before growing", "duplicate", newer);
+
+	/* enough sources to grow the index several times */
+	for (size_t i = 0; i < FILLER_SOURCES; i++) {
+		dstr_printf(&name, "filler %d", (int)i);
+		fillers[i] = create_source(name.array);
+	}
+	check_lookup("after growing", "duplicate", newer);
+
+	/* renaming does not move a source in the list */
+	obs_source_set_name(older, "renamed");
+	check_lookup("renamed away", "duplicate", newer);
+	check_lookup("renamed away", "renamed", older);
+
+	obs_source_set_name(older, "duplicate");
+	check_lookup("renamed back", "duplicate", newer);
+
+	obs_source_set_name(fillers[0], "duplicate");
+	check_lookup("filler renamed", "duplicate", fillers[0]);
+	obs_source_set_name(fillers[0], "filler 0");
+
+	obs_source_release(newer);
+	check_lookup("newest released", "duplicate", older);
+
+	obs_source_release(older);
+	check_lookup("all released", "duplicate", NULL);
+
+	for (size_t i = 0; i < FILLER_SOURCES; i++)
+		obs_source_release(fillers[i]);
+
+	dstr_free(&name);
+	obs_shutdown();
+
+	if (failures)
+		printf("%d failed lookups\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,372 @@
+/*
+ * Checks every instruction set variant of the format conversion functions
+ * bit-for-bit against a plain C reference, over a frame size that leaves a
+ * tail for each vector width and also when converted in separate slices.
+ *
+ * usage: test-format-conversion
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/format-conversion.h>
+
+/* widths not divisible by 8 make the AVX2 functions run their tails */
+#define WIDTH  1284
+#define HEIGHT 36
+#define SLICE_Y 10
+
+static const char *isa_names[] = {"SSE2", "SSSE3", "AVX2"};
+
+static uint32_t rand_state = 0x12345678;
+
+static inline uint8_t rand_byte(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return (uint8_t)(rand_state >> 16);
+}
+
+static uint8_t *alloc_random(size_t size)
+{
+	uint8_t *data = bmalloc(size);
+	for (size_t i = 0; i < size; i++)
+		data[i] = rand_byte();
+	return data;
+}
+
+/* ------------------------------------------------------------------------- */
+/* reference implementations                                                 */
+
+static inline uint8_t uyvx_at(const uint8_t *input, uint32_t linesize,
+		uint32_t x, uint32_t y, int channel)
+{
+	return input[y * linesize + x * 4 + channel];
+}
+
+static inline uint8_t avg_2x2(const uint8_t *input, uint32_t linesize,
+		uint32_t x, uint32_t y, int channel)
+{
+	uint32_t sum = uyvx_at(input, linesize, x,   y,   channel) +
+	               uyvx_at(input, linesize, x+1, y,   channel) +
+	               uyvx_at(input, linesize, x,   y+1, channel) +
+	               uyvx_at(input, linesize, x+1, y+1, channel);
+	return (uint8_t)(sum >> 2);
+}
+
+static void ref_uyvx_to_i420(const uint8_t *input, uint32_t in_linesize,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	for (uint32_t y = 0; y < HEIGHT; y++) {
+		for (uint32_t x = 0; x < WIDTH; x++) {
+			output[0][y * out_linesize[0] + x] =
+				uyvx_at(input, in_linesize, x, y, 1);
+
+			if ((x & 1) || (y & 1))
+				continue;
+
+			output[1][y/2 * out_linesize[1] + x/2] =
+				avg_2x2(input, in_linesize, x, y, 0);
+			output[2][y/2 * out_linesize[2] + x/2] =
+				avg_2x2(input, in_linesize, x, y, 2);
+		}
+	}
+}
+
+static void ref_uyvx_to_nv12(const uint8_t *input, uint32_t in_linesize,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	for (uint32_t y = 0; y < HEIGHT; y++) {
+		for (uint32_t x = 0; x < WIDTH; x++) {
+			output[0][y * out_linesize[0] + x] =
+				uyvx_at(input, in_linesize, x, y, 1);
+
+			if ((x & 1) || (y & 1))
+				continue;
+
+			output[1][y/2 * out_linesize[1] + x] =
+				avg_2x2(input, in_linesize, x, y, 0);
+			output[1][y/2 * out_linesize[1] + x + 1] =
+				avg_2x2(input, in_linesize, x, y, 2);
+		}
+	}
+}
+
+static void ref_uyvx_to_i444(const uint8_t *input, uint32_t in_linesize,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	for (uint32_t y = 0; y < HEIGHT; y++) {
+		for (uint32_t x = 0; x < WIDTH; x++) {
+			uint32_t pos = y * out_linesize[0] + x;
+
+			output[0][pos] = uyvx_at(input, in_linesize, x, y, 1);
+			output[1][pos] = uyvx_at(input, in_linesize, x, y, 0);
+			output[2][pos] = uyvx_at(input, in_linesize, x, y, 2);
+		}
+	}
+}
+
+static inline void store_yuvx(uint8_t *output, uint32_t out_linesize,
+		uint32_t x, uint32_t y, uint8_t lum, uint8_t u, uint8_t v)
+{
+	uint8_t *px = output + y * out_linesize + x * 4;
+	px[0] = lum;
+	px[1] = u;
+	px[2] = v;
+	px[3] = 0;
+}
+
+static void ref_decompress_420(const uint8_t *const input[],
+		const uint32_t in_linesize[],
+		uint8_t *output, uint32_t out_linesize)
+{
+	for (uint32_t y = 0; y < HEIGHT; y++) {
+		for (uint32_t x = 0; x < WIDTH; x++) {
+			store_yuvx(output, out_linesize, x, y,
+				input[0][y * in_linesize[0] + x],
+				input[1][y/2 * in_linesize[1] + x/2],
+				input[2][y/2 * in_linesize[2] + x/2]);
+		}
+	}
+}
+
+static void ref_decompress_nv12(const uint8_t *const input[],
+		const uint32_t in_linesize[],
+		uint8_t *output, uint32_t out_linesize)
+{
+	for (uint32_t y = 0; y < HEIGHT; y++) {
+		for (uint32_t x = 0; x < WIDTH; x++) {
+			const uint8_t *uv = input[1] +
+				y/2 * in_linesize[1] + (x & ~1);
+
+			store_yuvx(output, out_linesize, x, y,
+				input[0][y * in_linesize[0] + x],
+				uv[0], uv[1]);
+		}
+	}
+}
+
+/* packed 422 keeps the byte order of the input, only the luma position of
+ * the second pixel of each pair is replaced */
+static void ref_decompress_422(const uint8_t *input, uint32_t in_linesize,
+		uint8_t *output, uint32_t out_linesize, bool leading_lum)
+{
+	int lum0 = leading_lum ? 0 : 1;
+
+	for (uint32_t y = 0; y < HEIGHT; y++) {
+		for (uint32_t x = 0; x < WIDTH; x += 2) {
+			const uint8_t *pair = input + y * in_linesize + x * 2;
+			uint8_t *px = output + y * out_linesize + x * 4;
+
+			memcpy(px,     pair, 4);
+			memcpy(px + 4, pair, 4);
+			px[4 + lum0] = pair[lum0 + 2];
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct planes {
+	uint8_t  *data[3];
+	uint32_t linesize[3];
+	size_t   size[3];
+};
+
+static void planes_init(struct planes *planes, uint32_t lum_linesize,
+		uint32_t chroma_linesize, uint32_t chroma_height, int count)
+{
+	memset(planes, 0, sizeof(*planes));
+
+	for (int i = 0; i < count; i++) {
+		planes->linesize[i] = i ? chroma_linesize : lum_linesize;
+		planes->size[i] = (size_t)planes->linesize[i] *
+			(i ? chroma_height : HEIGHT);
+		planes->data[i] = bzalloc(planes->size[i]);
+	}
+}
+
+static void planes_free(struct planes *planes)
+{
+	for (int i = 0; i < 3; i++)
+		bfree(planes->data[i]);
+}
+
+static void planes_clear(struct planes *planes)
+{
+	for (int i = 0; i < 3; i++)
+		if (planes->data[i])
+			memset(planes->data[i], 0, planes->size[i]);
+}
+
+static bool planes_equal(const struct planes *a, const struct planes *b)
+{
+	for (int i = 0; i < 3; i++)
+		if (a->data[i] && memcmp(a->data[i], b->data[i], a->size[i]))
+			return false;
+	return true;
+}
+
+static int failures = 0;
+
+static void report(const char *isa, const char *func, bool slices, bool ok)
+{
+	printf("%-6s %-22s %-7s %s\n", isa, func, slices ? "slices" : "frame",
+			ok ? "ok" : "MISMATCH");
+	if (!ok)
+		failures++;
+}
+
+typedef void (*compress_func_t)(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+
+static void check_compress(const char *isa, const char *name,
+		compress_func_t func, const uint8_t *input,
+		uint32_t in_linesize, const struct planes *expected,
+		struct planes *actual)
+{
+	planes_clear(actual);
+	func(input, in_linesize, 0, HEIGHT, actual->data, actual->linesize);
+	report(isa, name, false, planes_equal(expected, actual));
+
+	planes_clear(actual);
+	func(input, in_linesize, 0, SLICE_Y, actual->data, actual->linesize);
+	func(input, in_linesize, SLICE_Y, HEIGHT,
+			actual->data, actual->linesize);
+	report(isa, name, true, planes_equal(expected, actual));
+}
+
+static void test_compress(const char *isa)
+{
+	uint32_t in_linesize = WIDTH * 4;
+	uint8_t  *input = alloc_random((size_t)in_linesize * HEIGHT);
+	struct planes expected, actual;
+
+	planes_init(&expected, WIDTH, WIDTH/2, HEIGHT/2, 3);
+	planes_init(&actual,   WIDTH, WIDTH/2, HEIGHT/2, 3);
+	ref_uyvx_to_i420(input, in_linesize, expected.data, expected.linesize);
+	check_compress(isa, "compress_uyvx_to_i420", compress_uyvx_to_i420,
+			input, in_linesize, &expected, &actual);
+	planes_free(&expected);
+	planes_free(&actual);
+
+	planes_init(&expected, WIDTH, WIDTH, HEIGHT/2, 2);
+	planes_init(&actual,   WIDTH, WIDTH, HEIGHT/2, 2);
+	ref_uyvx_to_nv12(input, in_linesize, expected.data, expected.linesize);
+	check_compress(isa, "compress_uyvx_to_nv12", compress_uyvx_to_nv12,
+			input, in_linesize, &expected, &actual);
+	planes_free(&expected);
+	planes_free(&actual);
+
+	planes_init(&expected, WIDTH, WIDTH, HEIGHT, 3);
+	planes_init(&actual,   WIDTH, WIDTH, HEIGHT, 3);
+	ref_uyvx_to_i444(input, in_linesize, expected.data, expected.linesize);
+	check_compress(isa, "convert_uyvx_to_i444", convert_uyvx_to_i444,
+			input, in_linesize, &expected, &actual);
+	planes_free(&expected);
+	planes_free(&actual);
+
+	bfree(input);
+}
+
+typedef void (*decompress_planar_func_t)(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize);
+
+static void check_decompress_planar(const char *isa, const char *name,
+		decompress_planar_func_t func, const struct planes *input,
+		const uint8_t *expected, uint8_t *actual, size_t size)
+{
+	const uint8_t *const *data = (const uint8_t *const *)input->data;
+	uint32_t out_linesize = WIDTH * 4;
+
+	memset(actual, 0, size);
+	func(data, input->linesize, 0, HEIGHT, actual, out_linesize);
+	report(isa, name, false, memcmp(expected, actual, size) == 0);
+
+	memset(actual, 0, size);
+	func(data, input->linesize, 0, SLICE_Y, actual, out_linesize);
+	func(data, input->linesize, SLICE_Y, HEIGHT, actual, out_linesize);
+	report(isa, name, true, memcmp(expected, actual, size) == 0);
+}
+
+static void test_decompress(const char *isa)
+{
+	uint32_t out_linesize = WIDTH * 4;
+	size_t   size = (size_t)out_linesize * HEIGHT;
+	uint8_t  *expected = bmalloc(size);
+	uint8_t  *actual = bmalloc(size);
+	const uint8_t *const *data;
+	struct planes input;
+	uint8_t  *packed;
+
+	planes_init(&input, WIDTH, WIDTH/2, HEIGHT/2, 3);
+	for (int i = 0; i < 3; i++)
+		for (size_t j = 0; j < input.size[i]; j++)
+			input.data[i][j] = rand_byte();
+	data = (const uint8_t *const *)input.data;
+
+	ref_decompress_420(data, input.linesize, expected, out_linesize);
+	check_decompress_planar(isa, "decompress_420", decompress_420,
+			&input, expected, actual, size);
+	planes_free(&input);
+
+	planes_init(&input, WIDTH, WIDTH, HEIGHT/2, 2);
+	for (int i = 0; i < 2; i++)
+		for (size_t j = 0; j < input.size[i]; j++)
+			input.data[i][j] = rand_byte();
+	data = (const uint8_t *const *)input.data;
+
+	ref_decompress_nv12(data, input.linesize, expected, out_linesize);
+	check_decompress_planar(isa, "decompress_nv12", decompress_nv12,
+			&input, expected, actual, size);
+	planes_free(&input);
+
+	packed = alloc_random((size_t)WIDTH * 2 * HEIGHT);
+
+	for (int leading_lum = 0; leading_lum < 2; leading_lum++) {
+		const char *name = leading_lum ?
+			"decompress_422 (yuyv)" : "decompress_422 (uyvy)";
+
+		ref_decompress_422(packed, WIDTH * 2, expected, out_linesize,
+				leading_lum);
+
+		memset(actual, 0, size);
+		decompress_422(packed, WIDTH * 2, 0, HEIGHT,
+				actual, out_linesize, leading_lum);
+		report(isa, name, false, memcmp(expected, actual, size) == 0);
+
+		memset(actual, 0, size);
+		decompress_422(packed, WIDTH * 2, 0, SLICE_Y,
+				actual, out_linesize, leading_lum);
+		decompress_422(packed, WIDTH * 2, SLICE_Y, HEIGHT,
+				actual, out_linesize, leading_lum);
+		report(isa, name, true, memcmp(expected, actual, size) == 0);
+	}
+
+	bfree(packed);
+	bfree(expected);
+	bfree(actual);
+}
+
+int main(void)
+{
+	for (size_t i = 0; i < sizeof(isa_names)/sizeof(isa_names[0]); i++) {
+		if (!format_conversion_set_isa(isa_names[i])) {
+			printf("%-6s not supported by this CPU, skipped\n",
+					isa_names[i]);
+			continue;
+		}
+
+		test_compress(isa_names[i]);
+		test_decompress(isa_names[i]);
+	}
+
+	if (failures)
+		printf("%d mismatches\n", failures);
+
+	return failures ? 1 : 0;
+}
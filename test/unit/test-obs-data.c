@@ -0,0 +1,107 @@
+/*
+ * Sets, erases and looks up keys of an obs_data object while its name index
+ * is built, while the item count drops below the size the index is built at,
+ * and after items are added again.  Every key has to stay findable and
+ * setting an existing key must never add a second item.
+ *
+ * usage: test-obs-data
+ */
+
+#include <stdio.h>
+#include <obs-data.h>
+#include <util/dstr.h>
+
+#define NUM_KEYS 40
+
+static int failures = 0;
+
+static void check_key(const char *step, obs_data_t *data, const char *name,
+		long long expected)
+{
+	long long val = obs_data_get_int(data, name);
+
+	if (!obs_data_has_user_value(data, name) || val != expected) {
+		printf("%s: '%s' is %lld, expected %lld\n", step, name, val,
+				expected);
+		failures++;
+	}
+}
+
+static void check_missing(const char *step, obs_data_t *data,
+		const char *name)
+{
+	if (obs_data_has_user_value(data, name)) {
+		printf("%s: '%s' should have been erased\n", step, name);
+		failures++;
+	}
+}
+
+static void check_count(const char *step, obs_data_t *data, size_t expected)
+{
+	size_t count = 0;
+
+	for (obs_data_item_t *item = obs_data_first(data); item;
+			obs_data_item_next(&item))
+		count++;
+
+	if (count != expected) {
+		printf("%s: %d items, expected %d\n", step, (int)count,
+				(int)expected);
+		failures++;
+	}
+}
+
+static const char *key(struct dstr *name, int i)
+{
+	dstr_printf(name, "key %d", i);
+	return name->array;
+}
+
+int main(void)
+{
+	obs_data_t *data = obs_data_create();
+	struct dstr name = {0};
+
+	/* grow past the size the index is built at */
+	for (int i = 0; i < 16; i++)
+		obs_data_set_int(data, key(&name, i), i);
+	check_count("grown", data, 16);
+
+	/* shrink below it, then add more */
+	obs_data_erase(data, key(&name, 0));
+	obs_data_erase(data, key(&name, 1));
+	check_missing("shrunk", data, key(&name, 0));
+
+	obs_data_set_int(data, "zz", 100);
+	check_key("added after shrinking", data, "zz", 100);
+	obs_data_set_int(data, "zz", 101);
+	check_key("set again", data, "zz", 101);
+	check_count("set again", data, 15);
+
+	for (int i = 2; i < 16; i++)
+		check_key("added after shrinking", data, key(&name, i), i);
+
+	/* grow well past it so the index is rebuilt, then erase most keys
+	 * and keep adding and replacing */
+	for (int i = 16; i < NUM_KEYS; i++)
+		obs_data_set_int(data, key(&name, i), i);
+	for (int i = 2; i < NUM_KEYS - 4; i++)
+		obs_data_erase(data, key(&name, i));
+	check_count("mostly erased", data, 5);
+
+	for (int i = 0; i < NUM_KEYS; i++)
+		obs_data_set_int(data, key(&name, i), i * 2);
+	obs_data_set_int(data, "zz", 102);
+
+	for (int i = 0; i < NUM_KEYS; i++)
+		check_key("added again", data, key(&name, i), i * 2);
+	check_key("added again", data, "zz", 102);
+	check_count("added again", data, NUM_KEYS + 1);
+
+	dstr_free(&name);
+	obs_data_release(data);
+
+	if (failures)
+		printf("%d failed checks\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * Disconnects a callback from inside another callback of the same signal
+ * while other threads keep emitting it, then marks the callback's data as
+ * freed.  signal_handler_disconnect must not return while another thread is
+ * still inside the disconnected callback.
+ *
+ * usage: test-signal
+ */
+
+#include <stdio.h>
+#include <callback/signal.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <util/bmem.h>
+
+#define EMIT_THREADS 3
+#define TEST_DURATION_MS 2000
+
+struct target {
+	volatile bool alive;
+};
+
+static signal_handler_t *handler;
+static struct target *volatile current;
+static volatile bool stop;
+static volatile long calls, replaced, failures;
+
+static void target_callback(void *data, calldata_t *params)
+{
+	struct target *target = data;
+
+	/* give disconnect a chance to return while this is still running */
+	for (int i = 0; i < 2; i++) {
+		if (!os_atomic_load_bool(&target->alive))
+			os_atomic_inc_long(&failures);
+		for (volatile int j = 0; j < 2000; j++);
+	}
+
+	os_atomic_inc_long(&calls);
+	UNUSED_PARAMETER(params);
+}
+
+/* swaps the current target for a new one from inside the signal */
+static void replace_callback(void *data, calldata_t *params)
+{
+	struct target *target = os_atomic_set_ptr((void *volatile*)&current,
+			NULL);
+	struct target *next;
+
+	if (!target)
+		return;
+
+	signal_handler_disconnect(handler, "test", target_callback, target);
+	os_atomic_set_bool(&target->alive, false);
+
+	next = bzalloc(sizeof(struct target));
+	next->alive = true;
+	signal_handler_connect(handler, "test", target_callback, next);
+	os_atomic_set_ptr((void *volatile*)&current, next);
+
+	os_atomic_inc_long(&replaced);
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(params);
+}
+
+static void *emit_thread(void *param)
+{
+	calldata_t params = {0};
+
+	while (!os_atomic_load_bool(&stop))
+		signal_handler_signal(handler, "test", &params);
+
+	calldata_free(&params);
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+int main(void)
+{
+	pthread_t threads[EMIT_THREADS];
+	struct target *first;
+
+	handler = signal_handler_create();
+	signal_handler_add(handler, "void test()");
+
+	first = bzalloc(sizeof(struct target));
+	first->alive = true;
+	current = first;
+	signal_handler_connect(handler, "test", target_callback, first);
+	signal_handler_connect(handler, "test", replace_callback, NULL);
+
+	for (size_t i = 0; i < EMIT_THREADS; i++)
+		pthread_create(&threads[i], NULL, emit_thread, NULL);
+
+	os_sleep_ms(TEST_DURATION_MS);
+	os_atomic_set_bool(&stop, true);
+
+	for (size_t i = 0; i < EMIT_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	signal_handler_destroy(handler);
+
+	/* targets are leaked on purpose so that late calls read valid
+	 * memory and get counted instead of crashing */
+	printf("%ld calls, %ld disconnects from a callback, "
+	       "%ld calls after disconnect\n", calls, replaced, failures);
+
+	return failures ? 1 : 0;
+}